@@ -3,222 +3,81 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#include <math.h>
-#include <stdio.h>
-#include <time.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
-#include <zros/private/zros_node_struct.h>
-#include <zros/private/zros_pub_struct.h>
-#include <zros/private/zros_sub_struct.h>
-#include <zros/zros_node.h>
-#include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
-#include <synapse_topic_list.h>
-
-#include <cerebri/core/casadi.h>
+#include <cerebri/core/estimate.h>
+#include <cerebri/core/sched.h>
 
 #include "casadi/gen/b3rb.h"
+#include "executor.h"
 
 LOG_MODULE_REGISTER(b3rb_estimate, CONFIG_CEREBRI_B3RB_LOG_LEVEL);
 
 #define MY_STACK_SIZE 4096
 #define MY_PRIORITY 4
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
-// private context
-typedef struct _context {
-    struct zros_node node;
-    synapse_msgs_WheelOdometry wheel_odometry;
-    synapse_msgs_Imu imu;
-    synapse_msgs_Odometry odometry;
-    struct zros_sub sub_wheel_odometry, sub_imu;
-    struct zros_pub pub_odometry;
-    double x[3];
-    const double wheel_radius;
-} context;
-
-// private initialization
-static context g_ctx = {
-    .node = {},
-    .wheel_odometry = synapse_msgs_WheelOdometry_init_default,
-    .imu = synapse_msgs_Imu_init_default,
-    .odometry = {
-        .child_frame_id = "base_link",
-        .has_header = true,
-        .header.frame_id = "odom",
-        .has_pose = true,
-        .pose.has_pose = true,
-        .pose.pose.has_position = true,
-        .pose.pose.has_orientation = true,
-    },
-    .sub_wheel_odometry = {},
-    .sub_imu = {},
-    .pub_odometry = {},
-    .x = {},
+static const struct estimate_model g_model = {
+    .name = "b3rb_estimate",
+    .predict = predict,
+    .predict_work = predict_work,
     .wheel_radius = CONFIG_CEREBRI_B3RB_WHEEL_RADIUS_MM / 1000.0,
 };
 
-static void estimate_rover2d_init(context* ctx)
-{
-    zros_node_init(&ctx->node, "b3rb_estimate");
-    zros_sub_init(&ctx->sub_imu, &ctx->node, &topic_imu, &ctx->imu, 10);
-    zros_sub_init(&ctx->sub_wheel_odometry, &ctx->node, &topic_wheel_odometry,
-        &ctx->wheel_odometry, 10);
-    zros_pub_init(&ctx->pub_odometry, &ctx->node, &topic_estimator_odometry, &ctx->odometry);
-}
+static struct estimate g_estimate;
 
-static bool all_finite(double* src, size_t n)
+void b3rb_estimate_init(int rate_hz)
 {
-    for (size_t i = 0; i < n; i++) {
-        if (!isfinite(src[i])) {
-            return false;
-        }
+    if (estimate_init(&g_estimate, &g_model, rate_hz) < 0) {
+        LOG_ERR("init failed");
     }
-    return true;
 }
 
-static void handle_update(context* ctx, double* x1)
+void b3rb_estimate_step(void)
 {
-    bool x1_finite = all_finite(x1, ARRAY_SIZE(ctx->x));
+    estimate_step(&g_estimate);
+}
 
-    if (!x1_finite) {
-        LOG_WRN("x1 update not finite");
-    }
+#if !defined(CONFIG_CEREBRI_B3RB_EXECUTOR)
+// the imu rate, predict runs on each sample
+#define IMU_RATE_HZ 200
 
-    if (x1_finite) {
-        memcpy(ctx->x, x1, sizeof(ctx->x));
-    }
-}
+SCHED_GROUP_DEFINE(b3rb_estimate, 1000000 / IMU_RATE_HZ, 1000, 500);
 
 static void b3rb_estimate_entry_point(void* p0, void* p1, void* p2)
 {
     LOG_INF("init");
-    context* ctx = p0;
+    struct estimate* est = p0;
     ARG_UNUSED(p1);
     ARG_UNUSED(p2);
 
-    int rc = 0;
-
-    // LOG_DBG("started");
-    estimate_rover2d_init(ctx);
-
-    // variables
-    int32_t seq = 0;
-    double rotation_last = 0;
-
-    struct k_poll_event events[1] = {};
-
-    // wait for imu
-    LOG_DBG("waiting for imu");
-    events[0] = *zros_sub_get_event(&ctx->sub_imu);
-    rc = k_poll(events, ARRAY_SIZE(events), K_FOREVER);
-    if (rc != 0) {
-        LOG_DBG("did not receive imu");
+    if (estimate_init(est, &g_model, IMU_RATE_HZ) < 0) {
+        LOG_ERR("init failed");
         return;
     }
-    if (zros_sub_update_available(&ctx->sub_imu)) {
-        zros_sub_update(&ctx->sub_imu);
-    }
-
-    // wait for wheel odometry
-    LOG_DBG("waiting for wheel odometry");
-    events[0] = *zros_sub_get_event(&ctx->sub_wheel_odometry);
-    rc = k_poll(events, ARRAY_SIZE(events), K_FOREVER);
-    if (rc != 0) {
-        LOG_DBG("did not receive wheel odometry");
-        return;
-    }
-    if (zros_sub_update_available(&ctx->sub_wheel_odometry)) {
-        zros_sub_update(&ctx->sub_wheel_odometry);
-    }
-
-    double dt = 0;
-    int64_t ticks_last = k_uptime_ticks();
+    sched_group_attach(&sched_group_b3rb_estimate);
 
     // poll on imu
-    events[0] = *zros_sub_get_event(&ctx->sub_imu);
+    struct k_poll_event events[] = {
+        *zros_sub_get_event(&est->sub_imu),
+    };
 
-    // estimator state
     while (true) {
-
-        // poll for imu
-        rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
+        int rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
         if (rc != 0) {
             LOG_DBG("not receiving imu");
             continue;
         }
-
-        if (zros_sub_update_available(&ctx->sub_imu)) {
-            zros_sub_update(&ctx->sub_imu);
-        }
-
-        if (zros_sub_update_available(&ctx->sub_wheel_odometry)) {
-            zros_sub_update(&ctx->sub_wheel_odometry);
-        }
-
-        // calculate dt
-        int64_t ticks_now = k_uptime_ticks();
-        dt = (float)(ticks_now - ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-        ticks_last = ticks_now;
-        if (dt < 0 || dt > 0.5) {
-            LOG_WRN("imu update rate too low");
-            continue;
-        }
-
-        // get data
-        double rotation = ctx->wheel_odometry.rotation;
-
-        // negative sign due to current gearing, should be in driver
-        double u = (rotation - rotation_last) * ctx->wheel_radius;
-        rotation_last = rotation;
-
-        double omega = ctx->imu.angular_velocity.z;
-        // LOG_DBG("imu omega z: %10.4f", omega);
-
-        /* predict:(x0[3],omega,u)->(x1[3]) */
-        {
-            double delta_theta = omega * dt;
-            double x1[3];
-
-            // LOG_DBG("predict");
-            CASADI_FUNC_ARGS(predict);
-            args[0] = ctx->x;
-            args[1] = &delta_theta;
-            args[2] = &u;
-            res[0] = x1;
-            CASADI_FUNC_CALL(predict);
-
-            // update x, W
-            handle_update(ctx, x1);
-        }
-
-        // publish odometry
-        {
-            stamp_header(&ctx->odometry.header, k_uptime_ticks());
-            ctx->odometry.header.seq = seq++;
-
-            double theta = ctx->x[2];
-            ctx->odometry.pose.pose.position.x = ctx->x[0];
-            ctx->odometry.pose.pose.position.y = ctx->x[1];
-            ctx->odometry.pose.pose.position.z = 0;
-            ctx->odometry.pose.pose.orientation.x = 0;
-            ctx->odometry.pose.pose.orientation.y = 0;
-            ctx->odometry.pose.pose.orientation.z = sin(theta / 2);
-            ctx->odometry.pose.pose.orientation.w = cos(theta / 2);
-            ctx->odometry.twist.twist.angular.z = omega;
-            ctx->odometry.twist.twist.linear.x = u;
-            zros_pub_update(&ctx->pub_odometry);
-        }
+        sched_job_begin(&sched_group_b3rb_estimate);
+        estimate_step(est);
+        sched_job_end(&sched_group_b3rb_estimate);
     }
 }
 
 K_THREAD_DEFINE(b3rb_estimate, MY_STACK_SIZE, b3rb_estimate_entry_point,
-    &g_ctx, NULL, NULL, MY_PRIORITY, 0, 1000);
+    &g_estimate, NULL, NULL, MY_PRIORITY, 0, 1000);
+#endif
 
 /* vi: ts=4 sw=4 et */
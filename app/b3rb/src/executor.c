@@ -0,0 +1,128 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_sub_struct.h>
+#include <zros/zros_node.h>
+#include <zros/zros_sub.h>
+
+#include <synapse_topic_list.h>
+
+#include <cerebri/actuate/pwm.h>
+#include <cerebri/core/sched.h>
+#include <cerebri/core/trace.h>
+#include <cerebri/sense/imu.h>
+
+#include "executor.h"
+
+LOG_MODULE_REGISTER(b3rb_executor, CONFIG_CEREBRI_B3RB_LOG_LEVEL);
+
+// the steps run in sequence, so the stack only holds the deepest one,
+// the 4 KB of the estimate, mpc position and pwm threads, plus the frame
+// of the loop, the casadi workspaces are in the contexts of the steps
+#define MY_STACK_SIZE 5120
+#define MY_PRIORITY 2
+
+#define RATE_HZ CONFIG_CEREBRI_B3RB_EXECUTOR_RATE_HZ
+#define PERIOD_US (1000000 / RATE_HZ)
+
+BUILD_ASSERT(CONFIG_SYS_CLOCK_TICKS_PER_SEC % RATE_HZ == 0,
+    "executor rate must divide the system clock tick rate");
+
+// the whole loop is one job, it must finish within its period
+SCHED_GROUP_DEFINE(b3rb_executor, PERIOD_US, PERIOD_US, PERIOD_US / 2);
+
+typedef struct _context {
+    struct zros_node node;
+    synapse_msgs_Status status;
+    synapse_msgs_Actuators actuators;
+    struct zros_sub sub_status, sub_actuators;
+    struct trace_origin origin;
+} context;
+
+static context g_ctx = {
+    .node = {},
+    .status = synapse_msgs_Status_init_default,
+    .actuators = synapse_msgs_Actuators_init_default,
+    .sub_status = {},
+    .sub_actuators = {},
+    .origin = {},
+};
+
+static void executor_init(context* ctx)
+{
+    zros_node_init(&ctx->node, "b3rb_executor");
+    zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, RATE_HZ);
+    zros_sub_init(&ctx->sub_actuators, &ctx->node, &topic_actuators, &ctx->actuators, RATE_HZ);
+    b3rb_estimate_init(RATE_HZ);
+    b3rb_position_init(RATE_HZ);
+    b3rb_velocity_init(RATE_HZ);
+}
+
+// sense -> estimate -> position -> velocity -> actuate, each step
+// publishes its topic, so the next step sees it on its subscription
+static void executor_step(context* ctx)
+{
+#if defined(CONFIG_CEREBRI_SENSE_IMU)
+    sense_imu_step();
+#endif
+    b3rb_estimate_step();
+    b3rb_position_step();
+    b3rb_velocity_step();
+
+    if (zros_sub_update_available(&ctx->sub_status)) {
+        zros_sub_update(&ctx->sub_status);
+    }
+
+    if (zros_sub_update_available(&ctx->sub_actuators)) {
+        zros_sub_update(&ctx->sub_actuators);
+        trace_consume(TRACE_TOPIC_ACTUATORS, &ctx->origin);
+    }
+
+#if defined(CONFIG_CEREBRI_ACTUATE_PWM)
+    pwm_update(&ctx->status, &ctx->actuators);
+    trace_point(&ctx->origin, TRACE_STAGE_ACTUATE);
+#endif
+}
+
+static void b3rb_executor_entry_point(void* p0, void* p1, void* p2)
+{
+    LOG_INF("init %d Hz", RATE_HZ);
+    context* ctx = p0;
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+
+    executor_init(ctx);
+    sched_group_attach(&sched_group_b3rb_executor);
+
+    const int64_t period_ticks = CONFIG_SYS_CLOCK_TICKS_PER_SEC / RATE_HZ;
+    int64_t ticks_next = k_uptime_ticks();
+
+    while (true) {
+        k_sleep(K_TIMEOUT_ABS_TICKS(ticks_next));
+        ticks_next += period_ticks;
+
+        sched_job_begin(&sched_group_b3rb_executor);
+        executor_step(ctx);
+        sched_job_end(&sched_group_b3rb_executor);
+
+        // after an overrun, skip the missed ticks instead of catching up
+        int64_t ticks_now = k_uptime_ticks();
+        if (ticks_now >= ticks_next) {
+            int64_t missed = (ticks_now - ticks_next) / period_ticks + 1;
+            LOG_DBG("overrun, skipped %d ticks", (int)missed);
+            ticks_next += missed * period_ticks;
+        }
+    }
+}
+
+K_THREAD_DEFINE(b3rb_executor, MY_STACK_SIZE,
+    b3rb_executor_entry_point, &g_ctx, NULL, NULL,
+    MY_PRIORITY, 0, 1000);
+
+/* vi: ts=4 sw=4 et */
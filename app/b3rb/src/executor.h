@@ -0,0 +1,26 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CEREBRI_B3RB_EXECUTOR_H
+#define CEREBRI_B3RB_EXECUTOR_H
+
+/*
+ * Nodes of the control loop, run by their own threads or, with
+ * CONFIG_CEREBRI_B3RB_EXECUTOR, one after the other by the executor.
+ * Each step consumes the latest messages on the node subscriptions and
+ * publishes its topic as the thread would. Init takes the rate of the
+ * subscriptions to the previous node.
+ */
+void b3rb_estimate_init(int rate_hz);
+void b3rb_estimate_step(void);
+
+void b3rb_position_init(int rate_hz);
+void b3rb_position_step(void);
+
+void b3rb_velocity_init(int rate_hz);
+void b3rb_velocity_step(void);
+
+#endif // CEREBRI_B3RB_EXECUTOR_H
+/* vi: ts=4 sw=4 et */
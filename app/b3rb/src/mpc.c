@@ -0,0 +1,163 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "mpc.h"
+
+void mpc_init(struct mpc* mpc, const struct mpc_params* params)
+{
+    memset(mpc, 0, sizeof(*mpc));
+    mpc->params = params;
+}
+
+// condensed QP of the horizon, H = R + sum G_k^T Q G_k, f = sum G_k^T Q x_k
+// with G_k the input to error map and x_k the free response at step k
+static void condense(struct mpc* mpc, const double e[MPC_NX], const double V[MPC_N],
+    const double omega[MPC_N])
+{
+    const struct mpc_params* p = mpc->params;
+    const double dt = p->dt;
+    const double* q = p->q;
+    double G[MPC_NX][MPC_NZ];
+    double x[MPC_NX] = { e[0], e[1], e[2] };
+
+    memset(mpc->H, 0, sizeof(mpc->H));
+    memset(mpc->f, 0, sizeof(mpc->f));
+    memset(G, 0, sizeof(G));
+    for (int i = 0; i < MPC_NZ; i++) {
+        mpc->H[i][i] = p->r[i % MPC_NU];
+    }
+
+    // steering at the reference speed bounds the turn rate
+    double k_turn = tan(p->max_turn_angle) / p->wheel_base;
+
+    for (int k = 0; k < MPC_N; k++) {
+        int n = MPC_NU * k;
+
+        // x <- A_k x and G <- A_k G over the inputs so far,
+        // A_k = I + dt [0 omega 0; -omega 0 V; 0 0 0]
+        const double a01 = dt * omega[k];
+        const double a12 = dt * V[k];
+        double x0 = x[0];
+        x[0] += a01 * x[1];
+        x[1] += -a01 * x0 + a12 * x[2];
+        for (int j = 0; j < n; j++) {
+            double g0 = G[0][j];
+            G[0][j] += a01 * G[1][j];
+            G[1][j] += -a01 * g0 + a12 * G[2][j];
+        }
+
+        // B = dt [-1 0; 0 0; 0 -1] for u_k
+        G[0][n] = -dt;
+        G[2][n + 1] = -dt;
+        n += MPC_NU;
+
+        // lower triangle of G^T Q G, and G^T Q x
+        for (int i = 0; i < n; i++) {
+            double qg0 = q[0] * G[0][i];
+            double qg1 = q[1] * G[1][i];
+            double qg2 = q[2] * G[2][i];
+            for (int j = 0; j <= i; j++) {
+                mpc->H[i][j] += qg0 * G[0][j] + qg1 * G[1][j] + qg2 * G[2][j];
+            }
+            mpc->f[i] += qg0 * x[0] + qg1 * x[1] + qg2 * x[2];
+        }
+
+        // 0 <= v <= max_velocity, |w| <= |V| tan(max_turn_angle) / L
+        double w_max = fabs(V[k]) * k_turn;
+        mpc->lb[MPC_NU * k] = -V[k];
+        mpc->ub[MPC_NU * k] = p->max_velocity - V[k];
+        mpc->lb[MPC_NU * k + 1] = -w_max - omega[k];
+        mpc->ub[MPC_NU * k + 1] = w_max - omega[k];
+    }
+
+    for (int i = 0; i < MPC_NZ; i++) {
+        for (int j = 0; j < i; j++) {
+            mpc->H[j][i] = mpc->H[i][j];
+        }
+    }
+}
+
+static double clamp(double x, double lo, double hi)
+{
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+// fixed iterations of the fast projected gradient method, on the QP
+// scaled to a unit diagonal, which evens out the curvature of speed and
+// turn rate inputs
+static void solve_qp(struct mpc* mpc)
+{
+    double d[MPC_NZ];
+    for (int i = 0; i < MPC_NZ; i++) {
+        d[i] = 1 / sqrt(mpc->H[i][i]);
+    }
+
+    // Gershgorin bound on the largest eigenvalue of D H D
+    double L = 0;
+    for (int i = 0; i < MPC_NZ; i++) {
+        double sum = 0;
+        for (int j = 0; j < MPC_NZ; j++) {
+            mpc->H[i][j] *= d[i] * d[j];
+            sum += fabs(mpc->H[i][j]);
+        }
+        mpc->f[i] *= d[i];
+        mpc->lb[i] /= d[i];
+        mpc->ub[i] /= d[i];
+        L = sum > L ? sum : L;
+    }
+
+    // z = D s
+    double s[MPC_NZ];
+    double y[MPC_NZ];
+    for (int i = 0; i < MPC_NZ; i++) {
+        s[i] = clamp(mpc->z[i] / d[i], mpc->lb[i], mpc->ub[i]);
+        y[i] = s[i];
+    }
+
+    double t = 1;
+    for (int it = 0; it < mpc->params->iterations; it++) {
+        double t_next = (1 + sqrt(1 + 4 * t * t)) / 2;
+        double beta = (t - 1) / t_next;
+        double s_next[MPC_NZ];
+        for (int i = 0; i < MPC_NZ; i++) {
+            double g = mpc->f[i];
+            for (int j = 0; j < MPC_NZ; j++) {
+                g += mpc->H[i][j] * y[j];
+            }
+            s_next[i] = clamp(y[i] - g / L, mpc->lb[i], mpc->ub[i]);
+        }
+        for (int i = 0; i < MPC_NZ; i++) {
+            y[i] = s_next[i] + beta * (s_next[i] - s[i]);
+            s[i] = s_next[i];
+        }
+        t = t_next;
+    }
+
+    for (int i = 0; i < MPC_NZ; i++) {
+        mpc->z[i] = d[i] * s[i];
+    }
+}
+
+int mpc_solve(struct mpc* mpc, const double e[MPC_NX], const double V[MPC_N],
+    const double omega[MPC_N], double* v, double* w)
+{
+    condense(mpc, e, V, omega);
+    solve_qp(mpc);
+    *v = V[0] + mpc->z[0];
+    *w = omega[0] + mpc->z[1];
+
+    // a bad input, don't warm start the next solve from it
+    if (!isfinite(*v) || !isfinite(*w)) {
+        memset(mpc->z, 0, sizeof(mpc->z));
+        return -EDOM;
+    }
+    return 0;
+}
+
+/* vi: ts=4 sw=4 et */
@@ -0,0 +1,73 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CEREBRI_B3RB_MPC_H
+#define CEREBRI_B3RB_MPC_H
+
+/*
+ * Linear model predictive control of the path following error.
+ *
+ * The error e = [e_x, e_y, e_theta] is the reference seen from the
+ * rover, the se2_error of the pose and the reference. Linearized about
+ * the reference speed V and turn rate omega, with the command deviations
+ * u = [v - V, w - omega],
+ *
+ *   e_x'     =  omega e_y - u_v
+ *   e_y'     = -omega e_x + V e_theta
+ *   e_theta' = -u_w
+ *
+ * and stepped by Euler over the horizon, with V and omega taken along
+ * the trajectory at each step. The inputs are condensed into a QP in
+ * u_0 ... u_N-1, with the speed in [0, max_velocity] and the turn rate
+ * limited to the steering angle at the reference speed. The QP, scaled
+ * to a unit diagonal, is solved by a fixed number of accelerated
+ * projected gradient steps, warm started from the previous solution,
+ * so the solve time is bounded and nothing is allocated.
+ */
+
+// steps in the horizon
+#if defined(CONFIG_CEREBRI_B3RB_MPC_HORIZON)
+#define MPC_N CONFIG_CEREBRI_B3RB_MPC_HORIZON
+#else
+#define MPC_N 10
+#endif
+
+#define MPC_NX 3
+#define MPC_NU 2
+#define MPC_NZ (MPC_NU * MPC_N)
+
+struct mpc_params {
+    // s, step of the horizon
+    double dt;
+    // weights of the error and of the command deviations
+    double q[MPC_NX];
+    double r[MPC_NU];
+    // m/s, rad, m
+    double max_velocity;
+    double max_turn_angle;
+    double wheel_base;
+    int iterations;
+};
+
+struct mpc {
+    const struct mpc_params* params;
+    // 1/2 z^T H z + f^T z, lb <= z <= ub
+    double H[MPC_NZ][MPC_NZ];
+    double f[MPC_NZ];
+    double lb[MPC_NZ];
+    double ub[MPC_NZ];
+    // solution, warm starts the next solve
+    double z[MPC_NZ];
+};
+
+void mpc_init(struct mpc* mpc, const struct mpc_params* params);
+
+// from the error and the reference over the horizon, the speed and turn
+// rate to command now, -EDOM if they aren't finite
+int mpc_solve(struct mpc* mpc, const double e[MPC_NX], const double V[MPC_N],
+    const double omega[MPC_N], double* v, double* w);
+
+#endif // CEREBRI_B3RB_MPC_H
+/* vi: ts=4 sw=4 et */
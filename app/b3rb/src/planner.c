@@ -0,0 +1,60 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <zros/zros_sub.h>
+
+#include <cerebri/core/bezier.h>
+
+#include "casadi/gen/b3rb.h"
+
+LOG_MODULE_REGISTER(b3rb_planner, CONFIG_CEREBRI_B3RB_LOG_LEVEL);
+
+#define MY_STACK_SIZE 3072
+#define MY_PRIORITY 6
+
+static const struct bezier_planner_model g_model = {
+    .name = "b3rb_planner",
+    .solve = bezier6_solve,
+    .solve_work = bezier6_solve_work,
+    .max_velocity = CONFIG_CEREBRI_B3RB_MAX_VELOCITY_MM_S / 1000.0,
+    .max_turn_angle = CONFIG_CEREBRI_B3RB_MAX_TURN_ANGLE_MRAD / 1000.0,
+    .wheel_base = CONFIG_CEREBRI_B3RB_WHEEL_BASE_MM / 1000.0,
+};
+
+static struct bezier_planner g_planner;
+
+static void b3rb_planner_entry_point(void* p0, void* p1, void* p2)
+{
+    LOG_INF("init");
+    struct bezier_planner* planner = p0;
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+
+    if (bezier_planner_init(planner, &g_model) < 0) {
+        LOG_ERR("init failed");
+        return;
+    }
+
+    // poll on waypoints
+    struct k_poll_event events[] = {
+        *zros_sub_get_event(&planner->sub_waypoints),
+    };
+
+    while (true) {
+        int rc = k_poll(events, ARRAY_SIZE(events), K_FOREVER);
+        if (rc != 0) {
+            continue;
+        }
+        bezier_planner_step(planner);
+    }
+}
+
+K_THREAD_DEFINE(b3rb_planner, MY_STACK_SIZE, b3rb_planner_entry_point,
+    &g_planner, NULL, NULL, MY_PRIORITY, 0, 1000);
+
+/* vi: ts=4 sw=4 et */
@@ -17,14 +17,25 @@
 #include <zephyr/logging/log.h>
 
 #include "casadi/gen/b3rb.h"
+#include "executor.h"
+#include "mpc.h"
 
+#include <cerebri/core/bezier.h>
 #include <cerebri/core/casadi.h>
+#include <cerebri/core/sched.h>
+#include <cerebri/core/trace.h>
 
+#if defined(CONFIG_CEREBRI_B3RB_MPC)
+#define MY_STACK_SIZE 4096
+#else
 #define MY_STACK_SIZE 3072
+#endif
 #define MY_PRIORITY 4
 
 LOG_MODULE_REGISTER(b3rb_position, CONFIG_CEREBRI_B3RB_LOG_LEVEL);
 
+CASADI_FUNC_DEFINE(se2_error);
+
 typedef struct _context {
     struct zros_node node;
     synapse_msgs_Status status;
@@ -32,12 +43,21 @@ typedef struct _context {
     synapse_msgs_Time clock_offset;
     synapse_msgs_Odometry pose;
     synapse_msgs_Twist cmd_vel;
+    struct bezier_cache trajectory;
     struct zros_sub sub_status, sub_clock_offset, sub_pose, sub_bezier_trajectory;
     struct zros_pub pub_cmd_vel;
     const double wheel_base;
     const double gain_along_track;
     const double gain_cross_track;
     const double gain_heading;
+    // se2_error:(p[3],r[3])->(error[3]), bound in g_ctx
+    double se2_p[3], se2_r[3], se2_e[3];
+    struct casadi_se2_error se2_error;
+#if defined(CONFIG_CEREBRI_B3RB_MPC)
+    const struct mpc_params mpc_params;
+    struct mpc mpc;
+#endif
+    struct trace_origin origin;
 } context;
 
 static context g_ctx = {
@@ -51,6 +71,7 @@ static context g_ctx = {
         .linear = synapse_msgs_Vector3_init_default,
         .angular = synapse_msgs_Vector3_init_default,
     },
+    .trajectory = {},
     .sub_status = {},
     .sub_clock_offset = {},
     .sub_pose = {},
@@ -60,16 +81,46 @@ static context g_ctx = {
     .gain_along_track = CONFIG_CEREBRI_B3RB_GAIN_ALONG_TRACK / 1000.0,
     .gain_cross_track = CONFIG_CEREBRI_B3RB_GAIN_CROSS_TRACK / 1000.0,
     .gain_heading = CONFIG_CEREBRI_B3RB_GAIN_HEADING / 1000.0,
+    .se2_p = {},
+    .se2_r = {},
+    .se2_e = {},
+    .se2_error = {
+        .arg = { g_ctx.se2_p, g_ctx.se2_r },
+        .res = { g_ctx.se2_e },
+    },
+#if defined(CONFIG_CEREBRI_B3RB_MPC)
+    .mpc_params = {
+        .dt = CONFIG_CEREBRI_B3RB_MPC_STEP_MS / 1000.0,
+        .q = {
+            CONFIG_CEREBRI_B3RB_MPC_WEIGHT_ALONG_TRACK / 1000.0,
+            CONFIG_CEREBRI_B3RB_MPC_WEIGHT_CROSS_TRACK / 1000.0,
+            CONFIG_CEREBRI_B3RB_MPC_WEIGHT_HEADING / 1000.0,
+        },
+        .r = {
+            CONFIG_CEREBRI_B3RB_MPC_WEIGHT_SPEED / 1000.0,
+            CONFIG_CEREBRI_B3RB_MPC_WEIGHT_TURN_RATE / 1000.0,
+        },
+        .max_velocity = CONFIG_CEREBRI_B3RB_MAX_VELOCITY_MM_S / 1000.0,
+        .max_turn_angle = CONFIG_CEREBRI_B3RB_MAX_TURN_ANGLE_MRAD / 1000.0,
+        .wheel_base = CONFIG_CEREBRI_B3RB_WHEEL_BASE_MM / 1000.0,
+        .iterations = CONFIG_CEREBRI_B3RB_MPC_ITERATIONS,
+    },
+    .mpc = {},
+#endif
+    .origin = {},
 };
 
-static void init(context* ctx)
+static void init(context* ctx, int rate_hz)
 {
     zros_node_init(&ctx->node, "b3rb_position");
     zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
     zros_sub_init(&ctx->sub_clock_offset, &ctx->node, &topic_clock_offset, &ctx->clock_offset, 10);
-    zros_sub_init(&ctx->sub_pose, &ctx->node, &topic_estimator_odometry, &ctx->pose, 10);
+    zros_sub_init(&ctx->sub_pose, &ctx->node, &topic_estimator_odometry, &ctx->pose, rate_hz);
     zros_sub_init(&ctx->sub_bezier_trajectory, &ctx->node, &topic_bezier_trajectory, &ctx->bezier_trajectory, 10);
     zros_pub_init(&ctx->pub_cmd_vel, &ctx->node, &topic_cmd_vel, &ctx->cmd_vel);
+#if defined(CONFIG_CEREBRI_B3RB_MPC)
+    mpc_init(&ctx->mpc, &ctx->mpc_params);
+#endif
 }
 
 static void stop(context* ctx)
@@ -78,102 +129,129 @@ static void stop(context* ctx)
     ctx->cmd_vel.angular.z = 0;
 }
 
+#if defined(CONFIG_CEREBRI_B3RB_MPC)
+// reference speed and turn rate over the horizon, stopped past the end
+static void mpc_reference(context* ctx, uint64_t time_nsec, double V[MPC_N], double omega[MPC_N])
+{
+    // look ahead without moving the cached curve of the current time
+    int index = ctx->trajectory.index;
+    for (int k = 0; k < MPC_N; k++) {
+        struct bezier_ref ref;
+        uint64_t t = time_nsec + (uint64_t)(k * ctx->mpc_params.dt * 1e9);
+        if (bezier_cache_eval(&ctx->trajectory, t, &ref) < 0) {
+            ref.V = 0;
+            ref.omega = 0;
+        }
+        V[k] = ref.V;
+        omega[k] = ref.omega;
+    }
+    ctx->trajectory.index = index;
+}
+#endif
+
 // computes thrust/steering in auto mode
 static void auto_mode(context* ctx)
 {
-    // goal -> given position goal, find cmd_vel
-    uint64_t time_start_nsec = ctx->bezier_trajectory.time_start;
-    uint64_t time_stop_nsec = time_start_nsec;
-
     // get current time
     uint64_t time_nsec = k_uptime_get() * 1e6 + ctx->clock_offset.sec * 1e9 + ctx->clock_offset.nanosec;
 
-    if (time_nsec < time_start_nsec) {
+    struct bezier_ref ref;
+    int rc = bezier_cache_eval(&ctx->trajectory, time_nsec, &ref);
+    if (rc == -EAGAIN) {
         LOG_DBG("time current: %" PRIu64
                 " ns < time start: %" PRIu64
                 "  ns, time out of range of trajectory\n",
-            time_nsec, time_start_nsec);
+            time_nsec, ctx->bezier_trajectory.time_start);
+        stop(ctx);
+        return;
+    } else if (rc < 0) {
+        // past the last curve
         stop(ctx);
         return;
     }
 
-    // find current trajectory index, time_start, and time_stop
-    int curve_index = 0;
-    while (true) {
+    /* se2_error:(p[3],r[3])->(error[3]) */
+    double* p = ctx->se2_p;
+    double* r = ctx->se2_r;
+    const double* e = ctx->se2_e; // e_x, e_y, e_theta
 
-        // check if time handled by current trajectory
-        if (time_nsec < ctx->bezier_trajectory.curves[curve_index].time_stop) {
-            time_stop_nsec = ctx->bezier_trajectory.curves[curve_index].time_stop;
-            if (curve_index > 0) {
-                time_start_nsec = ctx->bezier_trajectory.curves[curve_index - 1].time_stop;
-            }
-            break;
-        }
+    // vehicle position
+    p[0] = ctx->pose.pose.pose.position.x;
+    p[1] = ctx->pose.pose.pose.position.y;
+    p[2] = 2 * atan2(ctx->pose.pose.pose.orientation.z, ctx->pose.pose.pose.orientation.w);
 
-        // next index
-        curve_index++;
+    // reference position
+    r[0] = ref.x;
+    r[1] = ref.y;
+    r[2] = ref.psi;
 
-        // check if index exceeds bounds
-        if (curve_index >= ctx->bezier_trajectory.curves_count) {
-            // LOG_ERR("curve index exceeds bounds");
-            stop(ctx);
-            return;
-        }
+    casadi_se2_error_call(&ctx->se2_error);
+
+    // compute twist
+#if defined(CONFIG_CEREBRI_B3RB_MPC)
+    double V[MPC_N], omega[MPC_N];
+    double v, w;
+    mpc_reference(ctx, time_nsec, V, omega);
+    if (mpc_solve(&ctx->mpc, e, V, omega, &v, &w) < 0) {
+        LOG_WRN("mpc solution not finite, stopped");
+        stop(ctx);
+        return;
     }
+    ctx->cmd_vel.linear.x = v;
+    ctx->cmd_vel.angular.z = w;
+#else
+    ctx->cmd_vel.linear.x = ref.V + ctx->gain_along_track * e[0];
+    ctx->cmd_vel.angular.z = ref.omega + ctx->gain_cross_track * e[1] + ctx->gain_heading * e[2];
+#endif
+}
 
-    double T = (time_stop_nsec - time_start_nsec) * 1e-9;
-    double t = (time_nsec - time_start_nsec) * 1e-9;
-    double x, y, psi, V, omega = 0;
-    double e[3] = {}; // e_x, e_y, e_theta
+// position control on the latest pose, publishes cmd_vel in auto mode
+static void position_step(context* ctx)
+{
+    if (zros_sub_update_available(&ctx->sub_bezier_trajectory)) {
+        zros_sub_update(&ctx->sub_bezier_trajectory);
+        bezier_cache_load(&ctx->trajectory, &ctx->bezier_trajectory);
+    }
 
-    double PX[6], PY[6];
-    for (int i = 0; i < 6; i++) {
-        PX[i] = ctx->bezier_trajectory.curves[curve_index].x[i];
-        PY[i] = ctx->bezier_trajectory.curves[curve_index].y[i];
+    if (zros_sub_update_available(&ctx->sub_status)) {
+        zros_sub_update(&ctx->sub_status);
     }
 
-    /* bezier6_rover:(t,T,PX[1x6],PY[1x6],L)->(x,y,psi,V,omega) */
-    {
-        CASADI_FUNC_ARGS(bezier6_rover);
-        args[0] = &t;
-        args[1] = &T;
-        args[2] = PX;
-        args[3] = PY;
-        res[0] = &x;
-        res[1] = &y;
-        res[2] = &psi;
-        res[3] = &V;
-        res[4] = &omega;
-        CASADI_FUNC_CALL(bezier6_rover);
+    if (zros_sub_update_available(&ctx->sub_pose)) {
+        zros_sub_update(&ctx->sub_pose);
+        trace_consume(TRACE_TOPIC_ESTIMATOR_ODOMETRY, &ctx->origin);
     }
 
-    /* se2_error:(p[3],r[3])->(error[3]) */
-    {
-        double p[3], r[3];
-
-        // vehicle position
-        p[0] = ctx->pose.pose.pose.position.x;
-        p[1] = ctx->pose.pose.pose.position.y;
-        p[2] = 2 * atan2(ctx->pose.pose.pose.orientation.z, ctx->pose.pose.pose.orientation.w);
-
-        // reference position
-        r[0] = x;
-        r[1] = y;
-        r[2] = psi;
-
-        // call function
-        CASADI_FUNC_ARGS(se2_error);
-        args[0] = p;
-        args[1] = r;
-        res[0] = e;
-        CASADI_FUNC_CALL(se2_error);
+    if (zros_sub_update_available(&ctx->sub_clock_offset)) {
+        zros_sub_update(&ctx->sub_clock_offset);
     }
 
-    // compute twist
-    ctx->cmd_vel.linear.x = V + ctx->gain_along_track * e[0];
-    ctx->cmd_vel.angular.z = omega + ctx->gain_cross_track * e[1] + ctx->gain_heading * e[2];
+    if (ctx->status.mode != synapse_msgs_Status_Mode_MODE_AUTO) {
+        // LOG_DBG("not auto mode");
+        return;
+    }
+
+    auto_mode(ctx);
+    trace_publish(TRACE_TOPIC_CMD_VEL, &ctx->origin, TRACE_STAGE_POSITION);
+    zros_pub_update(&ctx->pub_cmd_vel);
+}
+
+void b3rb_position_init(int rate_hz)
+{
+    init(&g_ctx, rate_hz);
 }
 
+void b3rb_position_step(void)
+{
+    position_step(&g_ctx);
+}
+
+#if !defined(CONFIG_CEREBRI_B3RB_EXECUTOR)
+// the rate pose is subscribed at, a step on each pose
+#define POSE_RATE_HZ 10
+
+SCHED_GROUP_DEFINE(b3rb_position, 1000000 / POSE_RATE_HZ, 2500, 1000);
+
 static void b3rb_position_entry_point(void* p0, void* p1, void* p2)
 {
     LOG_INF("init");
@@ -181,7 +259,8 @@ static void b3rb_position_entry_point(void* p0, void* p1, void* p2)
     ARG_UNUSED(p1);
     ARG_UNUSED(p2);
 
-    init(ctx);
+    init(ctx, POSE_RATE_HZ);
+    sched_group_attach(&sched_group_b3rb_position);
 
     struct k_poll_event events[] = {
         *zros_sub_get_event(&ctx->sub_pose),
@@ -196,35 +275,15 @@ static void b3rb_position_entry_point(void* p0, void* p1, void* p2)
             LOG_DBG("pos not receiving  pose");
             continue;
         }
-
-        if (zros_sub_update_available(&ctx->sub_bezier_trajectory)) {
-            zros_sub_update(&ctx->sub_bezier_trajectory);
-        }
-
-        if (zros_sub_update_available(&ctx->sub_status)) {
-            zros_sub_update(&ctx->sub_status);
-        }
-
-        if (zros_sub_update_available(&ctx->sub_pose)) {
-            zros_sub_update(&ctx->sub_pose);
-        }
-
-        if (zros_sub_update_available(&ctx->sub_clock_offset)) {
-            zros_sub_update(&ctx->sub_clock_offset);
-        }
-
-        if (ctx->status.mode != synapse_msgs_Status_Mode_MODE_AUTO) {
-            // LOG_DBG("not auto mode");
-            continue;
-        }
-
-        auto_mode(ctx);
-        zros_pub_update(&ctx->pub_cmd_vel);
+        sched_job_begin(&sched_group_b3rb_position);
+        position_step(ctx);
+        sched_job_end(&sched_group_b3rb_position);
     }
 }
 
 K_THREAD_DEFINE(b3rb_position, MY_STACK_SIZE,
     b3rb_position_entry_point, &g_ctx, NULL, NULL,
     MY_PRIORITY, 0, 1000);
+#endif
 
 /* vi: ts=4 sw=4 et */
@@ -16,7 +16,10 @@
 #include <zros/zros_sub.h>
 
 #include <cerebri/core/casadi.h>
+#include <cerebri/core/sched.h>
+#include <cerebri/core/trace.h>
 
+#include "executor.h"
 #include "mixing.h"
 
 #define MY_STACK_SIZE 3072
@@ -24,6 +27,8 @@
 
 LOG_MODULE_REGISTER(b3rb_velocity, CONFIG_CEREBRI_B3RB_LOG_LEVEL);
 
+CASADI_FUNC_DEFINE(ackermann_steering);
+
 typedef struct _context {
     struct zros_node node;
     synapse_msgs_Twist cmd_vel;
@@ -34,6 +39,11 @@ typedef struct _context {
     struct zros_pub pub_actuators;
     const double wheel_radius;
     const double wheel_base;
+    // ackermann_steering:(L,omega,V)->(delta), bound in g_ctx
+    double delta;
+    struct casadi_ackermann_steering ackermann_steering;
+    struct trace_origin origin;
+    int64_t ticks_input;
 } context;
 
 static context g_ctx = {
@@ -48,13 +58,20 @@ static context g_ctx = {
     .pub_actuators = {},
     .wheel_radius = CONFIG_CEREBRI_B3RB_WHEEL_RADIUS_MM / 1000.0,
     .wheel_base = CONFIG_CEREBRI_B3RB_WHEEL_BASE_MM / 1000.0,
+    .delta = 0,
+    .ackermann_steering = {
+        .arg = { &g_ctx.wheel_base, &g_ctx.cmd_vel.angular.z, &g_ctx.cmd_vel.linear.x },
+        .res = { &g_ctx.delta },
+    },
+    .origin = {},
+    .ticks_input = 0,
 };
 
-static void init_b3rb_vel(context* ctx)
+static void init_b3rb_vel(context* ctx, int rate_hz)
 {
     LOG_DBG("init vel");
     zros_node_init(&ctx->node, "b3rb_velocity");
-    zros_sub_init(&ctx->sub_cmd_vel, &ctx->node, &topic_cmd_vel, &ctx->cmd_vel, 10);
+    zros_sub_init(&ctx->sub_cmd_vel, &ctx->node, &topic_cmd_vel, &ctx->cmd_vel, rate_hz);
     zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
     zros_sub_init(&ctx->sub_actuators_manual, &ctx->node,
         &topic_actuators_manual, &ctx->actuators_manual, 10);
@@ -67,19 +84,12 @@ static void update_cmd_vel(context* ctx)
     double turn_angle = 0;
     double omega_fwd = 0;
     double V = ctx->cmd_vel.linear.x;
-    double omega = ctx->cmd_vel.angular.z;
-    double delta = 0;
 
-    CASADI_FUNC_ARGS(ackermann_steering);
-    args[0] = &ctx->wheel_base;
-    args[1] = &omega;
-    args[2] = &V;
-    res[0] = &delta;
-    CASADI_FUNC_CALL(ackermann_steering);
+    casadi_ackermann_steering_call(&ctx->ackermann_steering);
 
     omega_fwd = V / ctx->wheel_radius;
     if (fabs(V) > 0.01) {
-        turn_angle = delta;
+        turn_angle = ctx->delta;
     }
     b3rb_set_actuators(&ctx->actuators, turn_angle, omega_fwd);
 }
@@ -89,6 +99,67 @@ static void stop(context* ctx)
     b3rb_set_actuators(&ctx->actuators, 0, 0);
 }
 
+// actuators from the latest cmd_vel or manual actuators, rc < 0 when
+// no input was received and the vehicle is stopped
+static void velocity_step(context* ctx, int rc)
+{
+    if (zros_sub_update_available(&ctx->sub_status)) {
+        zros_sub_update(&ctx->sub_status);
+    }
+
+    if (zros_sub_update_available(&ctx->sub_cmd_vel)) {
+        zros_sub_update(&ctx->sub_cmd_vel);
+        trace_consume(TRACE_TOPIC_CMD_VEL, &ctx->origin);
+    }
+
+    if (zros_sub_update_available(&ctx->sub_actuators_manual)) {
+        zros_sub_update(&ctx->sub_actuators_manual);
+    }
+
+    // handle modes
+    if (rc < 0) {
+        stop(ctx);
+        LOG_DBG("no data, stopped");
+    } else if (ctx->status.arming != synapse_msgs_Status_Arming_ARMING_ARMED) {
+        stop(ctx);
+        LOG_DBG("not armed, stopped");
+    } else if (ctx->status.mode == synapse_msgs_Status_Mode_MODE_MANUAL) {
+        LOG_DBG("manual mode");
+        ctx->actuators = ctx->actuators_manual;
+    } else {
+        update_cmd_vel(ctx);
+    }
+
+    // publish
+    trace_publish(TRACE_TOPIC_ACTUATORS, &ctx->origin, TRACE_STAGE_VELOCITY);
+    zros_pub_update(&ctx->pub_actuators);
+}
+
+void b3rb_velocity_init(int rate_hz)
+{
+    init_b3rb_vel(&g_ctx, rate_hz);
+}
+
+void b3rb_velocity_step(void)
+{
+    context* ctx = &g_ctx;
+    int64_t ticks_now = k_uptime_ticks();
+
+    // stop without input for as long as the thread would wait for it
+    if (zros_sub_update_available(&ctx->sub_cmd_vel)
+        || zros_sub_update_available(&ctx->sub_actuators_manual)) {
+        ctx->ticks_input = ticks_now;
+    }
+    bool timeout = ticks_now - ctx->ticks_input > k_ms_to_ticks_ceil64(1000);
+    velocity_step(ctx, timeout ? -ETIMEDOUT : 0);
+}
+
+#if !defined(CONFIG_CEREBRI_B3RB_EXECUTOR)
+// the rate cmd_vel is subscribed at
+#define CMD_VEL_RATE_HZ 10
+
+SCHED_GROUP_DEFINE(b3rb_velocity, 1000000 / CMD_VEL_RATE_HZ, 3500, 500);
+
 static void b3rb_velocity_entry_point(void* p0, void* p1, void* p2)
 {
     LOG_INF("init");
@@ -96,7 +167,8 @@ static void b3rb_velocity_entry_point(void* p0, void* p1, void* p2)
     ARG_UNUSED(p1);
     ARG_UNUSED(p2);
 
-    init_b3rb_vel(ctx);
+    init_b3rb_vel(ctx, CMD_VEL_RATE_HZ);
+    sched_group_attach(&sched_group_b3rb_velocity);
 
     while (true) {
         synapse_msgs_Status_Mode mode = ctx->status.mode;
@@ -119,40 +191,17 @@ static void b3rb_velocity_entry_point(void* p0, void* p1, void* p2)
                 LOG_DBG("not receiving cmd_vel");
             }
         }
-
-        if (zros_sub_update_available(&ctx->sub_status)) {
-            zros_sub_update(&ctx->sub_status);
+        if (rc == 0) {
+            sched_job_begin(&sched_group_b3rb_velocity);
         }
-
-        if (zros_sub_update_available(&ctx->sub_cmd_vel)) {
-            zros_sub_update(&ctx->sub_cmd_vel);
-        }
-
-        if (zros_sub_update_available(&ctx->sub_actuators_manual)) {
-            zros_sub_update(&ctx->sub_actuators_manual);
-        }
-
-        // handle modes
-        if (rc < 0) {
-            stop(ctx);
-            LOG_DBG("no data, stopped");
-        } else if (ctx->status.arming != synapse_msgs_Status_Arming_ARMING_ARMED) {
-            stop(ctx);
-            LOG_DBG("not armed, stopped");
-        } else if (ctx->status.mode == synapse_msgs_Status_Mode_MODE_MANUAL) {
-            LOG_DBG("manual mode");
-            ctx->actuators = ctx->actuators_manual;
-        } else {
-            update_cmd_vel(ctx);
-        }
-
-        // publish
-        zros_pub_update(&ctx->pub_actuators);
+        velocity_step(ctx, rc);
+        sched_job_end(&sched_group_b3rb_velocity);
     }
 }
 
 K_THREAD_DEFINE(b3rb_velocity, MY_STACK_SIZE,
     b3rb_velocity_entry_point, &g_ctx, NULL, NULL,
     MY_PRIORITY, 0, 1000);
+#endif
 
 /* vi: ts=4 sw=4 et */
@@ -18,6 +18,7 @@
 
 #include "casadi/gen/elm4.h"
 
+#include <cerebri/core/bezier.h>
 #include <cerebri/core/casadi.h>
 
 #define MY_STACK_SIZE 3072
@@ -25,6 +26,8 @@
 
 LOG_MODULE_REGISTER(elm4_position, CONFIG_CEREBRI_ELM4_LOG_LEVEL);
 
+CASADI_FUNC_DEFINE(se2_error);
+
 typedef struct _context {
     struct zros_node node;
     synapse_msgs_Status status;
@@ -32,12 +35,16 @@ typedef struct _context {
     synapse_msgs_Time clock_offset;
     synapse_msgs_Odometry pose;
     synapse_msgs_Twist cmd_vel;
+    struct bezier_cache trajectory;
     struct zros_sub sub_status, sub_clock_offset, sub_pose, sub_bezier_trajectory;
     struct zros_pub pub_cmd_vel;
     const double wheel_base;
     const double gain_along_track;
     const double gain_cross_track;
     const double gain_heading;
+    // se2_error:(p[3],r[3])->(error[3]), bound in g_ctx
+    double se2_p[3], se2_r[3], se2_e[3];
+    struct casadi_se2_error se2_error;
 } context;
 
 static context g_ctx = {
@@ -51,6 +58,7 @@ static context g_ctx = {
         .linear = synapse_msgs_Vector3_init_default,
         .angular = synapse_msgs_Vector3_init_default,
     },
+    .trajectory = {},
     .sub_status = {},
     .sub_clock_offset = {},
     .sub_pose = {},
@@ -60,6 +68,13 @@ static context g_ctx = {
     .gain_along_track = CONFIG_CEREBRI_ELM4_GAIN_ALONG_TRACK / 1000.0,
     .gain_cross_track = CONFIG_CEREBRI_ELM4_GAIN_CROSS_TRACK / 1000.0,
     .gain_heading = CONFIG_CEREBRI_ELM4_GAIN_HEADING / 1000.0,
+    .se2_p = {},
+    .se2_r = {},
+    .se2_e = {},
+    .se2_error = {
+        .arg = { g_ctx.se2_p, g_ctx.se2_r },
+        .res = { g_ctx.se2_e },
+    },
 };
 
 static void init(context* ctx)
@@ -81,97 +96,44 @@ static void stop(context* ctx)
 // computes thrust/steering in auto mode
 static void auto_mode(context* ctx)
 {
-    // goal -> given position goal, find cmd_vel
-    uint64_t time_start_nsec = ctx->bezier_trajectory.time_start;
-    uint64_t time_stop_nsec = time_start_nsec;
-
     // get current time
     uint64_t time_nsec = k_uptime_get() * 1e6 + ctx->clock_offset.sec * 1e9 + ctx->clock_offset.nanosec;
 
-    if (time_nsec < time_start_nsec) {
+    struct bezier_ref ref;
+    int rc = bezier_cache_eval(&ctx->trajectory, time_nsec, &ref);
+    if (rc == -EAGAIN) {
         LOG_DBG("time current: %" PRIu64
                 " ns < time start: %" PRIu64
                 "  ns, time out of range of trajectory\n",
-            time_nsec, time_start_nsec);
+            time_nsec, ctx->bezier_trajectory.time_start);
+        stop(ctx);
+        return;
+    } else if (rc < 0) {
+        // past the last curve
         stop(ctx);
         return;
     }
 
-    // find current trajectory index, time_start, and time_stop
-    int curve_index = 0;
-    while (true) {
-
-        // check if time handled by current trajectory
-        if (time_nsec < ctx->bezier_trajectory.curves[curve_index].time_stop) {
-            time_stop_nsec = ctx->bezier_trajectory.curves[curve_index].time_stop;
-            if (curve_index > 0) {
-                time_start_nsec = ctx->bezier_trajectory.curves[curve_index - 1].time_stop;
-            }
-            break;
-        }
-
-        // next index
-        curve_index++;
-
-        // check if index exceeds bounds
-        if (curve_index >= ctx->bezier_trajectory.curves_count) {
-            // LOG_ERR("curve index exceeds bounds");
-            stop(ctx);
-            return;
-        }
-    }
-
-    double T = (time_stop_nsec - time_start_nsec) * 1e-9;
-    double t = (time_nsec - time_start_nsec) * 1e-9;
-    double x, y, psi, V, omega = 0;
-    double e[3] = {}; // e_x, e_y, e_theta
+    /* se2_error:(p[3],r[3])->(error[3]) */
+    double* p = ctx->se2_p;
+    double* r = ctx->se2_r;
+    const double* e = ctx->se2_e; // e_x, e_y, e_theta
 
-    double PX[6], PY[6];
-    for (int i = 0; i < 6; i++) {
-        PX[i] = ctx->bezier_trajectory.curves[curve_index].x[i];
-        PY[i] = ctx->bezier_trajectory.curves[curve_index].y[i];
-    }
+    // vehicle position
+    p[0] = ctx->pose.pose.pose.position.x;
+    p[1] = ctx->pose.pose.pose.position.y;
+    p[2] = 2 * atan2(ctx->pose.pose.pose.orientation.z, ctx->pose.pose.pose.orientation.w);
 
-    /* bezier6_rover:(t,T,PX[1x6],PY[1x6],L)->(x,y,psi,V,omega) */
-    {
-        CASADI_FUNC_ARGS(bezier6_rover);
-        args[0] = &t;
-        args[1] = &T;
-        args[2] = PX;
-        args[3] = PY;
-        res[0] = &x;
-        res[1] = &y;
-        res[2] = &psi;
-        res[3] = &V;
-        res[4] = &omega;
-        CASADI_FUNC_CALL(bezier6_rover);
-    }
+    // reference position
+    r[0] = ref.x;
+    r[1] = ref.y;
+    r[2] = ref.psi;
 
-    /* se2_error:(p[3],r[3])->(error[3]) */
-    {
-        double p[3], r[3];
-
-        // vehicle position
-        p[0] = ctx->pose.pose.pose.position.x;
-        p[1] = ctx->pose.pose.pose.position.y;
-        p[2] = 2 * atan2(ctx->pose.pose.pose.orientation.z, ctx->pose.pose.pose.orientation.w);
-
-        // reference position
-        r[0] = x;
-        r[1] = y;
-        r[2] = psi;
-
-        // call function
-        CASADI_FUNC_ARGS(se2_error);
-        args[0] = p;
-        args[1] = r;
-        res[0] = e;
-        CASADI_FUNC_CALL(se2_error);
-    }
+    casadi_se2_error_call(&ctx->se2_error);
 
     // compute twist
-    ctx->cmd_vel.linear.x = V + ctx->gain_along_track * e[0];
-    ctx->cmd_vel.angular.z = omega + ctx->gain_cross_track * e[1] + ctx->gain_heading * e[2];
+    ctx->cmd_vel.linear.x = ref.V + ctx->gain_along_track * e[0];
+    ctx->cmd_vel.angular.z = ref.omega + ctx->gain_cross_track * e[1] + ctx->gain_heading * e[2];
 }
 
 static void elm4_position_entry_point(void* p0, void* p1, void* p2)
@@ -198,6 +160,7 @@ static void elm4_position_entry_point(void* p0, void* p1, void* p2)
 
         if (zros_sub_update_available(&ctx->sub_bezier_trajectory)) {
             zros_sub_update(&ctx->sub_bezier_trajectory);
+            bezier_cache_load(&ctx->trajectory, &ctx->bezier_trajectory);
         }
 
         if (zros_sub_update_available(&ctx->sub_status)) {
@@ -24,6 +24,8 @@
 
 LOG_MODULE_REGISTER(elm4_velocity, CONFIG_CEREBRI_ELM4_LOG_LEVEL);
 
+CASADI_FUNC_DEFINE(differential_steering);
+
 typedef struct _context {
     struct zros_node node;
     synapse_msgs_Twist cmd_vel;
@@ -36,6 +38,9 @@ typedef struct _context {
     const double wheel_base;
     const double max_velocity;
     const double wheel_separation;
+    // differential_steering:(L,omega,w)->(Vw), bound in g_ctx
+    double Vw;
+    struct casadi_differential_steering differential_steering;
 } context;
 
 static context g_ctx = {
@@ -52,6 +57,11 @@ static context g_ctx = {
     .wheel_base = CONFIG_CEREBRI_ELM4_WHEEL_BASE_MM / 1000.0,
     .max_velocity = CONFIG_CEREBRI_ELM4_MAX_VELOCITY_MM_S / 1000.0,
     .wheel_separation = CONFIG_CEREBRI_ELM4_WHEEL_SEPARATION_MM / 1000.0,
+    .Vw = 0,
+    .differential_steering = {
+        .arg = { &g_ctx.wheel_base, &g_ctx.cmd_vel.angular.z, &g_ctx.wheel_separation },
+        .res = { &g_ctx.Vw },
+    },
 };
 
 static void init_elm4_vel(context* ctx)
@@ -69,17 +79,10 @@ static void init_elm4_vel(context* ctx)
 void update_cmd_vel(context* ctx)
 {
     double V = ctx->cmd_vel.linear.x;
-    double omega = ctx->cmd_vel.angular.z;
-    double Vw = 0;
-    CASADI_FUNC_ARGS(differential_steering);
-    args[0] = &ctx->wheel_base;
-    args[1] = &omega;
-    args[2] = &ctx->wheel_separation;
-    res[0] = &Vw;
-    CASADI_FUNC_CALL(differential_steering);
+    casadi_differential_steering_call(&ctx->differential_steering);
 
     double omega_fwd = V / ctx->wheel_radius;
-    double omega_turn = Vw / ctx->wheel_radius;
+    double omega_turn = ctx->Vw / ctx->wheel_radius;
     elm4_set_actuators(&ctx->actuators, omega_fwd, omega_turn);
 }
 
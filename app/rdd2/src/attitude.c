@@ -0,0 +1,235 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
+
+#include "attitude.h"
+
+// accept the accelerometer as gravity within this fraction of g
+#define ACCEL_GATE 0.25
+#define GRAVITY 9.80665
+
+static double norm3(const double v[3])
+{
+    return sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+static double dot3(const double a[3], const double b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void cross3(const double a[3], const double b[3], double r[3])
+{
+    r[0] = a[1] * b[2] - a[2] * b[1];
+    r[1] = a[2] * b[0] - a[0] * b[2];
+    r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+void quat_mul(const double a[4], const double b[4], double r[4])
+{
+    double w = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+    double x = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+    double y = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+    double z = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+    r[0] = w;
+    r[1] = x;
+    r[2] = y;
+    r[3] = z;
+}
+
+void quat_from_euler(double roll, double pitch, double yaw, double q[4])
+{
+    double cr = cos(roll / 2), sr = sin(roll / 2);
+    double cp = cos(pitch / 2), sp = sin(pitch / 2);
+    double cy = cos(yaw / 2), sy = sin(yaw / 2);
+    q[0] = cr * cp * cy + sr * sp * sy;
+    q[1] = sr * cp * cy - cr * sp * sy;
+    q[2] = cr * sp * cy + sr * cp * sy;
+    q[3] = cr * cp * sy - sr * sp * cy;
+}
+
+double quat_yaw(const double q[4])
+{
+    return atan2(2 * (q[0] * q[3] + q[1] * q[2]), 1 - 2 * (q[2] * q[2] + q[3] * q[3]));
+}
+
+// v_body = R^T v_world
+static void rotate_inv(const double q[4], const double v[3], double r[3])
+{
+    const double qc[4] = { q[0], -q[1], -q[2], -q[3] };
+    const double p[4] = { 0, v[0], v[1], v[2] };
+    double t[4];
+    double s[4];
+    quat_mul(qc, p, t);
+    quat_mul(t, q, s);
+    r[0] = s[1];
+    r[1] = s[2];
+    r[2] = s[3];
+}
+
+// v_world = R v_body
+static void rotate(const double q[4], const double v[3], double r[3])
+{
+    const double qc[4] = { q[0], -q[1], -q[2], -q[3] };
+    rotate_inv(qc, v, r);
+}
+
+static void normalize4(double q[4])
+{
+    double n = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (int i = 0; i < 4; i++) {
+        q[i] /= n;
+    }
+}
+
+int attitude_init(struct attitude* att, const double accel[3], const double* mag,
+    double declination)
+{
+    // up, east and north seen from the body, a pseudo field along body y
+    // puts body x east, yaw 0, without a magnetometer
+    static const double body_y[3] = { 0, 1, 0 };
+    const double* m = mag != NULL ? mag : body_y;
+
+    double n = norm3(accel);
+    if (n < 1e-3) {
+        return -EINVAL;
+    }
+    double up[3] = { accel[0] / n, accel[1] / n, accel[2] / n };
+    double east[3];
+    cross3(m, up, east);
+    n = norm3(east);
+    if (n < 1e-3) {
+        return -EINVAL;
+    }
+    for (int i = 0; i < 3; i++) {
+        east[i] /= n;
+    }
+    double north[3];
+    cross3(up, east, north);
+
+    // rows of R are the world axes in the body frame
+    const double R[3][3] = {
+        { east[0], east[1], east[2] },
+        { north[0], north[1], north[2] },
+        { up[0], up[1], up[2] },
+    };
+    double* q = att->q;
+    double tr = R[0][0] + R[1][1] + R[2][2];
+    if (tr > 0) {
+        double s = 2 * sqrt(1 + tr);
+        q[0] = s / 4;
+        q[1] = (R[2][1] - R[1][2]) / s;
+        q[2] = (R[0][2] - R[2][0]) / s;
+        q[3] = (R[1][0] - R[0][1]) / s;
+    } else if (R[0][0] > R[1][1] && R[0][0] > R[2][2]) {
+        double s = 2 * sqrt(1 + R[0][0] - R[1][1] - R[2][2]);
+        q[0] = (R[2][1] - R[1][2]) / s;
+        q[1] = s / 4;
+        q[2] = (R[0][1] + R[1][0]) / s;
+        q[3] = (R[0][2] + R[2][0]) / s;
+    } else if (R[1][1] > R[2][2]) {
+        double s = 2 * sqrt(1 - R[0][0] + R[1][1] - R[2][2]);
+        q[0] = (R[0][2] - R[2][0]) / s;
+        q[1] = (R[0][1] + R[1][0]) / s;
+        q[2] = s / 4;
+        q[3] = (R[1][2] + R[2][1]) / s;
+    } else {
+        double s = 2 * sqrt(1 - R[0][0] - R[1][1] + R[2][2]);
+        q[0] = (R[1][0] - R[0][1]) / s;
+        q[1] = (R[0][2] + R[2][0]) / s;
+        q[2] = (R[1][2] + R[2][1]) / s;
+        q[3] = s / 4;
+    }
+
+    // magnetic to true north
+    if (mag != NULL) {
+        const double qd[4] = { cos(-declination / 2), 0, 0, sin(-declination / 2) };
+        double t[4];
+        quat_mul(qd, q, t);
+        for (int i = 0; i < 4; i++) {
+            q[i] = t[i];
+        }
+    }
+    normalize4(q);
+
+    for (int i = 0; i < 3; i++) {
+        att->bias[i] = 0;
+    }
+    return 0;
+}
+
+void attitude_update(struct attitude* att, const struct attitude_gains* gains,
+    const double omega[3], const double accel[3], const double* mag, double dt,
+    double rate[3])
+{
+    static const double e3[3] = { 0, 0, 1 };
+    double up[3];
+    rotate_inv(att->q, e3, up);
+
+    // error, the rotation that takes the predicted directions to the
+    // measured ones
+    double e[3] = { 0, 0, 0 };
+
+    double n = norm3(accel);
+    if (fabs(n - GRAVITY) < ACCEL_GATE * GRAVITY) {
+        double a[3] = { accel[0] / n, accel[1] / n, accel[2] / n };
+        double ea[3];
+        cross3(a, up, ea);
+        for (int i = 0; i < 3; i++) {
+            e[i] += gains->accel * ea[i];
+        }
+    }
+
+    if (mag != NULL && norm3(mag) > 1e-9) {
+        // expected field, the measured one turned to magnetic north,
+        // keeping its inclination
+        double m_w[3];
+        rotate(att->q, mag, m_w);
+        double h = hypot(m_w[0], m_w[1]);
+        const double b_w[3] = {
+            h * sin(gains->declination),
+            h * cos(gains->declination),
+            m_w[2],
+        };
+        double b[3];
+        rotate_inv(att->q, b_w, b);
+        double em[3];
+        cross3(mag, b, em);
+        double k = gains->mag / (norm3(mag) * norm3(b));
+        // about the vertical only, roll and pitch are left to gravity
+        double d = dot3(em, up);
+        for (int i = 0; i < 3; i++) {
+            e[i] += k * d * up[i];
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        att->bias[i] -= gains->bias * e[i] * dt;
+        rate[i] = omega[i] - att->bias[i];
+    }
+
+    // q = q exp(w dt / 2)
+    double w[3] = { rate[0] + e[0], rate[1] + e[1], rate[2] + e[2] };
+    double angle = norm3(w) * dt;
+    double dq[4] = { 1, 0, 0, 0 };
+    if (angle > 1e-9) {
+        double s = sin(angle / 2) / norm3(w);
+        dq[0] = cos(angle / 2);
+        dq[1] = w[0] * s;
+        dq[2] = w[1] * s;
+        dq[3] = w[2] * s;
+    }
+    double q1[4];
+    quat_mul(att->q, dq, q1);
+    normalize4(q1);
+    for (int i = 0; i < 4; i++) {
+        att->q[i] = q1[i];
+    }
+}
+
+/* vi: ts=4 sw=4 et */
@@ -0,0 +1,51 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CEREBRI_RDD2_ATTITUDE_H
+#define CEREBRI_RDD2_ATTITUDE_H
+
+#include <stdbool.h>
+
+/*
+ * Attitude of the multirotor, a nonlinear complementary filter on SO(3).
+ *
+ * The quaternion q = [w, x, y, z] rotates the body, forward left up, to
+ * the world, east north up. The gyro is integrated on the group, the
+ * direction of gravity from the accelerometer corrects roll and pitch,
+ * and the horizontal magnetic field corrects yaw only. The correction
+ * is also integrated into the gyro bias.
+ */
+
+struct attitude_gains {
+    // rad/s of correction per rad of error
+    double accel;
+    double mag;
+    // 1/s^2, gyro bias
+    double bias;
+    // rad, positive east of true north
+    double declination;
+};
+
+struct attitude {
+    double q[4];
+    double bias[3];
+};
+
+// from gravity and the magnetic field, mag may be NULL, then yaw is 0
+int attitude_init(struct attitude* att, const double accel[3], const double* mag,
+    double declination);
+
+// propagate over dt, rate is the bias corrected angular velocity
+void attitude_update(struct attitude* att, const struct attitude_gains* gains,
+    const double omega[3], const double accel[3], const double* mag, double dt,
+    double rate[3]);
+
+// quaternion helpers shared with the controller
+void quat_mul(const double a[4], const double b[4], double r[4]);
+void quat_from_euler(double roll, double pitch, double yaw, double q[4]);
+double quat_yaw(const double q[4]);
+
+#endif // CEREBRI_RDD2_ATTITUDE_H
+/* vi: ts=4 sw=4 et */
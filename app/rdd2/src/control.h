@@ -0,0 +1,18 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CEREBRI_RDD2_CONTROL_H
+#define CEREBRI_RDD2_CONTROL_H
+
+/*
+ * The attitude and rate controller, stepped by the estimate thread right
+ * after each attitude estimate, in the rdd2_control rate group. The step
+ * consumes the odometry just published and publishes the actuators.
+ */
+void rdd2_velocity_init(void);
+void rdd2_velocity_step(void);
+
+#endif // CEREBRI_RDD2_CONTROL_H
+/* vi: ts=4 sw=4 et */
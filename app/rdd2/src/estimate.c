@@ -4,8 +4,7 @@
  */
 
 #include <math.h>
-#include <stdio.h>
-#include <time.h>
+
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
@@ -18,35 +17,42 @@
 
 #include <synapse_topic_list.h>
 
-#include <cerebri/core/casadi.h>
+#include <cerebri/core/sched.h>
+#include <cerebri/core/trace.h>
 
-#include "casadi/gen/rdd2.h"
+#include "attitude.h"
+#include "control.h"
 
 LOG_MODULE_REGISTER(rdd2_estimate, CONFIG_CEREBRI_RDD2_LOG_LEVEL);
 
 #define MY_STACK_SIZE 4096
 #define MY_PRIORITY 4
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
+// 200 Hz imu, the attitude estimate and the controller run each sample
+SCHED_GROUP_DEFINE(rdd2_control, 5000, 2500, 1000);
 
 // private context
 typedef struct _context {
     struct zros_node node;
-    synapse_msgs_WheelOdometry wheel_odometry;
     synapse_msgs_Imu imu;
     synapse_msgs_Odometry odometry;
-    struct zros_sub sub_wheel_odometry, sub_imu;
+    struct zros_sub sub_imu;
     struct zros_pub pub_odometry;
-    double x[3];
-    const double wheel_radius;
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MAG)
+    synapse_msgs_MagneticField magnetic_field;
+    struct zros_sub sub_magnetic_field;
+#endif
+    const struct attitude_gains gains;
+    struct attitude attitude;
+    bool started;
+    int32_t seq;
+    int64_t ticks_last;
+    struct trace_origin origin;
 } context;
 
 // private initialization
 static context g_ctx = {
     .node = {},
-    .wheel_odometry = synapse_msgs_WheelOdometry_init_default,
     .imu = synapse_msgs_Imu_init_default,
     .odometry = {
         .child_frame_id = "base_link",
@@ -56,43 +62,113 @@ static context g_ctx = {
         .pose.has_pose = true,
         .pose.pose.has_position = true,
         .pose.pose.has_orientation = true,
+        .has_twist = true,
+        .twist.has_twist = true,
+        .twist.twist.has_angular = true,
     },
-    .sub_wheel_odometry = {},
     .sub_imu = {},
     .pub_odometry = {},
-    .x = {},
-    .wheel_radius = CONFIG_CEREBRI_RDD2_WHEEL_RADIUS_MM / 1000.0,
+    .gains = {
+        .accel = CONFIG_CEREBRI_RDD2_GAIN_ATTITUDE_ACCEL / 1000.0,
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MAG)
+        .mag = CONFIG_CEREBRI_RDD2_GAIN_ATTITUDE_MAG / 1000.0,
+        .declination = CONFIG_CEREBRI_RDD2_ESTIMATE_MAG_DECLINATION_MRAD / 1000.0,
+#endif
+        .bias = CONFIG_CEREBRI_RDD2_GAIN_ATTITUDE_BIAS / 1000.0,
+    },
+    .attitude = {},
+    .started = false,
+    .seq = 0,
+    .ticks_last = 0,
+    .origin = {},
 };
 
-static void estimate_rover2d_init(context* ctx)
+static void rdd2_estimate_init(context* ctx)
 {
     zros_node_init(&ctx->node, "rdd2_estimate");
-    zros_sub_init(&ctx->sub_imu, &ctx->node, &topic_imu, &ctx->imu, 10);
-    zros_sub_init(&ctx->sub_wheel_odometry, &ctx->node, &topic_wheel_odometry,
-        &ctx->wheel_odometry, 10);
+    zros_sub_init(&ctx->sub_imu, &ctx->node, &topic_imu, &ctx->imu, 1000);
     zros_pub_init(&ctx->pub_odometry, &ctx->node, &topic_estimator_odometry, &ctx->odometry);
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MAG)
+    zros_sub_init(&ctx->sub_magnetic_field, &ctx->node, &topic_magnetic_field,
+        &ctx->magnetic_field, 100);
+#endif
 }
 
-static bool all_finite(double* src, size_t n)
+static void rdd2_estimate_step(context* ctx)
 {
-    for (size_t i = 0; i < n; i++) {
-        if (!isfinite(src[i])) {
-            return false;
-        }
+    if (zros_sub_update_available(&ctx->sub_imu)) {
+        zros_sub_update(&ctx->sub_imu);
+        trace_consume(TRACE_TOPIC_IMU, &ctx->origin);
     }
-    return true;
-}
 
-static void handle_update(context* ctx, double* x1)
-{
-    bool x1_finite = all_finite(x1, ARRAY_SIZE(ctx->x));
+    const double omega[3] = {
+        ctx->imu.angular_velocity.x,
+        ctx->imu.angular_velocity.y,
+        ctx->imu.angular_velocity.z,
+    };
+    const double accel[3] = {
+        ctx->imu.linear_acceleration.x,
+        ctx->imu.linear_acceleration.y,
+        ctx->imu.linear_acceleration.z,
+    };
+
+    // the latest field, only on the step it arrives
+    const double* mag = NULL;
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MAG)
+    double mag_data[3];
+    if (zros_sub_update_available(&ctx->sub_magnetic_field)) {
+        zros_sub_update(&ctx->sub_magnetic_field);
+        mag_data[0] = ctx->magnetic_field.magnetic_field.x;
+        mag_data[1] = ctx->magnetic_field.magnetic_field.y;
+        mag_data[2] = ctx->magnetic_field.magnetic_field.z;
+        mag = mag_data;
+    }
+#endif
 
-    if (!x1_finite) {
-        LOG_WRN("x1 update not finite");
+    // level the estimate on gravity, and the field if any, at start
+    if (!ctx->started) {
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MAG)
+        if (mag == NULL) {
+            LOG_DBG("waiting for mag");
+            return;
+        }
+#endif
+        if (attitude_init(&ctx->attitude, accel, mag, ctx->gains.declination) < 0) {
+            LOG_DBG("waiting for gravity");
+            return;
+        }
+        ctx->started = true;
+        ctx->ticks_last = k_uptime_ticks();
+        return;
     }
 
-    if (x1_finite) {
-        memcpy(ctx->x, x1, sizeof(ctx->x));
+    // calculate dt
+    int64_t ticks_now = k_uptime_ticks();
+    double dt = (double)(ticks_now - ctx->ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+    ctx->ticks_last = ticks_now;
+    if (dt < 0 || dt > 0.5) {
+        LOG_WRN("imu update rate too low");
+        return;
+    }
+
+    double rate[3];
+    attitude_update(&ctx->attitude, &ctx->gains, omega, accel, mag, dt, rate);
+
+    // publish odometry
+    {
+        stamp_header(&ctx->odometry.header, k_uptime_ticks());
+        ctx->odometry.header.seq = ctx->seq++;
+
+        const double* q = ctx->attitude.q;
+        ctx->odometry.pose.pose.orientation.w = q[0];
+        ctx->odometry.pose.pose.orientation.x = q[1];
+        ctx->odometry.pose.pose.orientation.y = q[2];
+        ctx->odometry.pose.pose.orientation.z = q[3];
+        ctx->odometry.twist.twist.angular.x = rate[0];
+        ctx->odometry.twist.twist.angular.y = rate[1];
+        ctx->odometry.twist.twist.angular.z = rate[2];
+        trace_publish(TRACE_TOPIC_ESTIMATOR_ODOMETRY, &ctx->origin, TRACE_STAGE_ESTIMATE);
+        zros_pub_update(&ctx->pub_odometry);
     }
 }
 
@@ -103,118 +179,30 @@ static void rdd2_estimate_entry_point(void* p0, void* p1, void* p2)
     ARG_UNUSED(p1);
     ARG_UNUSED(p2);
 
-    int rc = 0;
-
-    // LOG_DBG("started");
-    estimate_rover2d_init(ctx);
-
-    // variables
-    int32_t seq = 0;
-    double rotation_last = 0;
-
-    struct k_poll_event events[1] = {};
-
-    // wait for imu
-    LOG_DBG("waiting for imu");
-    events[0] = *zros_sub_get_event(&ctx->sub_imu);
-    rc = k_poll(events, ARRAY_SIZE(events), K_FOREVER);
-    if (rc != 0) {
-        LOG_DBG("did not receive imu");
-        return;
-    }
-    if (zros_sub_update_available(&ctx->sub_imu)) {
-        zros_sub_update(&ctx->sub_imu);
-    }
-
-    // wait for wheel odometry
-    LOG_DBG("waiting for wheel odometry");
-    events[0] = *zros_sub_get_event(&ctx->sub_wheel_odometry);
-    rc = k_poll(events, ARRAY_SIZE(events), K_FOREVER);
-    if (rc != 0) {
-        LOG_DBG("did not receive wheel odometry");
-        return;
-    }
-    if (zros_sub_update_available(&ctx->sub_wheel_odometry)) {
-        zros_sub_update(&ctx->sub_wheel_odometry);
-    }
-
-    double dt = 0;
-    int64_t ticks_last = k_uptime_ticks();
+    rdd2_estimate_init(ctx);
+#if defined(CONFIG_CEREBRI_RDD2_VELOCITY)
+    rdd2_velocity_init();
+#endif
+    sched_group_attach(&sched_group_rdd2_control);
 
     // poll on imu
-    events[0] = *zros_sub_get_event(&ctx->sub_imu);
+    struct k_poll_event events[] = {
+        *zros_sub_get_event(&ctx->sub_imu),
+    };
 
-    // estimator state
     while (true) {
-
-        // poll for imu
-        rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
+        int rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
         if (rc != 0) {
             LOG_DBG("not receiving imu");
             continue;
         }
-
-        if (zros_sub_update_available(&ctx->sub_imu)) {
-            zros_sub_update(&ctx->sub_imu);
-        }
-
-        if (zros_sub_update_available(&ctx->sub_wheel_odometry)) {
-            zros_sub_update(&ctx->sub_wheel_odometry);
-        }
-
-        // calculate dt
-        int64_t ticks_now = k_uptime_ticks();
-        dt = (float)(ticks_now - ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-        ticks_last = ticks_now;
-        if (dt < 0 || dt > 0.5) {
-            LOG_WRN("imu update rate too low");
-            continue;
-        }
-
-        // get data
-        double rotation = ctx->wheel_odometry.rotation;
-
-        // negative sign due to current gearing, should be in driver
-        double u = (rotation - rotation_last) * ctx->wheel_radius;
-        rotation_last = rotation;
-
-        double omega = ctx->imu.angular_velocity.z;
-        // LOG_DBG("imu omega z: %10.4f", omega);
-
-        /* predict:(x0[3],omega,u)->(x1[3]) */
-        {
-            double delta_theta = omega * dt;
-            double x1[3];
-
-            // LOG_DBG("predict");
-            CASADI_FUNC_ARGS(predict);
-            args[0] = ctx->x;
-            args[1] = &delta_theta;
-            args[2] = &u;
-            res[0] = x1;
-            CASADI_FUNC_CALL(predict);
-
-            // update x, W
-            handle_update(ctx, x1);
-        }
-
-        // publish odometry
-        {
-            stamp_header(&ctx->odometry.header, k_uptime_ticks());
-            ctx->odometry.header.seq = seq++;
-
-            double theta = ctx->x[2];
-            ctx->odometry.pose.pose.position.x = ctx->x[0];
-            ctx->odometry.pose.pose.position.y = ctx->x[1];
-            ctx->odometry.pose.pose.position.z = 0;
-            ctx->odometry.pose.pose.orientation.x = 0;
-            ctx->odometry.pose.pose.orientation.y = 0;
-            ctx->odometry.pose.pose.orientation.z = sin(theta / 2);
-            ctx->odometry.pose.pose.orientation.w = cos(theta / 2);
-            ctx->odometry.twist.twist.angular.z = omega;
-            ctx->odometry.twist.twist.linear.x = u;
-            zros_pub_update(&ctx->pub_odometry);
-        }
+        sched_job_begin(&sched_group_rdd2_control);
+        rdd2_estimate_step(ctx);
+#if defined(CONFIG_CEREBRI_RDD2_VELOCITY)
+        // sees the odometry just published
+        rdd2_velocity_step();
+#endif
+        sched_job_end(&sched_group_rdd2_control);
     }
 }
 
@@ -0,0 +1,40 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+
+#include "rate_pid.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void rate_pid_reset(struct rate_pid* pid, double rate)
+{
+    pid->integral = 0;
+    pid->derivative = 0;
+    pid->rate_last = rate;
+}
+
+double rate_pid_update(struct rate_pid* pid, double rate_sp, double rate, double dt)
+{
+    double error = rate_sp - rate;
+
+    pid->integral += pid->ki * error * dt;
+    if (pid->integral > pid->integral_max) {
+        pid->integral = pid->integral_max;
+    } else if (pid->integral < -pid->integral_max) {
+        pid->integral = -pid->integral_max;
+    }
+
+    // first order low pass of the rate derivative, no kick on setpoint steps
+    double alpha = dt / (dt + 1 / (2 * M_PI * pid->d_cutoff_hz));
+    pid->derivative += alpha * (-(rate - pid->rate_last) / dt - pid->derivative);
+    pid->rate_last = rate;
+
+    return pid->kff * rate_sp + pid->kp * error + pid->integral + pid->kd * pid->derivative;
+}
+
+/* vi: ts=4 sw=4 et */
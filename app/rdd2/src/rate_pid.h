@@ -0,0 +1,32 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CEREBRI_RDD2_RATE_PID_H
+#define CEREBRI_RDD2_RATE_PID_H
+
+/*
+ * Rate pid of one body axis.
+ *
+ * The integral is clamped to integral_max, the derivative is taken on
+ * the measured rate, low passed at d_cutoff_hz, so a setpoint step
+ * doesn't kick it, and kff feeds the setpoint forward.
+ */
+struct rate_pid {
+    const double kp, ki, kd, kff;
+    const double integral_max;
+    const double d_cutoff_hz;
+    double integral;
+    double derivative;
+    double rate_last;
+};
+
+// clear the integral and derivative, rate is the current measurement
+void rate_pid_reset(struct rate_pid* pid, double rate);
+
+// torque command for the rate setpoint, dt > 0
+double rate_pid_update(struct rate_pid* pid, double rate_sp, double rate, double dt);
+
+#endif // CEREBRI_RDD2_RATE_PID_H
+/* vi: ts=4 sw=4 et */
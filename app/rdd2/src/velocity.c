@@ -3,9 +3,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#include "casadi/gen/rdd2.h"
-#include "math.h"
-
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
 #include <zros/private/zros_node_struct.h>
@@ -15,158 +13,209 @@
 #include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
-#include <cerebri/core/casadi.h>
+#include <cerebri/core/trace.h>
 
+#include "attitude.h"
+#include "control.h"
 #include "mixing.h"
-
-#define MY_STACK_SIZE 3072
-#define MY_PRIORITY 4
+#include "rate_pid.h"
 
 LOG_MODULE_REGISTER(rdd2_velocity, CONFIG_CEREBRI_RDD2_LOG_LEVEL);
 
+// cmd_vel older than this no longer turns the vehicle
+#define CMD_VEL_TIMEOUT_MS 1000
+
 typedef struct _context {
     struct zros_node node;
-    synapse_msgs_Twist cmd_vel;
     synapse_msgs_Status status;
     synapse_msgs_Actuators actuators;
     synapse_msgs_Actuators actuators_manual;
-    synapse_msgs_Imu imu;
-    struct zros_sub sub_status, sub_cmd_vel, sub_actuators_manual, sub_imu;
+    synapse_msgs_Odometry odometry;
+    synapse_msgs_Twist cmd_vel;
+    struct zros_sub sub_status, sub_actuators_manual, sub_odometry, sub_cmd_vel;
     struct zros_pub pub_actuators;
-    const double wheel_radius;
-    const double wheel_base;
+    // attitude gain, rad/s per rad, roll pitch and yaw
+    const double k_attitude[3];
+    struct rate_pid pid[3];
+    const double max_tilt;
+    const double max_yaw_rate;
+    // thrust held outside of manual mode, the last manual thrust
+    double thrust_hold;
+    int64_t ticks_cmd_vel;
+    int64_t ticks_last;
+    struct trace_origin origin;
 } context;
 
+#define RATE_PID(AXIS)                                                  \
+    {                                                                   \
+        .kp = CONFIG_CEREBRI_RDD2_GAIN_RATE_##AXIS##_P / 1000.0,        \
+        .ki = CONFIG_CEREBRI_RDD2_GAIN_RATE_##AXIS##_I / 1000.0,        \
+        .kd = CONFIG_CEREBRI_RDD2_GAIN_RATE_##AXIS##_D / 1000.0,        \
+        .kff = CONFIG_CEREBRI_RDD2_GAIN_RATE_##AXIS##_FF / 1000.0,      \
+        .integral_max = CONFIG_CEREBRI_RDD2_RATE_INTEGRAL_MAX / 1000.0, \
+        .d_cutoff_hz = CONFIG_CEREBRI_RDD2_RATE_D_CUTOFF_HZ,            \
+    }
+
 static context g_ctx = {
     .node = {},
-    .cmd_vel = synapse_msgs_Twist_init_default,
     .status = synapse_msgs_Status_init_default,
     .actuators = synapse_msgs_Actuators_init_default,
     .actuators_manual = synapse_msgs_Actuators_init_default,
+    .odometry = synapse_msgs_Odometry_init_default,
+    .cmd_vel = synapse_msgs_Twist_init_default,
     .sub_status = {},
-    .sub_cmd_vel = {},
     .sub_actuators_manual = {},
-    .sub_imu = {},
+    .sub_odometry = {},
+    .sub_cmd_vel = {},
     .pub_actuators = {},
-    .wheel_radius = CONFIG_CEREBRI_RDD2_WHEEL_RADIUS_MM / 1000.0,
-    .wheel_base = CONFIG_CEREBRI_RDD2_WHEEL_BASE_MM / 1000.0,
+    .k_attitude = {
+        CONFIG_CEREBRI_RDD2_GAIN_ATTITUDE_RP / 1000.0,
+        CONFIG_CEREBRI_RDD2_GAIN_ATTITUDE_RP / 1000.0,
+        CONFIG_CEREBRI_RDD2_GAIN_ATTITUDE_YAW / 1000.0,
+    },
+    .pid = { RATE_PID(RP), RATE_PID(RP), RATE_PID(YAW) },
+    .max_tilt = CONFIG_CEREBRI_RDD2_MAX_TILT_MRAD / 1000.0,
+    .max_yaw_rate = CONFIG_CEREBRI_RDD2_MAX_YAW_RATE_MRAD_S / 1000.0,
+    .thrust_hold = 0,
+    .ticks_cmd_vel = 0,
+    .ticks_last = 0,
+    .origin = {},
 };
 
-static void init_rdd2_vel(context* ctx)
+void rdd2_velocity_init(void)
 {
-    LOG_DBG("init vel");
+    context* ctx = &g_ctx;
     zros_node_init(&ctx->node, "rdd2_velocity");
-    zros_sub_init(&ctx->sub_cmd_vel, &ctx->node, &topic_cmd_vel, &ctx->cmd_vel, 10);
     zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
     zros_sub_init(&ctx->sub_actuators_manual, &ctx->node,
         &topic_actuators_manual, &ctx->actuators_manual, 10);
-    zros_sub_init(&ctx->sub_imu, &ctx->node,
-        &topic_imu, &ctx->imu, 100);
+    zros_sub_init(&ctx->sub_odometry, &ctx->node,
+        &topic_estimator_odometry, &ctx->odometry, 1000);
+    zros_sub_init(&ctx->sub_cmd_vel, &ctx->node, &topic_cmd_vel, &ctx->cmd_vel, 10);
     zros_pub_init(&ctx->pub_actuators, &ctx->node, &topic_actuators, &ctx->actuators);
 }
 
-// computes rc_input from V, omega
-static void update_cmd_vel(context* ctx)
+// roll and pitch setpoint with the yaw held, plus a yaw rate
+static void control_attitude(context* ctx, const double q[4], const double rate[3],
+    double roll_sp, double pitch_sp, double yaw_rate_sp, double thrust, double dt)
 {
-    /*
-    CASADI_FUNC_ARGS(ackermann_steering);
-    args[0] = &ctx->wheel_base;
-    args[1] = &omega;
-    args[2] = &V;
-    res[0] = &delta;
-    CASADI_FUNC_CALL(ackermann_steering);
-
-    omega_fwd = V / ctx->wheel_radius;
-    if (fabs(V) > 0.01) {
-        turn_angle = delta;
+    // attitude error in the body frame, the yaw is held where it is
+    double q_sp[4];
+    quat_from_euler(roll_sp, pitch_sp, quat_yaw(q), q_sp);
+    const double q_inv[4] = { q[0], -q[1], -q[2], -q[3] };
+    double q_e[4];
+    quat_mul(q_inv, q_sp, q_e);
+    double sign = q_e[0] < 0 ? -1 : 1;
+
+    double rate_sp[3];
+    for (int i = 0; i < 3; i++) {
+        rate_sp[i] = 2 * sign * ctx->k_attitude[i] * q_e[i + 1];
     }
-    */
-
-    double roll_rate_cmd = ctx->actuators_manual.normalized[0];
-    double pitch_rate_cmd = ctx->actuators_manual.normalized[1];
-    double yaw_rate_cmd = ctx->actuators_manual.normalized[2];
-    double thrust_cmd = ctx->actuators_manual.normalized[3];
+    rate_sp[2] += yaw_rate_sp;
 
-    double roll = 0.01 * (roll_rate_cmd - ctx->imu.angular_velocity.x);
-    double pitch = 0.01 * (pitch_rate_cmd + ctx->imu.angular_velocity.y);
-    double yaw = 0.05 * (yaw_rate_cmd + ctx->imu.angular_velocity.z);
+    double torque[3];
+    for (int i = 0; i < 3; i++) {
+        torque[i] = rate_pid_update(&ctx->pid[i], rate_sp[i], rate[i], dt);
+    }
 
-    rdd2_set_actuators(&ctx->actuators, roll, pitch, yaw, thrust_cmd);
+    // the mixer pitches about -y and yaws about -z
+    rdd2_set_actuators(&ctx->actuators, torque[0], -torque[1], -torque[2], thrust);
 }
 
-static void stop(context* ctx)
+// angle mode, the sticks set roll and pitch and the yaw rate
+static void control_manual(context* ctx, const double q[4], const double rate[3], double dt)
 {
-    rdd2_set_actuators(&ctx->actuators, 0, 0, 0, 0);
+    // the sticks pitch about -y and yaw about -z, as does the mixer
+    double roll_sp = ctx->actuators_manual.normalized[0] * ctx->max_tilt;
+    double pitch_sp = -ctx->actuators_manual.normalized[1] * ctx->max_tilt;
+    double yaw_rate_sp = -ctx->actuators_manual.normalized[2] * ctx->max_yaw_rate;
+    ctx->thrust_hold = ctx->actuators_manual.normalized[3];
+    control_attitude(ctx, q, rate, roll_sp, pitch_sp, yaw_rate_sp, ctx->thrust_hold, dt);
 }
 
-static void rdd2_velocity_entry_point(void* p0, void* p1, void* p2)
+// cmd_vel and auto mode. Without a position or velocity estimate the
+// linear velocity can't be followed, so the vehicle is held level at the
+// last manual thrust and only the yaw rate of cmd_vel is followed, zero
+// once cmd_vel times out.
+static void control_cmd_vel(context* ctx, const double q[4], const double rate[3],
+    int64_t ticks_now, double dt)
 {
-    LOG_INF("init");
-    context* ctx = p0;
-    ARG_UNUSED(p1);
-    ARG_UNUSED(p2);
-
-    init_rdd2_vel(ctx);
-
-    while (true) {
-        synapse_msgs_Status_Mode mode = ctx->status.mode;
-
-        int rc = 0;
-        if (mode == synapse_msgs_Status_Mode_MODE_MANUAL) {
-            struct k_poll_event events[] = {
-                *zros_sub_get_event(&ctx->sub_actuators_manual),
-            };
-            rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
-            if (rc != 0) {
-                LOG_DBG("not receiving manual actuators");
-            }
-        } else {
-            struct k_poll_event events[] = {
-                *zros_sub_get_event(&ctx->sub_cmd_vel),
-            };
-            rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
-            if (rc != 0) {
-                LOG_DBG("not receiving cmd_vel");
-            }
+    double yaw_rate_sp = 0;
+    if (ticks_now - ctx->ticks_cmd_vel < k_ms_to_ticks_ceil64(CMD_VEL_TIMEOUT_MS)) {
+        yaw_rate_sp = ctx->cmd_vel.angular.z;
+        if (yaw_rate_sp > ctx->max_yaw_rate) {
+            yaw_rate_sp = ctx->max_yaw_rate;
+        } else if (yaw_rate_sp < -ctx->max_yaw_rate) {
+            yaw_rate_sp = -ctx->max_yaw_rate;
         }
+    }
+    control_attitude(ctx, q, rate, 0, 0, yaw_rate_sp, ctx->thrust_hold, dt);
+}
 
-        if (zros_sub_update_available(&ctx->sub_status)) {
-            zros_sub_update(&ctx->sub_status);
-        }
+static void stop(context* ctx, const double rate[3])
+{
+    for (int i = 0; i < 3; i++) {
+        rate_pid_reset(&ctx->pid[i], rate[i]);
+    }
+    rdd2_set_actuators(&ctx->actuators, 0, 0, 0, 0);
+}
 
-        if (zros_sub_update_available(&ctx->sub_cmd_vel)) {
-            zros_sub_update(&ctx->sub_cmd_vel);
-        }
+void rdd2_velocity_step(void)
+{
+    context* ctx = &g_ctx;
 
-        if (zros_sub_update_available(&ctx->sub_actuators_manual)) {
-            zros_sub_update(&ctx->sub_actuators_manual);
-        }
+    if (zros_sub_update_available(&ctx->sub_status)) {
+        zros_sub_update(&ctx->sub_status);
+    }
 
-        if (zros_sub_update_available(&ctx->sub_imu)) {
-            zros_sub_update(&ctx->sub_imu);
-        }
+    if (zros_sub_update_available(&ctx->sub_actuators_manual)) {
+        zros_sub_update(&ctx->sub_actuators_manual);
+    }
 
-        // handle modes
-        if (rc < 0) {
-            stop(ctx);
-            LOG_DBG("no data, stopped");
-        } else if (ctx->status.arming != synapse_msgs_Status_Arming_ARMING_ARMED) {
-            stop(ctx);
-            LOG_DBG("not armed, stopped");
-        } else if (ctx->status.mode == synapse_msgs_Status_Mode_MODE_MANUAL) {
-            LOG_DBG("manual mode");
-            // ctx->actuators = ctx->actuators_manual;
-            update_cmd_vel(ctx);
-        } else {
-        }
+    if (zros_sub_update_available(&ctx->sub_cmd_vel)) {
+        zros_sub_update(&ctx->sub_cmd_vel);
+        ctx->ticks_cmd_vel = k_uptime_ticks();
+    }
 
-        // publish
-        zros_pub_update(&ctx->pub_actuators);
+    if (!zros_sub_update_available(&ctx->sub_odometry)) {
+        return;
+    }
+    zros_sub_update(&ctx->sub_odometry);
+    trace_consume(TRACE_TOPIC_ESTIMATOR_ODOMETRY, &ctx->origin);
+
+    const synapse_msgs_Quaternion* o = &ctx->odometry.pose.pose.orientation;
+    const double q[4] = { o->w, o->x, o->y, o->z };
+    const double rate[3] = {
+        ctx->odometry.twist.twist.angular.x,
+        ctx->odometry.twist.twist.angular.y,
+        ctx->odometry.twist.twist.angular.z,
+    };
+
+    int64_t ticks_now = k_uptime_ticks();
+    double dt = (double)(ticks_now - ctx->ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+    ctx->ticks_last = ticks_now;
+
+    // handle modes
+    if (ctx->status.arming != synapse_msgs_Status_Arming_ARMING_ARMED) {
+        stop(ctx, rate);
+        ctx->thrust_hold = 0;
+        LOG_DBG("not armed, stopped");
+    } else if (dt <= 0 || dt > 0.1) {
+        // first step after a gap, restart the filters, keep the output
+        for (int i = 0; i < 3; i++) {
+            rate_pid_reset(&ctx->pid[i], rate[i]);
+        }
+        return;
+    } else if (ctx->status.mode == synapse_msgs_Status_Mode_MODE_CMD_VEL
+        || ctx->status.mode == synapse_msgs_Status_Mode_MODE_AUTO) {
+        control_cmd_vel(ctx, q, rate, ticks_now, dt);
+    } else {
+        control_manual(ctx, q, rate, dt);
     }
-}
 
-K_THREAD_DEFINE(rdd2_velocity, MY_STACK_SIZE,
-    rdd2_velocity_entry_point, &g_ctx, NULL, NULL,
-    MY_PRIORITY, 0, 1000);
+    // publish
+    trace_publish(TRACE_TOPIC_ACTUATORS, &ctx->origin, TRACE_STAGE_VELOCITY);
+    zros_pub_update(&ctx->pub_actuators);
+}
 
 /* vi: ts=4 sw=4 et */
@@ -0,0 +1,19 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_ACTUATE_PWM_H
+#define CEREBRI_ACTUATE_PWM_H
+
+#include <synapse_topic_list.h>
+
+/*
+ * Set the pwm outputs from the actuators message, outputs are centered
+ * unless armed. With CONFIG_CEREBRI_ACTUATE_PWM_SYNCHRONOUS the
+ * actuate_pwm thread is not started and the application calls this
+ * from its own rate group.
+ */
+void pwm_update(const synapse_msgs_Status* status, const synapse_msgs_Actuators* actuators);
+
+#endif // CEREBRI_ACTUATE_PWM_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,152 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_BEZIER_H
+#define CEREBRI_CORE_BEZIER_H
+
+#include <stdint.h>
+
+#include <zephyr/sys/util.h>
+
+#include <synapse_topic_list.h>
+
+#include <cerebri/core/casadi.h>
+
+/*
+ * Evaluation of a planar bezier trajectory.
+ *
+ * When a trajectory arrives, bezier_cache_load turns the control points
+ * of each curve into power basis coefficients in the time since the
+ * start of the curve, for position, velocity and acceleration. Each
+ * evaluation then walks from the curve of the previous one, so finding
+ * the active curve is amortized O(1) as time moves forward, and
+ * evaluates the polynomials by Horner's method.
+ *
+ * The reference matches bezier6_rover of the casadi models.
+ */
+
+// control points per curve, degree 5
+#define BEZIER_POINTS 6
+
+#define BEZIER_CURVES_MAX ARRAY_SIZE(((synapse_msgs_BezierTrajectory*)0)->curves)
+
+struct bezier_curve {
+    uint64_t time_start;
+    uint64_t time_stop;
+    // coefficients of t^k, t in s since time_start
+    double x[BEZIER_POINTS];
+    double y[BEZIER_POINTS];
+    double vx[BEZIER_POINTS - 1];
+    double vy[BEZIER_POINTS - 1];
+    double ax[BEZIER_POINTS - 2];
+    double ay[BEZIER_POINTS - 2];
+};
+
+struct bezier_cache {
+    struct bezier_curve curves[BEZIER_CURVES_MAX];
+    int count;
+    // curve of the last evaluation
+    int index;
+};
+
+struct bezier_ref {
+    double x, y;
+    // heading and speed along the path
+    double psi, V;
+    // angular velocity, 0 when stopped
+    double omega;
+};
+
+// precompute one curve from its control points
+void bezier_curve_load(struct bezier_curve* curve, uint64_t time_start, uint64_t time_stop,
+    const double x[BEZIER_POINTS], const double y[BEZIER_POINTS]);
+
+// reference t s after the start of the curve
+void bezier_curve_eval(const struct bezier_curve* curve, double t, struct bezier_ref* ref);
+
+// precompute the curves of a trajectory
+void bezier_cache_load(struct bezier_cache* cache, const synapse_msgs_BezierTrajectory* msg);
+
+// reference at time_nsec, returns -EAGAIN before the start and -ERANGE
+// after the end of the trajectory
+int bezier_cache_eval(struct bezier_cache* cache, uint64_t time_nsec, struct bezier_ref* ref);
+
+#if defined(CONFIG_CEREBRI_CORE_BEZIER_PLANNER)
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_pub_struct.h>
+#include <zros/private/zros_sub_struct.h>
+
+/*
+ * Onboard waypoint planner.
+ *
+ * The waypoints arrive on topic_bezier_waypoints, sent over synapse with
+ * the tinyframe type CONFIG_CEREBRI_SYNAPSE_TOPIC_BEZIER_WAYPOINTS_TF. It
+ * is a BezierTrajectory where each curve holds only the position and
+ * velocity, x[2] and y[2], reached at its time_stop. The planner solves
+ * a curve from each waypoint to the next with the bezier6_solve function
+ * of the vehicle, at zero acceleration at both ends, and publishes
+ * topic_bezier_trajectory.
+ *
+ * Curves between unchanged waypoints are kept from the previous plan,
+ * also when the plan was shifted by dropping waypoints already passed,
+ * so an update that moves or appends a waypoint re-solves only the
+ * curves next to it.
+ *
+ * With CONFIG_CEREBRI_CORE_BEZIER_PLANNER_RETIME, the waypoint times are
+ * taken as a guess: each curve gets the shortest duration, within 1 ms,
+ * for which the speed and the steering angle along it stay in the
+ * limits of the model. The search bisects between the chord at the top
+ * speed and the given duration, doubled while it is infeasible, and
+ * samples the solved curve with bezier_curve_eval. A curve that can't
+ * be made feasible, such as one starting above the top speed, keeps
+ * its given duration, and so does a hold, both waypoints at rest at
+ * one point.
+ */
+
+struct bezier_planner_model {
+    // node name
+    const char* name;
+    // bezier6_solve:(wp_0[2],wp_1[2],T)->(P[1x6])
+    casadi_func_t solve;
+    casadi_work_t solve_work;
+    // limits for retiming, m/s, and rad with the wheel base in m, 0 if none
+    double max_velocity;
+    double max_turn_angle;
+    double wheel_base;
+};
+
+struct bezier_waypoint {
+    uint64_t time_nsec;
+    // position and velocity
+    double x[2];
+    double y[2];
+};
+
+struct bezier_planner {
+    const struct bezier_planner_model* model;
+    struct zros_node node;
+    synapse_msgs_BezierTrajectory waypoints;
+    synapse_msgs_BezierTrajectory trajectory;
+    struct zros_sub sub_waypoints;
+    struct zros_pub pub_trajectory;
+    // waypoints of the published trajectory
+    struct bezier_waypoint plan[BEZIER_CURVES_MAX];
+    int plan_count;
+    // duration of each curve, ns
+    uint64_t duration[BEZIER_CURVES_MAX];
+    // casadi workspace
+    casadi_int iw[CONFIG_CEREBRI_CORE_BEZIER_PLANNER_CASADI_IW];
+    casadi_real w[CONFIG_CEREBRI_CORE_BEZIER_PLANNER_CASADI_W];
+};
+
+// returns -EINVAL if the model doesn't fit the workspace
+int bezier_planner_init(struct bezier_planner* planner, const struct bezier_planner_model* model);
+
+// on new waypoints, publishes the trajectory and returns the number of
+// curves solved, -EINVAL if the waypoints are rejected
+int bezier_planner_step(struct bezier_planner* planner);
+#endif
+
+#endif // CEREBRI_CORE_BEZIER_H
+// vi: ts=4 sw=4 et
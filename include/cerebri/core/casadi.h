@@ -1,14 +1,44 @@
 #ifndef CEREBRI_CORE_CASADI_H
 #define CEREBRI_CORE_CASADI_H
 
-#define CASADI_FUNC_ARGS(name)              \
-    casadi_int iw[name##_SZ_IW];            \
-    casadi_real w[name##_SZ_W];             \
-    const casadi_real* args[name##_SZ_ARG]; \
-    casadi_real* res[name##_SZ_RES];        \
-    int mem = 0;
-
-#define CASADI_FUNC_CALL(name) \
-    name(args, res, iw, w, mem);
+#ifndef casadi_real
+#define casadi_real double
+#endif
+
+#ifndef casadi_int
+#define casadi_int long long int
+#endif
+
+// a casadi generated function, and the query of its work sizes
+typedef int (*casadi_func_t)(const casadi_real** arg, casadi_real** res,
+    casadi_int* iw, casadi_real* w, int mem);
+typedef int (*casadi_work_t)(casadi_int* sz_arg, casadi_int* sz_res,
+    casadi_int* sz_iw, casadi_int* sz_w);
+
+/*
+ * A casadi generated function with its work vectors and its argument and
+ * result pointers, held in static or context memory, so a call puts
+ * nothing on the stack of the caller and the footprint of each function
+ * is fixed at build time. Define it once per file after the generated
+ * header, bind the pointers once to storage that outlives the handle,
+ * then call it each step:
+ *
+ *   CASADI_FUNC_DEFINE(se2_error);
+ *
+ *   struct casadi_se2_error f = { .arg = { p, r }, .res = { e } };
+ *   casadi_se2_error_call(&f);
+ */
+#define CASADI_FUNC_DEFINE(name)                                    \
+    struct casadi_##name {                                          \
+        const casadi_real* arg[name##_SZ_ARG];                      \
+        casadi_real* res[name##_SZ_RES];                            \
+        casadi_int iw[name##_SZ_IW];                                \
+        casadi_real w[name##_SZ_W];                                 \
+    };                                                              \
+    static inline int casadi_##name##_call(struct casadi_##name* f) \
+    {                                                               \
+        return name(f->arg, f->res, f->iw, f->w, 0);                \
+    }                                                               \
+    struct casadi_##name
 
 #endif // CEREBRI_CORE_CASADI_H
@@ -0,0 +1,114 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_ESTIMATE_H
+#define CEREBRI_CORE_ESTIMATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_pub_struct.h>
+#include <zros/private/zros_sub_struct.h>
+
+#include <synapse_topic_list.h>
+
+#include <cerebri/core/casadi.h>
+#include <cerebri/core/trace.h>
+
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+#include <cerebri/sense/imu.h>
+#endif
+
+/*
+ * Planar estimator shared by the vehicles.
+ *
+ * A vehicle declares its model, the casadi generated predict function
+ * and its wheel radius, and calls estimate_step on each imu sample, from
+ * its own thread or rate group. The estimator waits for imu and wheel
+ * odometry, propagates the pose with the model and the error state
+ * covariance, see src/eskf.h, corrects it with the magnetometer, gnss and
+ * external odometry as enabled in Kconfig, and publishes
+ * topic_estimator_odometry.
+ *
+ * With CONFIG_CEREBRI_SENSE_IMU_STREAM the heading is propagated by the
+ * delta angle of topic_imu_delta, integrated from every fifo sample over
+ * their own interval, instead of the mean rate of topic_imu held over
+ * the step. A step without a new delta falls back to the rate.
+ *
+ * The casadi workspace is held in struct estimate, sized by
+ * CONFIG_CEREBRI_CORE_ESTIMATE_CASADI_W and _IW, and checked against the
+ * model at init.
+ */
+
+#define ESTIMATE_STATE_N 4
+
+struct estimate_model {
+    // node name
+    const char* name;
+    // predict:(x0[3],delta_theta,u)->(x1[3])
+    casadi_func_t predict;
+    casadi_work_t predict_work;
+    // m
+    double wheel_radius;
+};
+
+struct estimate {
+    const struct estimate_model* model;
+    struct zros_node node;
+    synapse_msgs_WheelOdometry wheel_odometry;
+    synapse_msgs_Imu imu;
+    synapse_msgs_Odometry odometry;
+    struct zros_sub sub_wheel_odometry, sub_imu;
+    struct zros_pub pub_odometry;
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+    struct imu_delta imu_delta;
+    struct zros_sub sub_imu_delta;
+#endif
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_MAG)
+    synapse_msgs_MagneticField magnetic_field;
+    struct zros_sub sub_magnetic_field;
+#endif
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_GNSS)
+    synapse_msgs_NavSatFix nav_sat_fix;
+    struct zros_sub sub_nav_sat_fix;
+    // local tangent plane at the first fix, offset to the odom frame
+    bool gnss_origin_set;
+    double lat0, lon0, cos_lat0;
+    double gnss_offset[2];
+#endif
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_EXTERNAL_ODOMETRY)
+    synapse_msgs_Odometry external_odometry;
+    struct zros_sub sub_external_odometry;
+#endif
+    // nominal state, x, y, theta, and gyro bias
+    double x[3];
+    double gyro_bias;
+    // error state covariance
+    double P[ESTIMATE_STATE_N][ESTIMATE_STATE_N];
+    // casadi workspace
+    casadi_int iw[CONFIG_CEREBRI_CORE_ESTIMATE_CASADI_IW];
+    casadi_real w[CONFIG_CEREBRI_CORE_ESTIMATE_CASADI_W];
+    // step state
+    bool imu_received;
+    bool wheel_odometry_received;
+    bool started;
+    int32_t seq;
+    double rotation_last;
+    int64_t ticks_last;
+    // wheel speed, over the interval between wheel odometry messages
+    double speed;
+    double rotation_speed_last;
+    int64_t ticks_wheel_last;
+    struct trace_origin origin;
+};
+
+// returns -EINVAL if the model doesn't fit the workspace
+int estimate_init(struct estimate* est, const struct estimate_model* model, int rate_hz);
+
+// on the latest imu, publishes odometry once started
+void estimate_step(struct estimate* est);
+
+#endif // CEREBRI_CORE_ESTIMATE_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,48 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_INSTANCE_H
+#define CEREBRI_CORE_INSTANCE_H
+
+#include <stdint.h>
+
+/*
+ * Addressing of this vehicle instance, used everywhere a socket is made.
+ *
+ * Several SIL vehicles can run on one host, each with its own instance
+ * id. Ports are port_base + id * stride + port, so instances never
+ * collide. On native_sim the fields are set from the command line
+ * (see lib/dream/sil/native_main.c), otherwise the Kconfig defaults
+ * are used. This header is also included by host compiled code.
+ */
+
+enum cerebri_port {
+    CEREBRI_PORT_SIL = 1,
+    CEREBRI_PORT_SYNAPSE = 2,
+};
+
+struct cerebri_instance {
+    int id;
+    int port_base;
+    // peer (ground station / ros bridge) ipv4 address
+    char* peer_ipv4;
+    // ipv4 address of this instance, NULL keeps the configured one
+    char* my_ipv4;
+};
+
+extern struct cerebri_instance g_cerebri_instance;
+
+static inline uint16_t cerebri_instance_port(enum cerebri_port port)
+{
+    return g_cerebri_instance.port_base
+        + g_cerebri_instance.id * CONFIG_CEREBRI_CORE_COMMON_INSTANCE_PORT_STRIDE + port;
+}
+
+static inline const char* cerebri_instance_peer_ipv4(void)
+{
+    return g_cerebri_instance.peer_ipv4;
+}
+
+#endif // CEREBRI_CORE_INSTANCE_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,123 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_SCHED_H
+#define CEREBRI_CORE_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/iterable_sections.h>
+
+/*
+ * Rate groups of the control threads.
+ *
+ * Each node declares its rate group with SCHED_GROUP_DEFINE, giving the
+ * activation period, the relative deadline and the worst case execution
+ * time budget, all in us. At boot the groups are sorted by deadline and
+ * given priorities deadline monotonically, from
+ * CONFIG_CEREBRI_CORE_SCHED_PRIORITY_HIGHEST down, groups with equal
+ * deadlines share a priority. The thread of a group calls
+ * sched_group_attach once to take its priority, and brackets the work
+ * of each activation with sched_job_begin and sched_job_end.
+ *
+ * A job is released periodically, a job that starts late keeps its
+ * nominal release so the lateness counts against the deadline. A job
+ * starting a whole period or more late counts the releases it missed,
+ * from an overrun or a gap in the input of the group, and keeps the
+ * latest of them. Deadline misses, missed releases and budget overruns
+ * are counted per group and published on
+ * topic_sched_diagnostics. Without CONFIG_CEREBRI_CORE_SCHED the calls
+ * are no-ops and threads keep the priority they were defined with.
+ */
+
+struct sched_group {
+    const char* name;
+    uint32_t period_us;
+    uint32_t deadline_us;
+    uint32_t wcet_us;
+#if defined(CONFIG_CEREBRI_CORE_SCHED)
+    // assigned at boot
+    int priority;
+    uint32_t period_cycles;
+    uint32_t deadline_cycles;
+    uint32_t wcet_cycles;
+    k_tid_t thread;
+    // job accounting, written by the thread of the group only
+    bool in_job;
+    uint32_t cycle_release;
+    uint32_t cycle_begin;
+    uint64_t exec_begin;
+    uint32_t jobs;
+    uint32_t deadline_misses;
+    uint32_t missed_releases;
+    uint32_t budget_overruns;
+    // maximum over the current diagnostics period
+    uint32_t max_response_cycles;
+    uint32_t max_exec_cycles;
+#endif
+};
+
+#define SCHED_GROUP_DEFINE(NAME, PERIOD_US, DEADLINE_US, WCET_US)      \
+    BUILD_ASSERT((WCET_US) > 0, "sched group " #NAME " needs a wcet"); \
+    BUILD_ASSERT((DEADLINE_US) <= (PERIOD_US),                        \
+        "sched group " #NAME " deadline must not exceed its period"); \
+    BUILD_ASSERT((WCET_US) <= (DEADLINE_US),                          \
+        "sched group " #NAME " wcet must not exceed its deadline");   \
+    Z_SCHED_GROUP_SECTION(NAME) = {                                   \
+        .name = #NAME,                                                \
+        .period_us = PERIOD_US,                                       \
+        .deadline_us = DEADLINE_US,                                   \
+        .wcet_us = WCET_US,                                           \
+    }
+
+#if defined(CONFIG_CEREBRI_CORE_SCHED)
+
+#define Z_SCHED_GROUP_SECTION(NAME) STRUCT_SECTION_ITERABLE(sched_group, sched_group_##NAME)
+
+struct sched_group_status {
+    const char* name;
+    int priority;
+    uint32_t jobs;
+    uint32_t deadline_misses;
+    uint32_t missed_releases;
+    uint32_t budget_overruns;
+    uint32_t max_response_us;
+    uint32_t max_exec_us;
+};
+
+// message of topic_sched_diagnostics, counts are since boot
+struct sched_diagnostics {
+    int64_t uptime_ticks;
+    uint8_t group_count;
+    struct sched_group_status group[CONFIG_CEREBRI_CORE_SCHED_MAX_GROUPS];
+};
+
+struct zros_topic;
+extern struct zros_topic topic_sched_diagnostics;
+
+// set the priority of the calling thread to the one of its group
+void sched_group_attach(struct sched_group* group);
+
+// start of a job, call when the thread wakes for an activation
+void sched_job_begin(struct sched_group* group);
+
+// end of a job, a job begun and not ended is not accounted
+void sched_job_end(struct sched_group* group);
+
+#else
+
+#define Z_SCHED_GROUP_SECTION(NAME) static struct sched_group __unused sched_group_##NAME
+
+static inline void sched_group_attach(struct sched_group* group) { }
+
+static inline void sched_job_begin(struct sched_group* group) { }
+
+static inline void sched_job_end(struct sched_group* group) { }
+
+#endif
+
+#endif // CEREBRI_CORE_SCHED_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,86 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_TRACE_H
+#define CEREBRI_CORE_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * End to end latency tracing of the control loop.
+ *
+ * A sensor sample is given an origin, its seq and its sensor stamp, with
+ * the cycle counter at the stamp derived from the time since it.
+ * Each node that consumes a traced topic takes the origin of that topic,
+ * and hands it on with the topic it publishes, so the origin follows
+ * the sample imu -> estimator_odometry -> cmd_vel -> actuators -> pwm.
+ * Twist has no header, so origins travel beside the messages, one slot
+ * per traced topic, instead of in them.
+ *
+ * At every stage boundary the cycles since the previous stage and since
+ * the origin are recorded into a per cpu ring, reported by the
+ * trace latency shell command. All calls compile out without
+ * CONFIG_CEREBRI_CORE_TRACE.
+ */
+
+enum trace_topic {
+    TRACE_TOPIC_IMU,
+    TRACE_TOPIC_ESTIMATOR_ODOMETRY,
+    TRACE_TOPIC_CMD_VEL,
+    TRACE_TOPIC_ACTUATORS,
+    TRACE_TOPIC_COUNT,
+};
+
+enum trace_stage {
+    TRACE_STAGE_SENSE,
+    TRACE_STAGE_ESTIMATE,
+    TRACE_STAGE_POSITION,
+    TRACE_STAGE_VELOCITY,
+    TRACE_STAGE_ACTUATE,
+    TRACE_STAGE_COUNT,
+};
+
+struct trace_origin {
+    uint32_t seq;
+    // uptime ticks of the sample, from the header stamp of the sensor
+    int64_t stamp_ticks;
+    // cycle counter at the sample stamp, and at the last stage boundary
+    uint32_t cycle_origin;
+    uint32_t cycle_last;
+};
+
+#if defined(CONFIG_CEREBRI_CORE_TRACE)
+
+// start a trace for a new sample published on topic, stamped at
+// stamp_ticks by the sensor, the sense stage is the time since the stamp
+void trace_sample(enum trace_topic topic, uint32_t seq, int64_t stamp_ticks);
+
+// origin of the latest sample on topic, call after zros_sub_update
+void trace_consume(enum trace_topic topic, struct trace_origin* origin);
+
+// record the stage boundary and hand the origin on with topic, call
+// before zros_pub_update, the origin is used up
+void trace_publish(enum trace_topic topic, struct trace_origin* origin, enum trace_stage stage);
+
+// record the stage boundary at the end of the chain, the origin is used up
+void trace_point(struct trace_origin* origin, enum trace_stage stage);
+
+#else
+
+static inline void trace_sample(enum trace_topic topic, uint32_t seq, int64_t stamp_ticks) { }
+
+static inline void trace_consume(enum trace_topic topic, struct trace_origin* origin)
+{
+    *origin = (struct trace_origin) {};
+}
+
+static inline void trace_publish(enum trace_topic topic, struct trace_origin* origin,
+    enum trace_stage stage) { }
+
+static inline void trace_point(struct trace_origin* origin, enum trace_stage stage) { }
+
+#endif
+
+#endif // CEREBRI_CORE_TRACE_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,73 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SENSE_IMU_H
+#define CEREBRI_SENSE_IMU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Read the imu and publish topic_imu from the calling thread, for an
+ * application running the imu in its own rate group with
+ * CONFIG_CEREBRI_SENSE_IMU_SYNCHRONOUS.
+ *
+ * Returns 0 when the imu was published, -EAGAIN before the imu is
+ * initialized and -EBUSY while calibrating, a calibration takes one
+ * sample per call and doesn't block the caller.
+ */
+int sense_imu_step(void);
+
+/*
+ * Redundancy state of the accelerometers and gyros, published on
+ * topic_imu_health when it changes and once a second.
+ */
+#define IMU_VOTE_MAX_SENSORS 4
+
+enum imu_fault {
+    IMU_FAULT_STUCK = 1 << 0,
+    IMU_FAULT_NOISY = 1 << 1,
+    IMU_FAULT_DISAGREE = 1 << 2,
+};
+
+struct imu_health_sensors {
+    uint8_t count;
+    // sensor index published when not fusing, or fused around
+    uint8_t primary;
+    // sensors disagree and none can be blamed, the primary is used alone
+    bool disagree;
+    uint32_t failovers;
+    // enum imu_fault bits by sensor
+    uint8_t faults[IMU_VOTE_MAX_SENSORS];
+};
+
+struct imu_health {
+    int64_t uptime_ticks;
+    struct imu_health_sensors accel;
+    struct imu_health_sensors gyro;
+};
+
+/*
+ * Delta angle and delta velocity of the primary gyro over a publish
+ * interval, integrated from every fifo sample with coning and sculling
+ * corrections, published on topic_imu_delta with
+ * CONFIG_CEREBRI_SENSE_IMU_STREAM. The delta velocity is in the body
+ * frame at the start of the interval.
+ */
+struct imu_delta {
+    // time of the last sample, from the data ready interrupt
+    uint64_t timestamp_ns;
+    uint32_t dt_us;
+    uint16_t samples;
+    uint8_t sensor;
+    float delta_angle[3];
+    float delta_velocity[3];
+};
+
+struct zros_topic;
+extern struct zros_topic topic_imu_health;
+extern struct zros_topic topic_imu_delta;
+
+#endif // CEREBRI_SENSE_IMU_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,72 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SYNAPSE_BATCH_H
+#define CEREBRI_SYNAPSE_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Batched synapse datagram, used to coalesce several TinyFrame frames
+ * into a single UDP datagram:
+ *
+ *   magic (u8) | count (u8) | { len (u16 le) | frame[len] } * count
+ *
+ * The magic byte differs from the TinyFrame start of frame byte, so a
+ * receiver can accept both batched and plain datagrams on one socket.
+ * This header is shared with the host side tools in scripts/.
+ */
+
+#define SYNAPSE_BATCH_MAGIC 0xCB
+#define SYNAPSE_BATCH_HEADER_SIZE 2
+#define SYNAPSE_BATCH_RECORD_HEADER_SIZE 2
+#define SYNAPSE_BATCH_MAX_COUNT UINT8_MAX
+
+struct synapse_batch_iter {
+    const uint8_t* buf;
+    size_t len;
+    size_t offset;
+    uint8_t remaining;
+};
+
+static inline bool synapse_batch_is_batch(const uint8_t* buf, size_t len)
+{
+    return len >= SYNAPSE_BATCH_HEADER_SIZE && buf[0] == SYNAPSE_BATCH_MAGIC;
+}
+
+static inline void synapse_batch_iter_init(struct synapse_batch_iter* it, const uint8_t* buf, size_t len)
+{
+    it->buf = buf;
+    it->len = len;
+    it->offset = SYNAPSE_BATCH_HEADER_SIZE;
+    it->remaining = buf[1];
+}
+
+/*
+ * Get the next frame of the batch, returns frame length,
+ * 0 when all frames were read, or -1 if the batch is truncated
+ */
+static inline int synapse_batch_next(struct synapse_batch_iter* it, const uint8_t** frame)
+{
+    if (it->remaining == 0) {
+        return 0;
+    }
+    if (it->offset + SYNAPSE_BATCH_RECORD_HEADER_SIZE > it->len) {
+        return -1;
+    }
+    size_t frame_len = (size_t)it->buf[it->offset] | ((size_t)it->buf[it->offset + 1] << 8);
+    it->offset += SYNAPSE_BATCH_RECORD_HEADER_SIZE;
+    if (frame_len == 0 || it->offset + frame_len > it->len) {
+        return -1;
+    }
+    *frame = &it->buf[it->offset];
+    it->offset += frame_len;
+    it->remaining--;
+    return (int)frame_len;
+}
+
+#endif // CEREBRI_SYNAPSE_BATCH_H
+// vi: ts=4 sw=4 et
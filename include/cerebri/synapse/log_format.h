@@ -0,0 +1,52 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SYNAPSE_LOG_FORMAT_H
+#define CEREBRI_SYNAPSE_LOG_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * Binary flight log written by lib/synapse/log, little endian:
+ *
+ *   header | record*
+ *   record: len (u16) | topic (u8) | kind (u8) | stamp_ns (u64) | payload[len]
+ *
+ * Each logging session starts with a topic record for every logged topic,
+ * giving the name of the topic id used by the message records that
+ * follow. Message payloads are the nanopb encoded topic message, stamped
+ * with the board uptime when the logger received them.
+ *
+ * The header length is the number of record bytes after the header, it
+ * is updated as data is flushed and is 0 if the log was not closed, in
+ * which case readers stop at the first truncated record. This header is
+ * shared with the host side tools in scripts/.
+ */
+
+#define SYNAPSE_LOG_MAGIC "CBLG"
+#define SYNAPSE_LOG_VERSION 1
+
+enum synapse_log_kind {
+    // payload is the topic name
+    SYNAPSE_LOG_KIND_TOPIC = 0,
+    // payload is the encoded message
+    SYNAPSE_LOG_KIND_MSG = 1,
+};
+
+struct synapse_log_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size;
+    uint64_t length;
+} __attribute__((packed));
+
+struct synapse_log_record {
+    uint16_t len;
+    uint8_t topic;
+    uint8_t kind;
+    uint64_t stamp_ns;
+} __attribute__((packed));
+
+#endif // CEREBRI_SYNAPSE_LOG_FORMAT_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,75 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SYNAPSE_TF_PB_H
+#define CEREBRI_SYNAPSE_TF_PB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <pb_encode.h>
+#include <synapse_tinyframe/TinyFrame.h>
+
+/*
+ * Encode a protobuf message straight into a TinyFrame frame.
+ *
+ * The payload length is found with a sizing pass, the frame header is
+ * sent, and pb_encode then streams the payload through TinyFrame's
+ * multipart interface, which updates the checksum incrementally as bytes
+ * are written into its send buffer. This avoids the intermediate
+ * CLASS##_size stack buffer, its memset and the copy made by TF_Send.
+ */
+
+static inline bool synapse_tf_pb_write(pb_ostream_t* stream, const pb_byte_t* buf, size_t count)
+{
+    TinyFrame* tf = stream->state;
+    TF_Multipart_Payload(tf, buf, count);
+    return true;
+}
+
+/*
+ * Send message with a payload size already computed by pb_get_encoded_size,
+ * returns false if the frame could not be sent
+ */
+static inline bool synapse_tf_send_pb_sized(TinyFrame* tf, TF_TYPE type,
+    const pb_msgdesc_t* fields, const void* src, size_t size)
+{
+    TF_Msg msg;
+    TF_ClearMsg(&msg);
+    msg.type = type;
+    msg.data = NULL;
+    msg.len = size;
+    if (!TF_Send_Multipart(tf, &msg)) {
+        return false;
+    }
+
+    pb_ostream_t stream = {
+        .callback = &synapse_tf_pb_write,
+        .state = tf,
+        .max_size = size,
+        .bytes_written = 0,
+    };
+
+    // the sizing pass succeeded, so encoding into the frame can not fail
+    // part way through, the frame is always closed to release the lock
+    bool rc = pb_encode(&stream, fields, src);
+    TF_Multipart_Close(tf);
+    return rc;
+}
+
+/*
+ * Send message, returns false if encoding failed or frame could not be sent
+ */
+static inline bool synapse_tf_send_pb(TinyFrame* tf, TF_TYPE type,
+    const pb_msgdesc_t* fields, const void* src)
+{
+    size_t size = 0;
+    if (!pb_get_encoded_size(&size, fields, src)) {
+        return false;
+    }
+    return synapse_tf_send_pb_sized(tf, type, fields, src, size);
+}
+
+#endif // CEREBRI_SYNAPSE_TF_PB_H
+// vi: ts=4 sw=4 et
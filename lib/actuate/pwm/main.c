@@ -17,6 +17,10 @@
 
 #include <synapse_topic_list.h>
 
+#include <cerebri/actuate/pwm.h>
+#include <cerebri/core/sched.h>
+#include <cerebri/core/trace.h>
+
 LOG_MODULE_REGISTER(actuate_pwm, CONFIG_CEREBRI_ACTUATE_PWM_LOG_LEVEL);
 
 #define MY_STACK_SIZE 4096
@@ -43,12 +47,18 @@ static context g_ctx = {
     .pwm_enable = PWM_DT_SPEC_GET(DT_CHILD(DT_NODELABEL(pwm_shell), aux2)),
 };
 
+#if !defined(CONFIG_CEREBRI_ACTUATE_PWM_SYNCHRONOUS)
+// the rate actuators are subscribed at
+#define ACTUATORS_RATE_HZ 100
+
 static void actuate_pwm_init(context* ctx)
 {
     zros_node_init(&ctx->node, "actuate_pwm");
-    zros_sub_init(&ctx->sub_actuators, &ctx->node, &topic_actuators, &ctx->actuators, 100);
+    zros_sub_init(&ctx->sub_actuators, &ctx->node, &topic_actuators, &ctx->actuators,
+        ACTUATORS_RATE_HZ);
     zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 100);
 }
+#endif
 
 void pwm_update(const synapse_msgs_Status* status, const synapse_msgs_Actuators* actuators)
 {
@@ -121,6 +131,9 @@ void pwm_update(const synapse_msgs_Status* status, const synapse_msgs_Actuators*
     }
 }
 
+#if !defined(CONFIG_CEREBRI_ACTUATE_PWM_SYNCHRONOUS)
+SCHED_GROUP_DEFINE(actuate_pwm, 1000000 / ACTUATORS_RATE_HZ, 4500, 200);
+
 void actuate_pwm_entry_point(void* p0, void* p1, void* p2)
 {
     LOG_INF("init");
@@ -129,10 +142,12 @@ void actuate_pwm_entry_point(void* p0, void* p1, void* p2)
     ARG_UNUSED(p2);
 
     actuate_pwm_init(ctx);
+    sched_group_attach(&sched_group_actuate_pwm);
 
     struct k_poll_event events[] = {
         *zros_sub_get_event(&ctx->sub_actuators),
     };
+    struct trace_origin origin = {};
 
     while (true) {
         int rc = 0;
@@ -144,6 +159,8 @@ void actuate_pwm_entry_point(void* p0, void* p1, void* p2)
                 ctx->status.arming = synapse_msgs_Status_Arming_ARMING_DISARMED;
                 LOG_ERR("disarming motors due to actuator msg timeout!");
             }
+        } else {
+            sched_job_begin(&sched_group_actuate_pwm);
         }
 
         if (zros_sub_update_available(&ctx->sub_status)) {
@@ -152,15 +169,19 @@ void actuate_pwm_entry_point(void* p0, void* p1, void* p2)
 
         if (zros_sub_update_available(&ctx->sub_actuators)) {
             zros_sub_update(&ctx->sub_actuators);
+            trace_consume(TRACE_TOPIC_ACTUATORS, &origin);
         }
 
         // update pwm
         pwm_update(&ctx->status, &ctx->actuators);
+        trace_point(&origin, TRACE_STAGE_ACTUATE);
+        sched_job_end(&sched_group_actuate_pwm);
     }
 }
 
 K_THREAD_DEFINE(actuate_pwm, MY_STACK_SIZE,
     actuate_pwm_entry_point, &g_ctx, NULL, NULL,
     MY_PRIORITY, 0, 100);
+#endif
 
 /* vi: ts=4 sw=4 et */
@@ -0,0 +1,119 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <math.h>
+
+#include <cerebri/core/bezier.h>
+
+// binomial coefficients of degree BEZIER_POINTS - 1
+static const double g_binom[BEZIER_POINTS][BEZIER_POINTS] = {
+    { 1 },
+    { 1, 1 },
+    { 1, 2, 1 },
+    { 1, 3, 3, 1 },
+    { 1, 4, 6, 4, 1 },
+    { 1, 5, 10, 10, 5, 1 },
+};
+
+// power basis of the control points P, in t for a curve of duration T
+static void power_basis(const double P[BEZIER_POINTS], double T,
+    double c[BEZIER_POINTS], double dc[BEZIER_POINTS - 1], double ddc[BEZIER_POINTS - 2])
+{
+    const int n = BEZIER_POINTS - 1;
+    double T_k = 1;
+    for (int k = 0; k <= n; k++) {
+        // coefficient of beta^k, beta = t / T
+        double sum = 0;
+        for (int i = 0; i <= k; i++) {
+            double sign = (k - i) % 2 == 0 ? 1 : -1;
+            sum += sign * g_binom[k][i] * P[i];
+        }
+        c[k] = g_binom[n][k] * sum / T_k;
+        T_k *= T;
+    }
+    for (int k = 1; k <= n; k++) {
+        dc[k - 1] = k * c[k];
+    }
+    for (int k = 2; k <= n; k++) {
+        ddc[k - 2] = k * (k - 1) * c[k];
+    }
+}
+
+static double horner(const double* c, int n, double t)
+{
+    double r = c[n - 1];
+    for (int k = n - 2; k >= 0; k--) {
+        r = r * t + c[k];
+    }
+    return r;
+}
+
+void bezier_curve_load(struct bezier_curve* curve, uint64_t time_start, uint64_t time_stop,
+    const double x[BEZIER_POINTS], const double y[BEZIER_POINTS])
+{
+    curve->time_start = time_start;
+    curve->time_stop = time_stop;
+    double T = (double)(time_stop - time_start) * 1e-9;
+    if (time_stop <= time_start) {
+        // empty curve, never active
+        T = 1;
+    }
+    power_basis(x, T, curve->x, curve->vx, curve->ax);
+    power_basis(y, T, curve->y, curve->vy, curve->ay);
+}
+
+void bezier_curve_eval(const struct bezier_curve* curve, double t, struct bezier_ref* ref)
+{
+    double vx = horner(curve->vx, BEZIER_POINTS - 1, t);
+    double vy = horner(curve->vy, BEZIER_POINTS - 1, t);
+    double ax = horner(curve->ax, BEZIER_POINTS - 2, t);
+    double ay = horner(curve->ay, BEZIER_POINTS - 2, t);
+    double V2 = vx * vx + vy * vy;
+
+    ref->x = horner(curve->x, BEZIER_POINTS, t);
+    ref->y = horner(curve->y, BEZIER_POINTS, t);
+    ref->psi = atan2(vy, vx);
+    ref->V = sqrt(V2);
+    ref->omega = V2 > 1e-12 ? (vx * ay - vy * ax) / V2 : 0;
+}
+
+void bezier_cache_load(struct bezier_cache* cache, const synapse_msgs_BezierTrajectory* msg)
+{
+    int count = MIN(msg->curves_count, (int)BEZIER_CURVES_MAX);
+    uint64_t time_start = msg->time_start;
+
+    for (int i = 0; i < count; i++) {
+        bezier_curve_load(&cache->curves[i], time_start, msg->curves[i].time_stop,
+            msg->curves[i].x, msg->curves[i].y);
+        time_start = msg->curves[i].time_stop;
+    }
+    cache->count = count;
+    cache->index = 0;
+}
+
+int bezier_cache_eval(struct bezier_cache* cache, uint64_t time_nsec, struct bezier_ref* ref)
+{
+    if (cache->count == 0 || time_nsec < cache->curves[0].time_start) {
+        return -EAGAIN;
+    }
+
+    // back to the first curve if time went backward, then forward
+    if (time_nsec < cache->curves[cache->index].time_start) {
+        cache->index = 0;
+    }
+    while (time_nsec >= cache->curves[cache->index].time_stop) {
+        if (cache->index + 1 >= cache->count) {
+            return -ERANGE;
+        }
+        cache->index++;
+    }
+
+    const struct bezier_curve* curve = &cache->curves[cache->index];
+    bezier_curve_eval(curve, (double)(time_nsec - curve->time_start) * 1e-9, ref);
+    return 0;
+}
+
+// vi: ts=4 sw=4 et
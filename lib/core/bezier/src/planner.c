@@ -0,0 +1,227 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <zros/zros_node.h>
+#include <zros/zros_pub.h>
+#include <zros/zros_sub.h>
+
+#include <cerebri/core/bezier.h>
+
+LOG_MODULE_REGISTER(core_bezier_planner, CONFIG_CEREBRI_CORE_BEZIER_LOG_LEVEL);
+
+// retiming search, samples per curve, resolution and bracket growth
+#define RETIME_SAMPLES 32
+#define RETIME_RESOLUTION_NSEC 1000000ULL
+#define RETIME_DOUBLINGS 4
+
+int bezier_planner_init(struct bezier_planner* ctx, const struct bezier_planner_model* model)
+{
+    casadi_int sz_arg, sz_res, sz_iw, sz_w;
+    model->solve_work(&sz_arg, &sz_res, &sz_iw, &sz_w);
+    if (sz_arg != 3 || sz_res != 1
+        || sz_iw > (casadi_int)ARRAY_SIZE(ctx->iw)
+        || sz_w > (casadi_int)ARRAY_SIZE(ctx->w)) {
+        LOG_ERR("%s solve doesn't fit, iw %d w %d", model->name, (int)sz_iw, (int)sz_w);
+        return -EINVAL;
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->model = model;
+    zros_node_init(&ctx->node, model->name);
+    zros_sub_init(&ctx->sub_waypoints, &ctx->node, &topic_bezier_waypoints, &ctx->waypoints, 10);
+    zros_pub_init(&ctx->pub_trajectory, &ctx->node, &topic_bezier_trajectory, &ctx->trajectory);
+    return 0;
+}
+
+static void solve_axis(struct bezier_planner* ctx, const double wp_0[2], const double wp_1[2],
+    double T, double P[BEZIER_POINTS])
+{
+    const casadi_real* args[] = { wp_0, wp_1, &T };
+    casadi_real* res[] = { P };
+    ctx->model->solve(args, res, ctx->iw, ctx->w, 0);
+}
+
+static void solve_curve(struct bezier_planner* ctx, const struct bezier_waypoint* wp_0,
+    const struct bezier_waypoint* wp_1, uint64_t duration, synapse_msgs_BezierCurve* curve)
+{
+    double T = (double)duration * 1e-9;
+    solve_axis(ctx, wp_0->x, wp_1->x, T, curve->x);
+    solve_axis(ctx, wp_0->y, wp_1->y, T, curve->y);
+    curve->x_count = BEZIER_POINTS;
+    curve->y_count = BEZIER_POINTS;
+    curve->z_count = 0;
+    curve->yaw_count = 0;
+}
+
+#if defined(CONFIG_CEREBRI_CORE_BEZIER_PLANNER_RETIME)
+// solves the curve for the duration, true if it stays in the limits
+static bool curve_feasible(struct bezier_planner* ctx, const struct bezier_waypoint* wp_0,
+    const struct bezier_waypoint* wp_1, uint64_t duration, synapse_msgs_BezierCurve* curve)
+{
+    const struct bezier_planner_model* model = ctx->model;
+    solve_curve(ctx, wp_0, wp_1, duration, curve);
+
+    struct bezier_curve c;
+    bezier_curve_load(&c, 0, duration, curve->x, curve->y);
+    double T = (double)duration * 1e-9;
+    for (int i = 0; i <= RETIME_SAMPLES; i++) {
+        struct bezier_ref ref;
+        bezier_curve_eval(&c, T * i / RETIME_SAMPLES, &ref);
+        // a waypoint at the top speed is in the limits
+        if (ref.V > model->max_velocity * (1 + 1e-6)) {
+            return false;
+        }
+        // bicycle steering angle, atan(L kappa), kappa = omega / V
+        if (model->max_turn_angle > 0 && ref.V > 1e-6
+            && fabs(atan(model->wheel_base * ref.omega / ref.V)) > model->max_turn_angle) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// shortest feasible duration, the curve is left solved for it
+static uint64_t retime_curve(struct bezier_planner* ctx, const struct bezier_waypoint* wp_0,
+    const struct bezier_waypoint* wp_1, synapse_msgs_BezierCurve* curve)
+{
+    uint64_t given = wp_1->time_nsec - wp_0->time_nsec;
+
+    // a hold, at rest at one point, has no path to speed along
+    double chord = hypot(wp_1->x[0] - wp_0->x[0], wp_1->y[0] - wp_0->y[0]);
+    double moving = chord + hypot(wp_0->x[1], wp_0->y[1]) + hypot(wp_1->x[1], wp_1->y[1]);
+    if (ctx->model->max_velocity <= 0 || moving < 1e-6) {
+        solve_curve(ctx, wp_0, wp_1, given, curve);
+        return given;
+    }
+
+    // no faster than the chord at the top speed
+    uint64_t lo = (uint64_t)(chord / ctx->model->max_velocity * 1e9);
+    uint64_t hi = given;
+    for (int i = 0; !curve_feasible(ctx, wp_0, wp_1, hi, curve); i++) {
+        if (i == RETIME_DOUBLINGS) {
+            LOG_WRN("%s curve infeasible, kept", ctx->model->name);
+            solve_curve(ctx, wp_0, wp_1, given, curve);
+            return given;
+        }
+        lo = hi;
+        hi *= 2;
+    }
+
+    // hi is feasible, lo is not or is the bound
+    bool solved_hi = true;
+    while (lo + RETIME_RESOLUTION_NSEC < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        solved_hi = curve_feasible(ctx, wp_0, wp_1, mid, curve);
+        if (solved_hi) {
+            hi = mid;
+        } else {
+            lo = mid;
+        }
+    }
+    if (!solved_hi) {
+        solve_curve(ctx, wp_0, wp_1, hi, curve);
+    }
+    return hi;
+}
+#endif
+
+// the waypoints of the message, checks they are in order
+static int read_waypoints(const synapse_msgs_BezierTrajectory* msg, struct bezier_waypoint* wp)
+{
+    if (msg->curves_count < 2) {
+        return -EINVAL;
+    }
+    for (int i = 0; i < msg->curves_count; i++) {
+        const synapse_msgs_BezierCurve* c = &msg->curves[i];
+        if (c->x_count < 2 || c->y_count < 2) {
+            return -EINVAL;
+        }
+        // zeroed, compared with memcmp
+        memset(&wp[i], 0, sizeof(wp[i]));
+        wp[i].time_nsec = c->time_stop;
+        wp[i].x[0] = c->x[0];
+        wp[i].x[1] = c->x[1];
+        wp[i].y[0] = c->y[0];
+        wp[i].y[1] = c->y[1];
+        if (i > 0 && wp[i].time_nsec <= wp[i - 1].time_nsec) {
+            return -EINVAL;
+        }
+    }
+    return msg->curves_count;
+}
+
+int bezier_planner_step(struct bezier_planner* ctx)
+{
+    if (!zros_sub_update_available(&ctx->sub_waypoints)) {
+        return 0;
+    }
+    zros_sub_update(&ctx->sub_waypoints);
+
+    struct bezier_waypoint wp[BEZIER_CURVES_MAX];
+    int count = read_waypoints(&ctx->waypoints, wp);
+    if (count < 0) {
+        LOG_WRN("%s waypoints rejected", ctx->model->name);
+        return count;
+    }
+
+    // the first waypoint in the previous plan, if it is still there
+    int offset = -1;
+    for (int j = 0; j < ctx->plan_count; j++) {
+        if (ctx->plan[j].time_nsec == wp[0].time_nsec) {
+            offset = j;
+            break;
+        }
+    }
+
+    // curve k of the previous plan is k + offset, moved down in place,
+    // the source is never before the curve being written
+    synapse_msgs_BezierTrajectory* traj = &ctx->trajectory;
+    int solved = 0;
+    for (int k = 0; k < count - 1; k++) {
+        int j = k + offset;
+        if (offset >= 0 && j + 1 < ctx->plan_count
+            && memcmp(&ctx->plan[j], &wp[k], sizeof(wp[k])) == 0
+            && memcmp(&ctx->plan[j + 1], &wp[k + 1], sizeof(wp[k])) == 0) {
+            if (j != k) {
+                traj->curves[k] = traj->curves[j];
+                ctx->duration[k] = ctx->duration[j];
+            }
+            continue;
+        }
+#if defined(CONFIG_CEREBRI_CORE_BEZIER_PLANNER_RETIME)
+        ctx->duration[k] = retime_curve(ctx, &wp[k], &wp[k + 1], &traj->curves[k]);
+#else
+        ctx->duration[k] = wp[k + 1].time_nsec - wp[k].time_nsec;
+        solve_curve(ctx, &wp[k], &wp[k + 1], ctx->duration[k], &traj->curves[k]);
+#endif
+        solved++;
+    }
+
+    memcpy(ctx->plan, wp, count * sizeof(wp[0]));
+    ctx->plan_count = count;
+
+    traj->has_header = ctx->waypoints.has_header;
+    traj->header = ctx->waypoints.header;
+    traj->time_start = wp[0].time_nsec;
+    traj->curves_count = count - 1;
+    uint64_t time_stop = traj->time_start;
+    for (int k = 0; k < count - 1; k++) {
+        time_stop += ctx->duration[k];
+        traj->curves[k].time_stop = time_stop;
+    }
+    zros_pub_update(&ctx->pub_trajectory);
+
+    LOG_DBG("%s solved %d of %d curves", ctx->model->name, solved, count - 1);
+    return solved;
+}
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,60 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+
+#if defined(CONFIG_NET_IPV4)
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/net_ip.h>
+#endif
+
+#include <cerebri/core/instance.h>
+
+LOG_MODULE_DECLARE(core_common);
+
+#if defined(CONFIG_NET_CONFIG_PEER_IPV4_ADDR)
+#define PEER_IPV4_ADDR CONFIG_NET_CONFIG_PEER_IPV4_ADDR
+#else
+#define PEER_IPV4_ADDR "192.0.2.2"
+#endif
+
+struct cerebri_instance g_cerebri_instance = {
+    .id = 0,
+    .port_base = CONFIG_CEREBRI_CORE_COMMON_INSTANCE_PORT_BASE,
+    .peer_ipv4 = PEER_IPV4_ADDR,
+    .my_ipv4 = NULL,
+};
+
+#if defined(CONFIG_NET_IPV4) && defined(CONFIG_NET_CONFIG_AUTO_INIT) && defined(CONFIG_NET_CONFIG_MY_IPV4_ADDR)
+// replace the configured address, runs after net config set it up
+static int instance_address_init(void)
+{
+    if (g_cerebri_instance.my_ipv4 == NULL) {
+        return 0;
+    }
+
+    struct net_if* iface = net_if_get_default();
+    struct in_addr addr;
+    if (iface == NULL || net_addr_pton(AF_INET, g_cerebri_instance.my_ipv4, &addr) < 0) {
+        LOG_ERR("invalid instance address %s", g_cerebri_instance.my_ipv4);
+        return -EINVAL;
+    }
+
+    struct in_addr configured;
+    if (net_addr_pton(AF_INET, CONFIG_NET_CONFIG_MY_IPV4_ADDR, &configured) == 0) {
+        net_if_ipv4_addr_rm(iface, &configured);
+    }
+    if (net_if_ipv4_addr_add(iface, &addr, NET_ADDR_MANUAL, 0) == NULL) {
+        LOG_ERR("failed to add instance address %s", g_cerebri_instance.my_ipv4);
+        return -ENOMEM;
+    }
+    LOG_INF("instance %d address %s", g_cerebri_instance.id, g_cerebri_instance.my_ipv4);
+    return 0;
+}
+
+SYS_INIT(instance_address_init, APPLICATION, CONFIG_NET_CONFIG_INIT_PRIO + 1);
+#endif
+
+// vi: ts=4 sw=4 et
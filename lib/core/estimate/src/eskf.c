@@ -0,0 +1,219 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "eskf.h"
+
+#define N ESKF_N
+
+static void symmetrize(double P[N][N])
+{
+    for (int i = 0; i < N; i++) {
+        for (int j = i + 1; j < N; j++) {
+            double p = 0.5 * (P[i][j] + P[j][i]);
+            P[i][j] = p;
+            P[j][i] = p;
+        }
+    }
+}
+
+void eskf_predict(double P[N][N], double theta, double u, double dt,
+    const struct eskf_noise* noise)
+{
+    double c = cos(theta);
+    double s = sin(theta);
+
+    // F = I + dF, the heading error moves the position across the
+    // step, the bias error integrates into the heading
+    double F[N][N] = {
+        { 1, 0, -u * s, 0 },
+        { 0, 1, u * c, 0 },
+        { 0, 0, 1, -dt },
+        { 0, 0, 0, 1 },
+    };
+
+    double FP[N][N] = {};
+    for (int i = 0; i < N; i++) {
+        for (int k = 0; k < N; k++) {
+            for (int j = 0; j < N; j++) {
+                FP[i][j] += F[i][k] * P[k][j];
+            }
+        }
+    }
+
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) {
+            double sum = 0;
+            for (int k = 0; k < N; k++) {
+                sum += FP[i][k] * F[j][k];
+            }
+            P[i][j] = sum;
+        }
+    }
+
+    // wheel and slip noise along and across the heading, the variance
+    // grows with the distance, so it doesn't depend on the step rate
+    double var_along = noise->wheel * noise->wheel * fabs(u);
+    double var_across = noise->slip * noise->slip * fabs(u);
+    P[ESKF_X][ESKF_X] += c * c * var_along + s * s * var_across;
+    P[ESKF_X][ESKF_Y] += c * s * (var_along - var_across);
+    P[ESKF_Y][ESKF_X] += c * s * (var_along - var_across);
+    P[ESKF_Y][ESKF_Y] += s * s * var_along + c * c * var_across;
+    P[ESKF_THETA][ESKF_THETA] += noise->gyro * noise->gyro * dt;
+    P[ESKF_GYRO_BIAS][ESKF_GYRO_BIAS] += noise->gyro_bias * noise->gyro_bias * dt;
+    symmetrize(P);
+}
+
+// invert the m x m matrix A in place, gauss jordan with partial pivoting
+static int invert(int m, double A[ESKF_M_MAX][ESKF_M_MAX])
+{
+    double inv[ESKF_M_MAX][ESKF_M_MAX] = {};
+    for (int i = 0; i < m; i++) {
+        inv[i][i] = 1;
+    }
+
+    for (int col = 0; col < m; col++) {
+        int pivot = col;
+        for (int i = col + 1; i < m; i++) {
+            if (fabs(A[i][col]) > fabs(A[pivot][col])) {
+                pivot = i;
+            }
+        }
+        if (fabs(A[pivot][col]) < 1e-12) {
+            return -EDOM;
+        }
+        for (int j = 0; j < m; j++) {
+            double t = A[col][j];
+            A[col][j] = A[pivot][j];
+            A[pivot][j] = t;
+            t = inv[col][j];
+            inv[col][j] = inv[pivot][j];
+            inv[pivot][j] = t;
+        }
+        double d = A[col][col];
+        for (int j = 0; j < m; j++) {
+            A[col][j] /= d;
+            inv[col][j] /= d;
+        }
+        for (int i = 0; i < m; i++) {
+            if (i == col) {
+                continue;
+            }
+            double f = A[i][col];
+            for (int j = 0; j < m; j++) {
+                A[i][j] -= f * A[col][j];
+                inv[i][j] -= f * inv[col][j];
+            }
+        }
+    }
+    memcpy(A, inv, sizeof(inv));
+    return 0;
+}
+
+int eskf_update(double P[N][N], int m, const double y[],
+    const double H[][N], const double R[][ESKF_M_MAX], double gate,
+    double dx[N])
+{
+    // P H^T, N x m
+    double PHt[N][ESKF_M_MAX] = {};
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < m; j++) {
+            for (int k = 0; k < N; k++) {
+                PHt[i][j] += P[i][k] * H[j][k];
+            }
+        }
+    }
+
+    // S = H P H^T + R, inverted in place
+    double S[ESKF_M_MAX][ESKF_M_MAX] = {};
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < m; j++) {
+            S[i][j] = R[i][j];
+            for (int k = 0; k < N; k++) {
+                S[i][j] += H[i][k] * PHt[k][j];
+            }
+        }
+    }
+    int rc = invert(m, S);
+    if (rc < 0) {
+        return rc;
+    }
+
+    // normalized innovation squared
+    double S_inv_y[ESKF_M_MAX] = {};
+    double nis = 0;
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < m; j++) {
+            S_inv_y[i] += S[i][j] * y[j];
+        }
+        nis += y[i] * S_inv_y[i];
+    }
+    if (nis > gate) {
+        return -ERANGE;
+    }
+
+    // K = P H^T S^-1, dx = K y
+    double K[N][ESKF_M_MAX] = {};
+    for (int i = 0; i < N; i++) {
+        dx[i] = 0;
+        for (int j = 0; j < m; j++) {
+            for (int k = 0; k < m; k++) {
+                K[i][j] += PHt[i][k] * S[k][j];
+            }
+        }
+        for (int j = 0; j < m; j++) {
+            dx[i] += PHt[i][j] * S_inv_y[j];
+        }
+    }
+
+    // joseph form, P = (I - K H) P (I - K H)^T + K R K^T
+    double A[N][N];
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) {
+            A[i][j] = i == j ? 1 : 0;
+            for (int k = 0; k < m; k++) {
+                A[i][j] -= K[i][k] * H[k][j];
+            }
+        }
+    }
+
+    double AP[N][N] = {};
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) {
+            for (int k = 0; k < N; k++) {
+                AP[i][j] += A[i][k] * P[k][j];
+            }
+        }
+    }
+
+    double KR[N][ESKF_M_MAX] = {};
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < m; j++) {
+            for (int k = 0; k < m; k++) {
+                KR[i][j] += K[i][k] * R[k][j];
+            }
+        }
+    }
+
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) {
+            double sum = 0;
+            for (int k = 0; k < N; k++) {
+                sum += AP[i][k] * A[j][k];
+            }
+            for (int k = 0; k < m; k++) {
+                sum += KR[i][k] * K[j][k];
+            }
+            P[i][j] = sum;
+        }
+    }
+    symmetrize(P);
+    return 0;
+}
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,60 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_ESTIMATE_ESKF_H
+#define CEREBRI_CORE_ESTIMATE_ESKF_H
+
+/*
+ * Error state Kalman filter of the planar rover.
+ *
+ * The nominal state, position, heading and gyro bias, is propagated by
+ * the casadi predict function, the filter only propagates and corrects
+ * the covariance of the error state, which stays small so its dynamics
+ * are linear. After an update the error is added to the nominal state
+ * by the caller and reset to zero.
+ *
+ * All matrices are fixed size, there is no allocation, a predict or an
+ * update is a few hundred flops.
+ */
+
+#define ESKF_N 4
+#define ESKF_M_MAX 3
+
+// error state
+enum {
+    ESKF_X = 0,
+    ESKF_Y = 1,
+    ESKF_THETA = 2,
+    ESKF_GYRO_BIAS = 3,
+};
+
+struct eskf_noise {
+    // std of the distance travelled after a unit distance, m/sqrt(m)
+    double wheel;
+    // std of the lateral slip after a unit distance, m/sqrt(m)
+    double slip;
+    // gyro noise density, rad/s/sqrt(Hz)
+    double gyro;
+    // gyro bias random walk, rad/s/sqrt(s)
+    double gyro_bias;
+};
+
+// propagate the covariance over a step of distance u at heading theta
+void eskf_predict(double P[ESKF_N][ESKF_N], double theta, double u, double dt,
+    const struct eskf_noise* noise);
+
+/*
+ * Update with m <= ESKF_M_MAX measurements, y is the innovation, H the
+ * m x ESKF_N jacobian and R the m x m noise covariance. The measurement
+ * is rejected if its normalized innovation squared exceeds gate.
+ *
+ * Returns 0 and the error state dx, -ERANGE if rejected by the gate and
+ * -EDOM if the innovation covariance is singular.
+ */
+int eskf_update(double P[ESKF_N][ESKF_N], int m, const double y[],
+    const double H[][ESKF_N], const double R[][ESKF_M_MAX], double gate,
+    double dx[ESKF_N]);
+
+#endif // CEREBRI_CORE_ESTIMATE_ESKF_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,410 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <zros/zros_node.h>
+#include <zros/zros_pub.h>
+#include <zros/zros_sub.h>
+
+#include <cerebri/core/estimate.h>
+
+#include "eskf.h"
+
+LOG_MODULE_REGISTER(core_estimate, CONFIG_CEREBRI_CORE_ESTIMATE_LOG_LEVEL);
+
+BUILD_ASSERT(ESKF_N == ESTIMATE_STATE_N, "estimate state size mismatch");
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define EARTH_RADIUS_M 6378137.0
+#define DEG2RAD (M_PI / 180)
+
+// 99.9 % chi square bound of the normalized innovation, by dimension
+static const double g_gate[ESKF_M_MAX + 1] = { 0, 10.83, 13.82, 16.27 };
+
+// process noise of the error state
+static const struct eskf_noise g_noise = {
+    .wheel = 0.05,
+    .slip = 0.02,
+    .gyro = 0.005,
+    .gyro_bias = 1e-4,
+};
+
+int estimate_init(struct estimate* ctx, const struct estimate_model* model, int rate_hz)
+{
+    casadi_int sz_arg, sz_res, sz_iw, sz_w;
+    model->predict_work(&sz_arg, &sz_res, &sz_iw, &sz_w);
+    if (sz_arg != 3 || sz_res != 1
+        || sz_iw > (casadi_int)ARRAY_SIZE(ctx->iw)
+        || sz_w > (casadi_int)ARRAY_SIZE(ctx->w)) {
+        LOG_ERR("%s predict doesn't fit, iw %d w %d", model->name, (int)sz_iw, (int)sz_w);
+        return -EINVAL;
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->model = model;
+    ctx->wheel_odometry = (synapse_msgs_WheelOdometry)synapse_msgs_WheelOdometry_init_default;
+    ctx->imu = (synapse_msgs_Imu)synapse_msgs_Imu_init_default;
+    strncpy(ctx->odometry.child_frame_id, "base_link", sizeof(ctx->odometry.child_frame_id) - 1);
+    ctx->odometry.has_header = true;
+    strncpy(ctx->odometry.header.frame_id, "odom", sizeof(ctx->odometry.header.frame_id) - 1);
+    ctx->odometry.has_pose = true;
+    ctx->odometry.pose.has_pose = true;
+    ctx->odometry.pose.pose.has_position = true;
+    ctx->odometry.pose.pose.has_orientation = true;
+    ctx->odometry.pose.covariance_count = 36;
+
+    zros_node_init(&ctx->node, model->name);
+    zros_sub_init(&ctx->sub_imu, &ctx->node, &topic_imu, &ctx->imu, rate_hz);
+    zros_sub_init(&ctx->sub_wheel_odometry, &ctx->node, &topic_wheel_odometry,
+        &ctx->wheel_odometry, rate_hz);
+    zros_pub_init(&ctx->pub_odometry, &ctx->node, &topic_estimator_odometry, &ctx->odometry);
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+    zros_sub_init(&ctx->sub_imu_delta, &ctx->node, &topic_imu_delta, &ctx->imu_delta, rate_hz);
+#endif
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_MAG)
+    zros_sub_init(&ctx->sub_magnetic_field, &ctx->node, &topic_magnetic_field,
+        &ctx->magnetic_field, rate_hz);
+#endif
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_GNSS)
+    zros_sub_init(&ctx->sub_nav_sat_fix, &ctx->node, &topic_nav_sat_fix,
+        &ctx->nav_sat_fix, rate_hz);
+#endif
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_EXTERNAL_ODOMETRY)
+    zros_sub_init(&ctx->sub_external_odometry, &ctx->node, &topic_external_odometry,
+        &ctx->external_odometry, rate_hz);
+#endif
+
+    // the odom frame starts at the vehicle, the gyro was just calibrated
+    ctx->P[ESKF_GYRO_BIAS][ESKF_GYRO_BIAS] = 1e-4;
+    return 0;
+}
+
+static bool all_finite(const double* src, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (!isfinite(src[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void handle_update(struct estimate* ctx, double* x1)
+{
+    bool x1_finite = all_finite(x1, ARRAY_SIZE(ctx->x));
+
+    if (!x1_finite) {
+        LOG_WRN("x1 update not finite");
+    }
+
+    if (x1_finite) {
+        memcpy(ctx->x, x1, sizeof(ctx->x));
+    }
+}
+
+static double wrap_pi(double angle)
+{
+    return angle - 2 * M_PI * floor((angle + M_PI) / (2 * M_PI));
+}
+
+// correct the nominal state with the error of an update
+static void eskf_correct(struct estimate* ctx, int m, const double y[],
+    const double H[][ESKF_N], const double R[][ESKF_M_MAX], const char* name)
+{
+    double dx[ESKF_N];
+    int rc = eskf_update(ctx->P, m, y, H, R, g_gate[m], dx);
+    if (rc == -ERANGE) {
+        LOG_DBG("%s rejected", name);
+        return;
+    } else if (rc < 0) {
+        LOG_WRN("%s update failed %d", name, rc);
+        return;
+    } else if (!all_finite(dx, ESKF_N)) {
+        LOG_WRN("%s update not finite", name);
+        return;
+    }
+    ctx->x[0] += dx[ESKF_X];
+    ctx->x[1] += dx[ESKF_Y];
+    ctx->x[2] += dx[ESKF_THETA];
+    ctx->gyro_bias += dx[ESKF_GYRO_BIAS];
+}
+
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_MAG)
+// heading from the horizontal field, the board is assumed level
+static bool mag_heading(const struct estimate* ctx, double* theta)
+{
+    double mx = ctx->magnetic_field.magnetic_field.x;
+    double my = ctx->magnetic_field.magnetic_field.y;
+    if (hypot(mx, my) < 1e-9) {
+        return false;
+    }
+    *theta = wrap_pi(atan2(mx, my) - CONFIG_CEREBRI_CORE_ESTIMATE_MAG_DECLINATION_MRAD / 1000.0);
+    return true;
+}
+
+static void update_mag(struct estimate* ctx)
+{
+    double theta;
+    if (!mag_heading(ctx, &theta)) {
+        return;
+    }
+    double std = CONFIG_CEREBRI_CORE_ESTIMATE_MAG_STD_MRAD / 1000.0;
+    const double y[1] = { wrap_pi(theta - ctx->x[2]) };
+    const double H[1][ESKF_N] = { { 0, 0, 1, 0 } };
+    const double R[1][ESKF_M_MAX] = { { std * std } };
+    eskf_correct(ctx, 1, y, H, R, "mag");
+}
+#endif
+
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_GNSS)
+static void update_gnss(struct estimate* ctx)
+{
+    const synapse_msgs_NavSatFix* fix = &ctx->nav_sat_fix;
+    if (fix->status.status < 0 || !isfinite(fix->latitude) || !isfinite(fix->longitude)) {
+        return;
+    }
+
+    // the first fix is the origin of the plane, where the vehicle is now
+    if (!ctx->gnss_origin_set) {
+        ctx->lat0 = fix->latitude;
+        ctx->lon0 = fix->longitude;
+        ctx->cos_lat0 = cos(fix->latitude * DEG2RAD);
+        ctx->gnss_offset[0] = ctx->x[0];
+        ctx->gnss_offset[1] = ctx->x[1];
+        ctx->gnss_origin_set = true;
+        LOG_INF("gnss origin %10.6f %10.6f", fix->latitude, fix->longitude);
+        return;
+    }
+
+    double east = (fix->longitude - ctx->lon0) * DEG2RAD * EARTH_RADIUS_M * ctx->cos_lat0;
+    double north = (fix->latitude - ctx->lat0) * DEG2RAD * EARTH_RADIUS_M;
+    const double y[2] = {
+        east + ctx->gnss_offset[0] - ctx->x[0],
+        north + ctx->gnss_offset[1] - ctx->x[1],
+    };
+    const double H[2][ESKF_N] = {
+        { 1, 0, 0, 0 },
+        { 0, 1, 0, 0 },
+    };
+    double std = CONFIG_CEREBRI_CORE_ESTIMATE_GNSS_STD_MM / 1000.0;
+    double R[2][ESKF_M_MAX] = {
+        { std * std, 0, 0 },
+        { 0, std * std, 0 },
+    };
+    // east north up covariance of the receiver, when it reports one
+    if (fix->position_covariance_type != 0 && fix->position_covariance_count == 9) {
+        R[0][0] = fix->position_covariance[0];
+        R[0][1] = fix->position_covariance[1];
+        R[1][0] = fix->position_covariance[3];
+        R[1][1] = fix->position_covariance[4];
+    }
+    eskf_correct(ctx, 2, y, H, R, "gnss");
+}
+#endif
+
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_EXTERNAL_ODOMETRY)
+static void update_external_odometry(struct estimate* ctx)
+{
+    const synapse_msgs_Pose* pose = &ctx->external_odometry.pose.pose;
+    const synapse_msgs_Quaternion* q = &pose->orientation;
+    double yaw = atan2(2 * (q->w * q->z + q->x * q->y), 1 - 2 * (q->y * q->y + q->z * q->z));
+    const double y[3] = {
+        pose->position.x - ctx->x[0],
+        pose->position.y - ctx->x[1],
+        wrap_pi(yaw - ctx->x[2]),
+    };
+    const double H[3][ESKF_N] = {
+        { 1, 0, 0, 0 },
+        { 0, 1, 0, 0 },
+        { 0, 0, 1, 0 },
+    };
+    double std = CONFIG_CEREBRI_CORE_ESTIMATE_EXTERNAL_ODOMETRY_STD_MM / 1000.0;
+    double std_yaw = CONFIG_CEREBRI_CORE_ESTIMATE_EXTERNAL_ODOMETRY_STD_MRAD / 1000.0;
+    double R[3][ESKF_M_MAX] = {
+        { std * std, 0, 0 },
+        { 0, std * std, 0 },
+        { 0, 0, std_yaw * std_yaw },
+    };
+    // x, y and yaw of the 6 x 6 pose covariance, when it is given
+    if (ctx->external_odometry.pose.covariance_count == 36) {
+        static const int idx[3] = { 0, 1, 5 };
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                R[i][j] = ctx->external_odometry.pose.covariance[idx[i] * 6 + idx[j]];
+            }
+        }
+    }
+    eskf_correct(ctx, 3, y, H, R, "external odometry");
+}
+#endif
+
+// the wheel odometry is slower than imu, so the speed is taken over the
+// interval between its messages, not the distance of a predict step
+static void update_speed(struct estimate* ctx)
+{
+    int64_t ticks = k_uptime_ticks();
+    double rotation = ctx->wheel_odometry.rotation;
+    if (ctx->wheel_odometry_received && ticks > ctx->ticks_wheel_last) {
+        double dt = (double)(ticks - ctx->ticks_wheel_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+        ctx->speed = (rotation - ctx->rotation_speed_last) * ctx->model->wheel_radius / dt;
+    }
+    ctx->rotation_speed_last = rotation;
+    ctx->ticks_wheel_last = ticks;
+}
+
+void estimate_step(struct estimate* ctx)
+{
+    if (zros_sub_update_available(&ctx->sub_imu)) {
+        zros_sub_update(&ctx->sub_imu);
+        trace_consume(TRACE_TOPIC_IMU, &ctx->origin);
+        ctx->imu_received = true;
+    }
+
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+    // published by sense imu just before the imu it was integrated with
+    bool delta_available = zros_sub_update_available(&ctx->sub_imu_delta);
+    if (delta_available) {
+        zros_sub_update(&ctx->sub_imu_delta);
+    }
+#endif
+
+    if (zros_sub_update_available(&ctx->sub_wheel_odometry)) {
+        zros_sub_update(&ctx->sub_wheel_odometry);
+        update_speed(ctx);
+        ctx->wheel_odometry_received = true;
+    }
+
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_MAG)
+    bool mag_available = zros_sub_update_available(&ctx->sub_magnetic_field);
+    if (mag_available) {
+        zros_sub_update(&ctx->sub_magnetic_field);
+    }
+#endif
+
+    // start once both imu and wheel odometry have been received
+    if (!ctx->started) {
+        if (!ctx->imu_received) {
+            LOG_DBG("waiting for imu");
+            return;
+        } else if (!ctx->wheel_odometry_received) {
+            LOG_DBG("waiting for wheel odometry");
+            return;
+        }
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_MAG)
+        // the initial heading is the magnetic one
+        double theta;
+        if (!mag_available || !mag_heading(ctx, &theta)) {
+            LOG_DBG("waiting for mag");
+            return;
+        }
+        ctx->x[2] = theta;
+        double std = CONFIG_CEREBRI_CORE_ESTIMATE_MAG_STD_MRAD / 1000.0;
+        ctx->P[ESKF_THETA][ESKF_THETA] = std * std;
+        mag_available = false;
+#endif
+        ctx->started = true;
+        ctx->ticks_last = k_uptime_ticks();
+        return;
+    }
+
+    // calculate dt
+    int64_t ticks_now = k_uptime_ticks();
+    double dt = (float)(ticks_now - ctx->ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+    ctx->ticks_last = ticks_now;
+    if (dt < 0 || dt > 0.5) {
+        LOG_WRN("imu update rate too low");
+        return;
+    }
+
+    // get data
+    double rotation = ctx->wheel_odometry.rotation;
+
+    // negative sign due to current gearing, should be in driver
+    double u = (rotation - ctx->rotation_last) * ctx->model->wheel_radius;
+    ctx->rotation_last = rotation;
+
+    double omega = ctx->imu.angular_velocity.z - ctx->gyro_bias;
+    double delta_theta = omega * dt;
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+    if (delta_available && ctx->imu_delta.dt_us > 0) {
+        double dt_delta = ctx->imu_delta.dt_us * 1e-6;
+        delta_theta = ctx->imu_delta.delta_angle[2] - ctx->gyro_bias * dt_delta;
+        omega = delta_theta / dt_delta;
+    }
+#endif
+    // LOG_DBG("imu omega z: %10.4f", omega);
+
+    /* predict:(x0[3],delta_theta,u)->(x1[3]) */
+    {
+        double x1[3];
+
+        const casadi_real* args[3] = { ctx->x, &delta_theta, &u };
+        casadi_real* res[1] = { x1 };
+        ctx->model->predict(args, res, ctx->iw, ctx->w, 0);
+
+        // update x, W
+        handle_update(ctx, x1);
+    }
+
+    // propagate the error covariance from the heading at the start of the step
+    eskf_predict(ctx->P, ctx->x[2] - delta_theta, u, dt, &g_noise);
+
+    // correct with the measurements that arrived since the last step
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_MAG)
+    if (mag_available) {
+        update_mag(ctx);
+    }
+#endif
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_GNSS)
+    if (zros_sub_update_available(&ctx->sub_nav_sat_fix)) {
+        zros_sub_update(&ctx->sub_nav_sat_fix);
+        update_gnss(ctx);
+    }
+#endif
+#if defined(CONFIG_CEREBRI_CORE_ESTIMATE_EXTERNAL_ODOMETRY)
+    if (zros_sub_update_available(&ctx->sub_external_odometry)) {
+        zros_sub_update(&ctx->sub_external_odometry);
+        update_external_odometry(ctx);
+    }
+#endif
+
+    // publish odometry
+    {
+        stamp_header(&ctx->odometry.header, k_uptime_ticks());
+        ctx->odometry.header.seq = ctx->seq++;
+
+        double theta = ctx->x[2];
+        ctx->odometry.pose.pose.position.x = ctx->x[0];
+        ctx->odometry.pose.pose.position.y = ctx->x[1];
+        ctx->odometry.pose.pose.position.z = 0;
+        ctx->odometry.pose.pose.orientation.x = 0;
+        ctx->odometry.pose.pose.orientation.y = 0;
+        ctx->odometry.pose.pose.orientation.z = sin(theta / 2);
+        ctx->odometry.pose.pose.orientation.w = cos(theta / 2);
+        ctx->odometry.twist.twist.angular.z = omega;
+        ctx->odometry.twist.twist.linear.x = ctx->speed;
+
+        // x, y and yaw of the 6 x 6 pose covariance
+        static const int idx[3] = { 0, 1, 5 };
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                ctx->odometry.pose.covariance[idx[i] * 6 + idx[j]] = ctx->P[i][j];
+            }
+        }
+        trace_publish(TRACE_TOPIC_ESTIMATOR_ODOMETRY, &ctx->origin, TRACE_STAGE_ESTIMATE);
+        zros_pub_update(&ctx->pub_odometry);
+    }
+}
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,299 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_pub_struct.h>
+#include <zros/private/zros_topic_struct.h>
+#include <zros/zros_broker.h>
+#include <zros/zros_node.h>
+#include <zros/zros_pub.h>
+#include <zros/zros_topic.h>
+
+#include <cerebri/core/sched.h>
+
+LOG_MODULE_REGISTER(core_sched, CONFIG_CEREBRI_CORE_SCHED_LOG_LEVEL);
+
+#define MY_STACK_SIZE 2048
+#define MY_PRIORITY CONFIG_CEREBRI_CORE_SCHED_MONITOR_PRIORITY
+
+#define PRIORITY_HIGHEST CONFIG_CEREBRI_CORE_SCHED_PRIORITY_HIGHEST
+#define PRIORITY_LOWEST CONFIG_CEREBRI_CORE_SCHED_PRIORITY_LOWEST
+#define MAX_GROUPS CONFIG_CEREBRI_CORE_SCHED_MAX_GROUPS
+
+BUILD_ASSERT(PRIORITY_HIGHEST <= PRIORITY_LOWEST, "sched priority range is empty");
+
+ZROS_TOPIC_DEFINE(sched_diagnostics, struct sched_diagnostics);
+
+// private context
+typedef struct _context {
+    struct zros_node node;
+    struct zros_pub pub_diagnostics;
+    struct sched_diagnostics diagnostics;
+    // groups by priority, highest first
+    struct sched_group* group[MAX_GROUPS];
+    int group_count;
+    uint32_t deadline_misses_reported[MAX_GROUPS];
+    uint32_t missed_releases_reported[MAX_GROUPS];
+    uint32_t budget_overruns_reported[MAX_GROUPS];
+} context;
+
+static context g_ctx = {};
+
+static uint64_t exec_cycles_now(void)
+{
+#if defined(CONFIG_SCHED_THREAD_USAGE) && !defined(CONFIG_THREAD_RUNTIME_STATS_USE_TIMING_FUNCTIONS)
+    // cycles the thread has run, excludes preemption
+    k_thread_runtime_stats_t stats;
+    k_thread_runtime_stats_get(k_current_get(), &stats);
+    return stats.execution_cycles;
+#else
+    // wall clock, includes preemption by higher priorities
+    return k_cycle_get_32();
+#endif
+}
+
+void sched_group_attach(struct sched_group* group)
+{
+    group->thread = k_current_get();
+    k_thread_priority_set(group->thread, group->priority);
+    LOG_DBG("%s attached at priority %d", group->name, group->priority);
+}
+
+void sched_job_begin(struct sched_group* group)
+{
+    uint32_t now = k_cycle_get_32();
+    int32_t late = (int32_t)(now - (group->cycle_release + group->period_cycles));
+
+    // a job starting within a period of its nominal release keeps it, one
+    // starting whole periods late counts the releases it missed and keeps
+    // the latest, so the rest of the lateness counts against the deadline,
+    // the first job or one waking early is released now
+    if (group->jobs == 0 || late < 0) {
+        group->cycle_release = now;
+    } else if (late >= (int32_t)group->period_cycles) {
+        uint32_t missed = (uint32_t)late / group->period_cycles;
+        group->missed_releases += missed;
+        group->cycle_release += (missed + 1) * group->period_cycles;
+    } else {
+        group->cycle_release += group->period_cycles;
+    }
+    group->cycle_begin = now;
+    group->exec_begin = exec_cycles_now();
+    group->in_job = true;
+}
+
+void sched_job_end(struct sched_group* group)
+{
+    if (!group->in_job) {
+        return;
+    }
+    group->in_job = false;
+
+    uint32_t response = k_cycle_get_32() - group->cycle_release;
+    uint32_t exec = (uint32_t)(exec_cycles_now() - group->exec_begin);
+
+    group->jobs++;
+    if (response > group->deadline_cycles) {
+        group->deadline_misses++;
+    }
+    if (exec > group->wcet_cycles) {
+        group->budget_overruns++;
+    }
+    if (response > group->max_response_cycles) {
+        group->max_response_cycles = response;
+    }
+    if (exec > group->max_exec_cycles) {
+        group->max_exec_cycles = exec;
+    }
+}
+
+/*
+ * Worst case response time of the group at index i under fixed priority
+ * preemptive scheduling, groups sharing the priority count as higher
+ * priority, returns 0 if it exceeds the deadline.
+ */
+static uint64_t response_time_us(const context* ctx, int i)
+{
+    const struct sched_group* g = ctx->group[i];
+    uint64_t r = g->wcet_us;
+    while (r <= g->deadline_us) {
+        uint64_t next = g->wcet_us;
+        for (int j = 0; j < ctx->group_count; j++) {
+            const struct sched_group* h = ctx->group[j];
+            if (j == i || h->priority > g->priority) {
+                continue;
+            }
+            next += DIV_ROUND_UP(r, h->period_us) * h->wcet_us;
+        }
+        if (next == r) {
+            return r;
+        }
+        r = next;
+    }
+    return 0;
+}
+
+static int sched_assign_priorities(void)
+{
+    context* ctx = &g_ctx;
+
+    STRUCT_SECTION_FOREACH(sched_group, group)
+    {
+        if (ctx->group_count == MAX_GROUPS) {
+            LOG_ERR("more than %d groups, %s not scheduled", MAX_GROUPS, group->name);
+            continue;
+        }
+        // insert by deadline, stable for equal deadlines
+        int i = ctx->group_count++;
+        for (; i > 0 && ctx->group[i - 1]->deadline_us > group->deadline_us; i--) {
+            ctx->group[i] = ctx->group[i - 1];
+        }
+        ctx->group[i] = group;
+    }
+
+    int priority = PRIORITY_HIGHEST;
+    uint64_t utilization_ppm = 0;
+    for (int i = 0; i < ctx->group_count; i++) {
+        struct sched_group* g = ctx->group[i];
+        if (i > 0 && g->deadline_us > ctx->group[i - 1]->deadline_us) {
+            priority++;
+        }
+        if (priority > PRIORITY_LOWEST) {
+            LOG_WRN("%s shares the lowest priority %d", g->name, PRIORITY_LOWEST);
+        }
+        g->priority = MIN(priority, PRIORITY_LOWEST);
+        g->period_cycles = k_us_to_cyc_ceil32(g->period_us);
+        g->deadline_cycles = k_us_to_cyc_ceil32(g->deadline_us);
+        g->wcet_cycles = k_us_to_cyc_ceil32(g->wcet_us);
+        utilization_ppm += (uint64_t)g->wcet_us * 1000000 / g->period_us;
+    }
+
+    for (int i = 0; i < ctx->group_count; i++) {
+        const struct sched_group* g = ctx->group[i];
+        uint64_t r = response_time_us(ctx, i);
+        if (r == 0) {
+            LOG_WRN("%s may miss its %d us deadline", g->name, g->deadline_us);
+        } else {
+            LOG_INF("%s priority %d worst case response %d us",
+                g->name, g->priority, (int)r);
+        }
+    }
+
+    if (utilization_ppm > 1000000) {
+        LOG_WRN("wcet utilization %d %% exceeds the cpu",
+            (int)(utilization_ppm / 10000));
+    }
+    return 0;
+}
+
+static void sched_collect(context* ctx)
+{
+    struct sched_diagnostics* d = &ctx->diagnostics;
+    d->uptime_ticks = k_uptime_ticks();
+    d->group_count = ctx->group_count;
+    for (int i = 0; i < ctx->group_count; i++) {
+        struct sched_group* g = ctx->group[i];
+        struct sched_group_status* s = &d->group[i];
+        s->name = g->name;
+        s->priority = g->priority;
+        s->jobs = g->jobs;
+        s->deadline_misses = g->deadline_misses;
+        s->missed_releases = g->missed_releases;
+        s->budget_overruns = g->budget_overruns;
+        // the group thread may raise a maximum while it is reset, this
+        // only loses one sample
+        s->max_response_us = k_cyc_to_us_ceil32(g->max_response_cycles);
+        s->max_exec_us = k_cyc_to_us_ceil32(g->max_exec_cycles);
+        g->max_response_cycles = 0;
+        g->max_exec_cycles = 0;
+    }
+}
+
+static void sched_report(context* ctx)
+{
+    const struct sched_diagnostics* d = &ctx->diagnostics;
+    for (int i = 0; i < d->group_count; i++) {
+        const struct sched_group_status* s = &d->group[i];
+        uint32_t misses = s->deadline_misses - ctx->deadline_misses_reported[i];
+        uint32_t missed = s->missed_releases - ctx->missed_releases_reported[i];
+        uint32_t overruns = s->budget_overruns - ctx->budget_overruns_reported[i];
+        if (misses > 0) {
+            LOG_WRN("%s missed %d deadlines, max response %d us",
+                s->name, misses, s->max_response_us);
+        }
+        if (missed > 0) {
+            LOG_WRN("%s missed %d releases", s->name, missed);
+        }
+        if (overruns > 0) {
+            LOG_WRN("%s overran its budget %d times, max exec %d us",
+                s->name, overruns, s->max_exec_us);
+        }
+        ctx->deadline_misses_reported[i] = s->deadline_misses;
+        ctx->missed_releases_reported[i] = s->missed_releases;
+        ctx->budget_overruns_reported[i] = s->budget_overruns;
+    }
+}
+
+static void sched_monitor_entry_point(void* p0, void* p1, void* p2)
+{
+    context* ctx = p0;
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+
+    zros_node_init(&ctx->node, "core_sched");
+    zros_pub_init(&ctx->pub_diagnostics, &ctx->node, &topic_sched_diagnostics,
+        &ctx->diagnostics);
+
+    while (true) {
+        k_msleep(CONFIG_CEREBRI_CORE_SCHED_DIAGNOSTICS_PERIOD_MS);
+        sched_collect(ctx);
+        zros_pub_update(&ctx->pub_diagnostics);
+        sched_report(ctx);
+    }
+}
+
+K_THREAD_DEFINE(core_sched, MY_STACK_SIZE, sched_monitor_entry_point,
+    &g_ctx, NULL, NULL, MY_PRIORITY, 0, 0);
+
+static int sched_add_topic(void)
+{
+    zros_broker_add_topic(&topic_sched_diagnostics);
+    return 0;
+}
+
+// priorities are needed before static threads start
+SYS_INIT(sched_assign_priorities, POST_KERNEL, 0);
+SYS_INIT(sched_add_topic, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#if defined(CONFIG_SHELL)
+static int cmd_status(const struct shell* sh, size_t argc, char** argv)
+{
+    const context* ctx = &g_ctx;
+    shell_print(sh, "%-20s %4s %8s %8s %8s %10s %8s %8s %8s %9s %9s",
+        "group", "prio", "period", "deadline", "wcet",
+        "jobs", "misses", "missed", "overruns", "max resp", "max exec");
+    for (int i = 0; i < ctx->group_count; i++) {
+        const struct sched_group* g = ctx->group[i];
+        const struct sched_group_status* s = &ctx->diagnostics.group[i];
+        shell_print(sh, "%-20s %4d %8d %8d %8d %10d %8d %8d %8d %9d %9d",
+            g->name, g->priority, g->period_us, g->deadline_us, g->wcet_us,
+            g->jobs, g->deadline_misses, g->missed_releases, g->budget_overruns,
+            s->max_response_us, s->max_exec_us);
+    }
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_sched,
+    SHELL_CMD(status, NULL, "rate groups, times in us, maxima over the last period", cmd_status),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(sched, &sub_sched, "rate group scheduler commands", NULL);
+#endif
+
+// vi: ts=4 sw=4 et
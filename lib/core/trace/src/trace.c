@@ -0,0 +1,183 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+
+#include <cerebri/core/trace.h>
+
+LOG_MODULE_REGISTER(core_trace, CONFIG_CEREBRI_CORE_TRACE_LOG_LEVEL);
+
+#define RING_DEPTH CONFIG_CEREBRI_CORE_TRACE_RING_DEPTH
+
+BUILD_ASSERT(IS_POWER_OF_TWO(RING_DEPTH), "trace ring depth must be a power of two");
+
+struct trace_event {
+    uint32_t seq;
+    uint32_t stage_cycles;
+    uint32_t total_cycles;
+    uint8_t stage;
+};
+
+/*
+ * One ring per cpu, written without locks. A slot is claimed with an
+ * atomic increment, so threads preempting each other on a cpu never
+ * share a slot, the reader may see an event being written which only
+ * affects one sample of the statistics.
+ */
+struct trace_ring {
+    struct trace_event event[RING_DEPTH];
+    atomic_t head;
+};
+
+static struct trace_ring g_ring[CONFIG_MP_MAX_NUM_CPUS];
+
+// latest origin of each traced topic
+static struct trace_origin g_origin[TRACE_TOPIC_COUNT];
+static struct k_spinlock g_origin_lock;
+
+static const char* g_stage_name[TRACE_STAGE_COUNT] = {
+    [TRACE_STAGE_SENSE] = "sense",
+    [TRACE_STAGE_ESTIMATE] = "estimate",
+    [TRACE_STAGE_POSITION] = "position",
+    [TRACE_STAGE_VELOCITY] = "velocity",
+    [TRACE_STAGE_ACTUATE] = "actuate",
+};
+
+static void record(struct trace_origin* origin, enum trace_stage stage)
+{
+    uint32_t now = k_cycle_get_32();
+    struct trace_ring* ring = &g_ring[arch_curr_cpu()->id];
+    atomic_val_t head = atomic_inc(&ring->head);
+    struct trace_event* e = &ring->event[head & (RING_DEPTH - 1)];
+    e->seq = origin->seq;
+    e->stage = stage;
+    e->stage_cycles = now - origin->cycle_last;
+    e->total_cycles = now - origin->cycle_origin;
+    origin->cycle_last = now;
+}
+
+void trace_sample(enum trace_topic topic, uint32_t seq, int64_t stamp_ticks)
+{
+    uint32_t now = k_cycle_get_32();
+
+    // back to the cycle counter at the stamp, a stamp ahead of now is
+    // taken as now, 0 marks a used up origin
+    int64_t age_ticks = k_uptime_ticks() - stamp_ticks;
+    uint32_t cycle_origin = now - (age_ticks > 0 ? k_ticks_to_cyc_floor32(age_ticks) : 0);
+    if (cycle_origin == 0) {
+        cycle_origin = 1;
+    }
+
+    struct trace_origin origin = {
+        .seq = seq,
+        .stamp_ticks = stamp_ticks,
+        .cycle_origin = cycle_origin,
+        .cycle_last = cycle_origin,
+    };
+    record(&origin, TRACE_STAGE_SENSE);
+
+    k_spinlock_key_t key = k_spin_lock(&g_origin_lock);
+    g_origin[topic] = origin;
+    k_spin_unlock(&g_origin_lock, key);
+}
+
+void trace_consume(enum trace_topic topic, struct trace_origin* origin)
+{
+    k_spinlock_key_t key = k_spin_lock(&g_origin_lock);
+    *origin = g_origin[topic];
+    k_spin_unlock(&g_origin_lock, key);
+}
+
+void trace_publish(enum trace_topic topic, struct trace_origin* origin, enum trace_stage stage)
+{
+    // no sample has reached this node yet
+    if (origin->cycle_origin == 0) {
+        return;
+    }
+    record(origin, stage);
+
+    k_spinlock_key_t key = k_spin_lock(&g_origin_lock);
+    g_origin[topic] = *origin;
+    k_spin_unlock(&g_origin_lock, key);
+
+    // each origin is handed on once, republishing stale data is not traced
+    origin->cycle_origin = 0;
+}
+
+void trace_point(struct trace_origin* origin, enum trace_stage stage)
+{
+    if (origin->cycle_origin == 0) {
+        return;
+    }
+    record(origin, stage);
+    origin->cycle_origin = 0;
+}
+
+static int compare_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_distribution(const struct shell* sh, const char* name,
+    uint32_t* cycles, size_t n)
+{
+    qsort(cycles, n, sizeof(cycles[0]), compare_u32);
+    shell_print(sh, "  %-8s p50 %8llu p99 %8llu max %8llu us", name,
+        k_cyc_to_us_near64(cycles[n / 2]),
+        k_cyc_to_us_near64(cycles[(n * 99) / 100]),
+        k_cyc_to_us_near64(cycles[n - 1]));
+}
+
+static int cmd_latency(const struct shell* sh, size_t argc, char** argv)
+{
+    // too large for the shell stack
+    static uint32_t stage_cycles[CONFIG_MP_MAX_NUM_CPUS * RING_DEPTH];
+    static uint32_t total_cycles[CONFIG_MP_MAX_NUM_CPUS * RING_DEPTH];
+
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        for (int cpu = 0; cpu < CONFIG_MP_MAX_NUM_CPUS; cpu++) {
+            atomic_set(&g_ring[cpu].head, 0);
+        }
+        return 0;
+    }
+
+    for (int stage = 0; stage < TRACE_STAGE_COUNT; stage++) {
+        size_t n = 0;
+        for (int cpu = 0; cpu < CONFIG_MP_MAX_NUM_CPUS; cpu++) {
+            struct trace_ring* ring = &g_ring[cpu];
+            size_t count = MIN(atomic_get(&ring->head), RING_DEPTH);
+            for (size_t i = 0; i < count; i++) {
+                const struct trace_event* e = &ring->event[i];
+                if (e->stage == stage) {
+                    stage_cycles[n] = e->stage_cycles;
+                    total_cycles[n] = e->total_cycles;
+                    n++;
+                }
+            }
+        }
+        shell_print(sh, "%s: %d samples", g_stage_name[stage], (int)n);
+        if (n == 0) {
+            continue;
+        }
+        print_distribution(sh, "stage", stage_cycles, n);
+        print_distribution(sh, "total", total_cycles, n);
+    }
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_trace,
+    SHELL_CMD_ARG(latency, NULL, "latency from sensor sample per stage [reset]", cmd_latency, 1, 1),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(trace, &sub_trace, "trace commands", NULL);
+
+// vi: ts=4 sw=4 et
@@ -2,31 +2,39 @@
  * Copyright CogniPilot Foundation 2023
  * SPDX-License-Identifier: Apache-2.0
  */
+#include <cmdline.h>
 #include <soc.h>
 
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <pb_decode.h>
 #include <synapse_tinyframe/SynapseTopics.h>
-#include <zephyr/sys/ring_buffer.h>
+
+#include <cerebri/core/instance.h>
 
 #include "sil_context.h"
 
-// mutex locking is not necessary, as this is single threaded
-// and all consumers can only run while this process is sleeping
+// messages are handed to the zephyr sim thread through the lock-free
+// rings in sil_ring.h, this thread is their only producer
 
-#define BIND_PORT 4241
 #define RX_BUF_SIZE 2048
 
-RING_BUF_DECLARE(g_msg_updates, 1024);
-
 void write_sim(TinyFrame* tf, const uint8_t* buf, uint32_t len);
 
+#define Z_SIL_RING_INIT(NAME, CLASS, TF_TYPE, SNPRINT, RATE_HZ, SIM) \
+    COND_CODE_1(SIM,                                                  \
+        ([SIL_TOPIC_##NAME] = SIL_RING_INIT(g_ctx.storage.NAME, SYNAPSE_TOPIC_ID_##NAME), ), ())
+#define Z_SIL_RING_INIT_ENTRY(entry) SYNAPSE_TOPIC_EXPAND(Z_SIL_RING_INIT, entry)
+
 sil_context_t g_ctx = {
     .module_name = "dream_sil_native",
     .serv = 0,
@@ -39,14 +47,15 @@ sil_context_t g_ctx = {
         .userdata = &g_ctx,
     },
     .sim_clock = synapse_msgs_SimClock_init_default,
-    .nav_sat_fix = synapse_msgs_NavSatFix_init_default,
-    .imu = synapse_msgs_Imu_init_default,
-    .magnetic_field = synapse_msgs_MagneticField_init_default,
-    .battery_state = synapse_msgs_BatteryState_init_default,
-    .altimeter = synapse_msgs_Altimeter_init_default,
-    .wheel_odometry = synapse_msgs_WheelOdometry_init_default,
+    .clock_seq = ATOMIC_INIT(0),
+    .ring = {
+        FOR_EACH(Z_SIL_RING_INIT_ENTRY, (), SYNAPSE_TOPIC_DICTIONARY())
+    },
 };
 
+// sil topic + 1 by tinyframe type, filled when listeners are added
+static uint8_t g_sim_topic_index[256];
+
 // public data
 void write_sim(TinyFrame* tf, const uint8_t* buf, uint32_t len)
 {
@@ -72,106 +81,108 @@ static TF_Result sim_clock_listener(TinyFrame* tf, TF_Msg* frame)
     if (rc) {
         g_ctx.sim_clock = msg;
         if (!g_ctx.clock_initialized) {
-            g_ctx.clock_initialized = true;
             printf("%s: sim clock received sec: %lld nsec: %d\n",
                 ctx->module_name, msg.sim.sec, msg.sim.nanosec);
             g_ctx.clock_offset.sec = msg.sim.sec;
             g_ctx.clock_offset.nanosec = msg.sim.nanosec;
+            g_ctx.clock_initialized = true;
         }
+        atomic_inc(&g_ctx.clock_seq);
     } else {
         printf("%s: sim_clock decoding failed: %s\n", ctx->module_name, PB_GET_ERROR(&stream));
     }
     return TF_STAY;
 }
 
-static TF_Result nav_sat_fix_listener(TinyFrame* tf, TF_Msg* frame)
+static TF_Result topic_listener(TinyFrame* tf, TF_Msg* frame)
 {
     sil_context_t* ctx = (sil_context_t*)tf->userdata;
-    synapse_msgs_NavSatFix msg = synapse_msgs_NavSatFix_init_default;
-    pb_istream_t stream = pb_istream_from_buffer(frame->data, frame->len);
-    int rc = pb_decode(&stream, synapse_msgs_NavSatFix_fields, &msg);
-    if (rc) {
-        g_ctx.nav_sat_fix = msg;
-        uint8_t topic = SYNAPSE_NAV_SAT_FIX_TOPIC;
-        ring_buf_put(&g_msg_updates, &topic, 1);
-    } else {
-        printf("%s: navsat decoding failed: %s\n",
-            ctx->module_name, PB_GET_ERROR(&stream));
-    }
-    return TF_STAY;
-}
+    struct sil_ring* ring = &ctx->ring[g_sim_topic_index[frame->type & 0xff] - 1];
+    const struct synapse_topic_info* info = &synapse_topic_registry[ring->topic_id];
 
-static TF_Result imu_listener(TinyFrame* tf, TF_Msg* frame)
-{
-    sil_context_t* ctx = (sil_context_t*)tf->userdata;
-    synapse_msgs_Imu msg = synapse_msgs_Imu_init_default;
+    // decode straight into the ring, dropped and counted if full
+    void* msg = sil_ring_reserve(ring);
+    if (msg == NULL) {
+        return TF_STAY;
+    }
     pb_istream_t stream = pb_istream_from_buffer(frame->data, frame->len);
-    int rc = pb_decode(&stream, synapse_msgs_Imu_fields, &msg);
+    int rc = pb_decode(&stream, info->fields, msg);
     if (rc) {
-        g_ctx.imu = msg;
-        uint8_t topic = SYNAPSE_IMU_TOPIC;
-        ring_buf_put(&g_msg_updates, &topic, 1);
+        sil_ring_commit(ring, ctx->seq++, ctx->rx_ns);
     } else {
-        printf("%s: imu decoding failed: %s\n",
-            ctx->module_name, PB_GET_ERROR(&stream));
+        printf("%s: %s decoding failed: %s\n",
+            ctx->module_name, info->name, PB_GET_ERROR(&stream));
     }
     return TF_STAY;
 }
 
-static TF_Result magnetic_field_listener(TinyFrame* tf, TF_Msg* frame)
+TF_Result generic_listener(TinyFrame* tf, TF_Msg* frame)
 {
-    sil_context_t* ctx = (sil_context_t*)tf->userdata;
-    synapse_msgs_MagneticField msg = synapse_msgs_MagneticField_init_default;
-    pb_istream_t stream = pb_istream_from_buffer(frame->data, frame->len);
-    int rc = pb_decode(&stream, synapse_msgs_MagneticField_fields, &msg);
-    if (rc) {
-        g_ctx.magnetic_field = msg;
-        uint8_t topic = SYNAPSE_MAGNETIC_FIELD_TOPIC;
-        ring_buf_put(&g_msg_updates, &topic, 1);
-    } else {
-        printf("%s: magnetic field decoding failed: %s\n",
-            ctx->module_name, PB_GET_ERROR(&stream));
-    }
     return TF_STAY;
 }
 
-static TF_Result battery_state_listener(TinyFrame* tf, TF_Msg* frame)
+uint64_t sil_native_time_ns(void)
 {
-    sil_context_t* ctx = (sil_context_t*)tf->userdata;
-    synapse_msgs_BatteryState msg = synapse_msgs_BatteryState_init_default;
-    pb_istream_t stream = pb_istream_from_buffer(frame->data, frame->len);
-    int rc = pb_decode(&stream, synapse_msgs_BatteryState_fields, &msg);
-    if (rc) {
-        g_ctx.battery_state = msg;
-        uint8_t topic = SYNAPSE_BATTERY_STATE_TOPIC;
-        ring_buf_put(&g_msg_updates, &topic, 1);
-    } else {
-        printf("%s: battery state decoding failed: %s\n",
-            ctx->module_name, PB_GET_ERROR(&stream));
-    }
-    return TF_STAY;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
-static TF_Result wheel_odometry_listener(TinyFrame* tf, TF_Msg* frame)
+void sil_native_wait(sil_context_t* ctx, int timeout_ms)
 {
-    sil_context_t* ctx = (sil_context_t*)tf->userdata;
-    synapse_msgs_WheelOdometry msg = synapse_msgs_WheelOdometry_init_default;
-    pb_istream_t stream = pb_istream_from_buffer(frame->data, frame->len);
-    int rc = pb_decode(&stream, synapse_msgs_WheelOdometry_fields, &msg);
-    if (rc) {
-        g_ctx.wheel_odometry = msg;
-        uint8_t topic = SYNAPSE_WHEEL_ODOMETRY_TOPIC;
-        ring_buf_put(&g_msg_updates, &topic, 1);
-    } else {
-        printf("%s: wheel odometry decoding failed: %s\n",
-            ctx->module_name, PB_GET_ERROR(&stream));
+#if defined(CONFIG_CEREBRI_DREAM_SIL_POLL_SLEEP)
+    struct timespec request = { .tv_sec = 0, .tv_nsec = timeout_ms * 1000000L };
+    nanosleep(&request, NULL);
+#else
+    struct pollfd pfd = { .fd = ctx->event_fd, .events = POLLIN };
+    if (poll(&pfd, 1, timeout_ms) > 0) {
+        eventfd_t count;
+        eventfd_read(ctx->event_fd, &count);
     }
-    return TF_STAY;
+#endif
 }
 
-TF_Result generic_listener(TinyFrame* tf, TF_Msg* frame)
+// receive from client until it disconnects or shutdown
+static void receive_client(sil_context_t* ctx)
 {
-    return TF_STAY;
+    uint8_t data[RX_BUF_SIZE];
+    while (!ctx->shutdown) {
+#if defined(CONFIG_CEREBRI_DREAM_SIL_POLL_SLEEP)
+        struct timespec request = { .tv_sec = 0, .tv_nsec = 1000000 }; // 1 ms
+        nanosleep(&request, NULL);
+#else
+        // wake on data, or periodically to check for shutdown
+        struct pollfd pfd = { .fd = ctx->client, .events = POLLIN };
+        int rc = poll(&pfd, 1, 100);
+        if (rc < 0 && errno != EINTR) {
+            printf("%s: poll failed: %d\n", ctx->module_name, errno);
+            return;
+        } else if (rc <= 0) {
+            continue;
+        }
+#endif
+        int len = recv(ctx->client, data, RX_BUF_SIZE, 0);
+        if (len == 0) {
+            printf("%s: client disconnected\n", ctx->module_name);
+            return;
+        } else if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                continue;
+            }
+            printf("%s: recv failed: %d\n", ctx->module_name, errno);
+            return;
+        }
+
+        ctx->rx_ns = sil_native_time_ns();
+        uint32_t seq = ctx->seq;
+        atomic_val_t clock_seq = atomic_get(&ctx->clock_seq);
+        TF_Accept(&ctx->tf, data, len);
+
+        // wake the zephyr sim thread
+        if (ctx->seq != seq || atomic_get(&ctx->clock_seq) != clock_seq) {
+            eventfd_write(ctx->event_fd, 1);
+        }
+    }
 }
 
 void* native_sim_entry_point(void* p0)
@@ -182,11 +193,11 @@ void* native_sim_entry_point(void* p0)
     // setup tinyframe
     TF_AddGenericListener(&ctx->tf, generic_listener);
     TF_AddTypeListener(&ctx->tf, SYNAPSE_SIM_CLOCK_TOPIC, sim_clock_listener);
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_NAV_SAT_FIX_TOPIC, nav_sat_fix_listener);
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_IMU_TOPIC, imu_listener);
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_MAGNETIC_FIELD_TOPIC, magnetic_field_listener);
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_BATTERY_STATE_TOPIC, battery_state_listener);
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_WHEEL_ODOMETRY_TOPIC, wheel_odometry_listener);
+    for (int i = 0; i < SIL_TOPIC_COUNT; i++) {
+        int tf_type = synapse_topic_registry[ctx->ring[i].topic_id].tf_type;
+        g_sim_topic_index[tf_type] = i + 1;
+        TF_AddTypeListener(&ctx->tf, tf_type, topic_listener);
+    }
 
     struct sockaddr_in bind_addr;
     static int counter;
@@ -211,7 +222,7 @@ void* native_sim_entry_point(void* p0)
 
     bind_addr.sin_family = AF_INET;
     bind_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    bind_addr.sin_port = htons(BIND_PORT);
+    bind_addr.sin_port = htons(cerebri_instance_port(CEREBRI_PORT_SIL));
 
     if (bind(ctx->serv, (struct sockaddr*)&bind_addr, sizeof(bind_addr)) < 0) {
         printf("%s: bind() failed: %d\n", ctx->module_name, errno);
@@ -223,9 +234,8 @@ void* native_sim_entry_point(void* p0)
         exit(1);
     }
 
-    printf("%s: listening to server on port: %d\n", ctx->module_name, BIND_PORT);
-
-    struct timespec remaining, request;
+    printf("%s: instance %d listening to server on port: %d\n", ctx->module_name,
+        g_cerebri_instance.id, cerebri_instance_port(CEREBRI_PORT_SIL));
 
     printf("%s: waiting for client connection\n", ctx->module_name);
 
@@ -235,36 +245,29 @@ void* native_sim_entry_point(void* p0)
     sigaction(SIGINT, &action, NULL);
 
     while (!ctx->shutdown) {
+        // wait for connection, waking periodically to check for shutdown
+        struct pollfd pfd = { .fd = ctx->serv, .events = POLLIN };
+        if (poll(&pfd, 1, 1000) <= 0) {
+            continue;
+        }
+
         struct sockaddr_in client_addr;
         socklen_t client_addr_len = sizeof(client_addr);
         char addr_str[32];
         ctx->client = accept(ctx->serv, (struct sockaddr*)&client_addr,
             &client_addr_len);
-        fcntl(ctx->client, F_SETFL, O_NONBLOCK);
-
         if (ctx->client < 0) {
-            request.tv_sec = 1;
-            request.tv_nsec = 0;
-            nanosleep(&request, &remaining);
             continue;
         }
+        fcntl(ctx->client, F_SETFL, O_NONBLOCK);
 
         inet_ntop(client_addr.sin_family, &client_addr.sin_addr,
             addr_str, sizeof(addr_str));
         printf("%s: connection #%d from %s\n", ctx->module_name, counter++, addr_str);
 
         // process incoming messages
-        while (!ctx->shutdown) {
-            // write received data to sim_rx_buf
-            uint8_t data[RX_BUF_SIZE];
-            int len = recv(ctx->client, data, RX_BUF_SIZE, 0);
-            if (len > 0) {
-                TF_Accept(&ctx->tf, data, len);
-            }
-            request.tv_sec = 0;
-            request.tv_nsec = 1000000; // 1 ms
-            nanosleep(&request, &remaining);
-        }
+        receive_client(ctx);
+        close(ctx->client);
     }
 
     printf("native main exitting\n");
@@ -272,9 +275,52 @@ void* native_sim_entry_point(void* p0)
     return 0;
 }
 
+static void native_sim_add_options(void)
+{
+    static struct args_struct_t options[] = {
+        {
+            .option = "instance",
+            .name = "id",
+            .type = 'i',
+            .dest = (void*)&g_cerebri_instance.id,
+            .descript = "Vehicle instance id, offsets all ports so several "
+                        "instances can run on one host",
+        },
+        {
+            .option = "port_base",
+            .name = "port",
+            .type = 'i',
+            .dest = (void*)&g_cerebri_instance.port_base,
+            .descript = "Base of the ports used by the instance, sim port is "
+                        "base + 1 and synapse port base + 2",
+        },
+        {
+            .option = "peer",
+            .name = "ipv4",
+            .type = 's',
+            .dest = (void*)&g_cerebri_instance.peer_ipv4,
+            .descript = "Address of the synapse peer",
+        },
+        {
+            .option = "addr",
+            .name = "ipv4",
+            .type = 's',
+            .dest = (void*)&g_cerebri_instance.my_ipv4,
+            .descript = "Address of this instance, replaces the configured address",
+        },
+        ARG_TABLE_ENDMARKER,
+    };
+    native_add_command_line_opts(options);
+}
+
 void native_sim_start_task(void)
 {
     printf("native sim start task\n");
+    g_ctx.event_fd = eventfd(0, EFD_NONBLOCK);
+    if (g_ctx.event_fd < 0) {
+        printf("%s: eventfd failed: %d\n", g_ctx.module_name, errno);
+        exit(1);
+    }
     pthread_create(&g_ctx.thread, NULL, native_sim_entry_point, &g_ctx);
 }
 
@@ -285,7 +331,9 @@ void native_sim_stop_task(void)
 }
 
 // native tasks
-NATIVE_TASK(native_sim_start_task, PRE_BOOT_1, 0);
+// options are parsed between PRE_BOOT_1 and PRE_BOOT_2
+NATIVE_TASK(native_sim_add_options, PRE_BOOT_1, 0);
+NATIVE_TASK(native_sim_start_task, PRE_BOOT_2, 0);
 NATIVE_TASK(native_sim_stop_task, ON_EXIT_PRE, 1);
 
 // vi: ts=4 sw=4 et
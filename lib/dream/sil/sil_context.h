@@ -9,13 +9,30 @@
 
 #include <synapse_tinyframe/TinyFrame.h>
 
-#include <synapse_protobuf/altimeter.pb.h>
-#include <synapse_protobuf/battery_state.pb.h>
-#include <synapse_protobuf/imu.pb.h>
-#include <synapse_protobuf/magnetic_field.pb.h>
-#include <synapse_protobuf/nav_sat_fix.pb.h>
 #include <synapse_protobuf/sim_clock.pb.h>
-#include <synapse_protobuf/wheel_odometry.pb.h>
+#include <synapse_topic_list.h>
+
+#include "sil_ring.h"
+
+// topics received from the simulator, the sim input topics of the
+// topic dictionary in synapse_topic_list.h
+#define Z_SIL_TOPIC_ID(NAME, CLASS, TF_TYPE, SNPRINT, RATE_HZ, SIM) \
+    COND_CODE_1(SIM, (SIL_TOPIC_##NAME, ), ())
+#define Z_SIL_TOPIC_ID_ENTRY(entry) SYNAPSE_TOPIC_EXPAND(Z_SIL_TOPIC_ID, entry)
+
+#define Z_SIL_TOPIC_STORAGE(NAME, CLASS, TF_TYPE, SNPRINT, RATE_HZ, SIM) \
+    COND_CODE_1(SIM, (CLASS NAME[SIL_RING_DEPTH];), ())
+#define Z_SIL_TOPIC_STORAGE_ENTRY(entry) SYNAPSE_TOPIC_EXPAND(Z_SIL_TOPIC_STORAGE, entry)
+
+enum sil_topic {
+    FOR_EACH(Z_SIL_TOPIC_ID_ENTRY, (), SYNAPSE_TOPIC_DICTIONARY())
+    SIL_TOPIC_COUNT,
+};
+
+// typed ring storage for each topic
+struct sil_topic_storage {
+    FOR_EACH(Z_SIL_TOPIC_STORAGE_ENTRY, (), SYNAPSE_TOPIC_DICTIONARY())
+};
 
 typedef struct context_s {
     const char* module_name;
@@ -27,13 +44,28 @@ typedef struct context_s {
     TinyFrame tf;
     synapse_msgs_SimClock sim_clock;
     synapse_msgs_Time clock_offset;
-    synapse_msgs_NavSatFix nav_sat_fix;
-    synapse_msgs_Imu imu;
-    synapse_msgs_MagneticField magnetic_field;
-    synapse_msgs_BatteryState battery_state;
-    synapse_msgs_Altimeter altimeter;
-    synapse_msgs_WheelOdometry wheel_odometry;
+    // incremented by the native thread for each SimClock received
+    atomic_t clock_seq;
+    // messages received from the simulator, producer is the native
+    // thread, consumer the zephyr sim thread
+    struct sil_ring ring[SIL_TOPIC_COUNT];
+    struct sil_topic_storage storage;
+    // arrival order, only written by the native thread
+    uint32_t seq;
+    // host time the frames being decoded were received, ns
+    uint64_t rx_ns;
+    // signalled by the native thread when messages are ready
+    int event_fd;
 } sil_context_t;
 
+/********************************************************************
+ * host side helpers, implemented in native_main.c
+ ********************************************************************/
+// host monotonic time, ns
+uint64_t sil_native_time_ns(void);
+
+// block until the native thread signals new messages, or timeout
+void sil_native_wait(sil_context_t* ctx, int timeout_ms);
+
 #endif // CEREBRI_DREAM_SIL_H
 // vi: ts=4 sw=4 et
@@ -0,0 +1,124 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_DREAM_SIL_RING_H
+#define CEREBRI_DREAM_SIL_RING_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+/*
+ * Lock-free single producer, single consumer ring of full messages.
+ *
+ * The native socket thread is the only producer and the zephyr sim
+ * thread the only consumer. Head is only written by the producer and
+ * tail only by the consumer, the sequentially consistent atomics order
+ * the slot contents against the index updates. When the ring is full
+ * the newest sample is dropped and counted, the producer never touches
+ * a slot the consumer may be reading.
+ */
+
+#define SIL_RING_DEPTH CONFIG_CEREBRI_DREAM_SIL_RING_DEPTH
+
+BUILD_ASSERT(IS_POWER_OF_TWO(SIL_RING_DEPTH), "sil ring depth must be a power of two");
+
+struct sil_ring {
+    // message storage, SIL_RING_DEPTH messages of msg_size
+    uint8_t* buf;
+    size_t msg_size;
+    int topic_id;
+    // arrival order of each slot, across all rings
+    uint32_t seq[SIL_RING_DEPTH];
+    // host receive time of each slot, ns
+    uint64_t stamp_ns[SIL_RING_DEPTH];
+    atomic_t head;
+    atomic_t tail;
+    // statistics
+    atomic_t dropped;
+    atomic_t high_water;
+};
+
+#define SIL_RING_INIT(BUF, TOPIC_ID)           \
+    {                                          \
+        .buf = (uint8_t*)(BUF),                \
+        .msg_size = sizeof((BUF)[0]),          \
+        .topic_id = TOPIC_ID,                  \
+        .head = ATOMIC_INIT(0),                \
+        .tail = ATOMIC_INIT(0),                \
+        .dropped = ATOMIC_INIT(0),             \
+        .high_water = ATOMIC_INIT(0),          \
+    }
+
+static inline void* sil_ring_slot(struct sil_ring* r, atomic_val_t index)
+{
+    return &r->buf[(index & (SIL_RING_DEPTH - 1)) * r->msg_size];
+}
+
+/*
+ * Producer: get the next free slot to decode into, returns NULL and
+ * counts a drop if the ring is full
+ */
+static inline void* sil_ring_reserve(struct sil_ring* r)
+{
+    atomic_val_t head = atomic_get(&r->head);
+    if (head - atomic_get(&r->tail) >= SIL_RING_DEPTH) {
+        atomic_inc(&r->dropped);
+        return NULL;
+    }
+    void* slot = sil_ring_slot(r, head);
+    memset(slot, 0, r->msg_size);
+    return slot;
+}
+
+/*
+ * Producer: publish the reserved slot to the consumer
+ */
+static inline void sil_ring_commit(struct sil_ring* r, uint32_t seq, uint64_t stamp_ns)
+{
+    atomic_val_t head = atomic_get(&r->head);
+    r->seq[head & (SIL_RING_DEPTH - 1)] = seq;
+    r->stamp_ns[head & (SIL_RING_DEPTH - 1)] = stamp_ns;
+    atomic_set(&r->head, head + 1);
+
+    atomic_val_t level = head + 1 - atomic_get(&r->tail);
+    if (level > atomic_get(&r->high_water)) {
+        atomic_set(&r->high_water, level);
+    }
+}
+
+/*
+ * Consumer: get the oldest message and its sequence number,
+ * returns NULL if the ring is empty
+ */
+static inline void* sil_ring_peek(struct sil_ring* r, uint32_t* seq)
+{
+    atomic_val_t tail = atomic_get(&r->tail);
+    if (tail == atomic_get(&r->head)) {
+        return NULL;
+    }
+    *seq = r->seq[tail & (SIL_RING_DEPTH - 1)];
+    return sil_ring_slot(r, tail);
+}
+
+/*
+ * Consumer: host receive time of the message returned by peek
+ */
+static inline uint64_t sil_ring_stamp_ns(struct sil_ring* r)
+{
+    return r->stamp_ns[atomic_get(&r->tail) & (SIL_RING_DEPTH - 1)];
+}
+
+/*
+ * Consumer: release the message returned by peek
+ */
+static inline void sil_ring_release(struct sil_ring* r)
+{
+    atomic_set(&r->tail, atomic_get(&r->tail) + 1);
+}
+
+#endif // CEREBRI_DREAM_SIL_RING_H
+// vi: ts=4 sw=4 et
@@ -2,8 +2,11 @@
  * Copyright CogniPilot Foundation 2023
  * SPDX-License-Identifier: Apache-2.0 */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <zephyr/logging/log.h>
-#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/shell/shell.h>
 
 #include <synapse_tinyframe/SynapseTopics.h>
 #include <synapse_tinyframe/TinyFrame.h>
@@ -28,15 +31,122 @@ LOG_MODULE_REGISTER(dream_sil, CONFIG_CEREBRI_DREAM_SIL_LOG_LEVEL);
 #define MY_PRIORITY -10
 
 extern sil_context_t g_ctx;
-extern struct ring_buf g_msg_updates;
 static K_THREAD_STACK_DEFINE(my_stack_area, MY_STACK_SIZE);
 static struct k_thread my_thread_data;
 
+// host latency from socket receive to zros publish, us
+#define LATENCY_SAMPLES 1024
+static uint32_t g_latency_us[LATENCY_SAMPLES];
+static atomic_t g_latency_count = ATOMIC_INIT(0);
+
+static void record_latency(uint64_t stamp_ns)
+{
+    uint64_t now_ns = sil_native_time_ns();
+    atomic_val_t n = atomic_inc(&g_latency_count);
+    g_latency_us[n % LATENCY_SAMPLES] = (uint32_t)((now_ns - stamp_ns) / 1000);
+}
+
+// publish every message received from the simulator, in arrival order
+static void publish_sim_messages(sil_context_t* ctx)
+{
+    while (true) {
+        struct sil_ring* next = NULL;
+        void* next_msg = NULL;
+        uint32_t next_seq = 0;
+        for (int i = 0; i < SIL_TOPIC_COUNT; i++) {
+            uint32_t seq = 0;
+            void* msg = sil_ring_peek(&ctx->ring[i], &seq);
+            if (msg != NULL && (next == NULL || (int32_t)(seq - next_seq) < 0)) {
+                next = &ctx->ring[i];
+                next_msg = msg;
+                next_seq = seq;
+            }
+        }
+        if (next == NULL) {
+            return;
+        }
+        zros_topic_publish(synapse_topic_registry[next->topic_id].topic, next_msg);
+        record_latency(sil_ring_stamp_ns(next));
+        sil_ring_release(next);
+    }
+}
+
+static void send_actuators(sil_context_t* ctx, const synapse_msgs_Actuators* actuators)
+{
+    TF_Msg msg;
+    TF_ClearMsg(&msg);
+    uint8_t buf[synapse_msgs_Actuators_size];
+    pb_ostream_t stream = pb_ostream_from_buffer((pu8)buf, sizeof(buf));
+    int status = pb_encode(&stream, synapse_msgs_Actuators_fields, actuators);
+    if (status) {
+        msg.type = SYNAPSE_ACTUATORS_TOPIC;
+        msg.data = buf;
+        msg.len = stream.bytes_written;
+        TF_Send(&ctx->tf, &msg);
+    } else {
+        LOG_ERR("encoding failed: %s", PB_GET_ERROR(&stream));
+    }
+}
+
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+/*
+ * Lockstep mode, the kernel clock only advances when the simulator
+ * sends a SimClock. The simulator is expected to send the sensor
+ * topics of a step followed by the SimClock of that step, and to wait
+ * for the actuators before stepping again. While waiting for the
+ * simulator this thread blocks on the host, which freezes the
+ * simulated cpu and kernel clock, so a run does not depend on host
+ * scheduling and is as fast as the simulator allows.
+ */
+static void run_ready_threads(void)
+{
+    // drop to the lowest priority and yield, we only get the cpu back
+    // once every other ready thread has run at this tick
+    k_tid_t tid = k_current_get();
+    k_thread_priority_set(tid, K_LOWEST_APPLICATION_THREAD_PRIO);
+    k_yield();
+    k_thread_priority_set(tid, MY_PRIORITY);
+}
+
+static void run_lockstep(sil_context_t* ctx, struct zros_sub* sub_actuators,
+    synapse_msgs_Actuators* actuators)
+{
+    // the step of the first SimClock is still waiting for a reply
+    atomic_val_t clock_seq = 0;
+    while (!ctx->shutdown) {
+        // wait for the next step, checking periodically for shutdown
+        if (atomic_get(&ctx->clock_seq) == clock_seq) {
+            sil_native_wait(ctx, 100);
+            continue;
+        }
+        clock_seq = atomic_get(&ctx->clock_seq);
+
+        // sensor data of this step
+        publish_sim_messages(ctx);
+
+        // advance kernel clock to sim time, board time is uptime + clock offset
+        int64_t target_ns = (ctx->sim_clock.sim.sec - ctx->clock_offset.sec) * 1000000000LL
+            + (ctx->sim_clock.sim.nanosec - ctx->clock_offset.nanosec);
+        k_ticks_t target = k_ns_to_ticks_floor64(target_ns);
+        if (target > k_uptime_ticks()) {
+            k_sleep(K_TIMEOUT_ABS_TICKS(target));
+        }
+        run_ready_threads();
+
+        // always reply, the actuators acknowledge the step
+        if (zros_sub_update_available(sub_actuators)) {
+            zros_sub_update(sub_actuators);
+        }
+        send_actuators(ctx, actuators);
+    }
+}
+#endif
+
 static void zephyr_sim_entry_point(void* p0, void* p1, void* p2)
 {
     struct zros_node node;
     struct zros_sub sub_actuators;
-    synapse_msgs_Actuators actuators;
+    synapse_msgs_Actuators actuators = synapse_msgs_Actuators_init_default;
 
     zros_node_init(&node, "dream_sil");
     zros_sub_init(&sub_actuators, &node, &topic_actuators, &actuators, 10);
@@ -49,10 +159,15 @@ static void zephyr_sim_entry_point(void* p0, void* p1, void* p2)
     while (!ctx->shutdown) {
         // if clock not initialized, wait 1 second
         synapse_msgs_SimClock sim_clock;
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+        // keep the kernel clock frozen until the simulator starts
+        sil_native_wait(ctx, 100);
+#else
         struct timespec request, remaining;
         request.tv_sec = 1;
         request.tv_nsec = 0;
         nanosleep(&request, &remaining);
+#endif
         sim_clock = ctx->sim_clock;
         if (ctx->clock_initialized) {
             LOG_DBG("sim clock initialized");
@@ -61,44 +176,20 @@ static void zephyr_sim_entry_point(void* p0, void* p1, void* p2)
         }
     }
 
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+    LOG_DBG("running lockstep loop");
+    run_lockstep(ctx, &sub_actuators, &actuators);
+#else
     LOG_DBG("running main loop");
     while (!ctx->shutdown) {
 
         //  publish new messages
-        uint8_t topic;
-        while (!ring_buf_is_empty(&g_msg_updates)) {
-            ring_buf_get(&g_msg_updates, &topic, 1);
-            if (topic == SYNAPSE_NAV_SAT_FIX_TOPIC) {
-                zros_topic_publish(&topic_nav_sat_fix, &ctx->nav_sat_fix);
-            } else if (topic == SYNAPSE_MAGNETIC_FIELD_TOPIC) {
-                zros_topic_publish(&topic_magnetic_field, &ctx->magnetic_field);
-            } else if (topic == SYNAPSE_IMU_TOPIC) {
-                zros_topic_publish(&topic_imu, &ctx->imu);
-            } else if (topic == SYNAPSE_ALTIMETER_TOPIC) {
-                zros_topic_publish(&topic_altimeter, &ctx->altimeter);
-            } else if (topic == SYNAPSE_BATTERY_STATE_TOPIC) {
-                zros_topic_publish(&topic_battery_state, &ctx->battery_state);
-            } else if (topic == SYNAPSE_WHEEL_ODOMETRY_TOPIC) {
-                zros_topic_publish(&topic_wheel_odometry, &ctx->wheel_odometry);
-            }
-        }
+        publish_sim_messages(ctx);
 
         // send actuators if subscription updated
         if (zros_sub_update_available(&sub_actuators)) {
             zros_sub_update(&sub_actuators);
-            TF_Msg msg;
-            TF_ClearMsg(&msg);
-            uint8_t buf[synapse_msgs_Actuators_size];
-            pb_ostream_t stream = pb_ostream_from_buffer((pu8)buf, sizeof(buf));
-            int status = pb_encode(&stream, synapse_msgs_Actuators_fields, &actuators);
-            if (status) {
-                msg.type = SYNAPSE_ACTUATORS_TOPIC;
-                msg.data = buf;
-                msg.len = stream.bytes_written;
-                TF_Send(&ctx->tf, &msg);
-            } else {
-                LOG_ERR("encoding failed: %s", PB_GET_ERROR(&stream));
-            }
+            send_actuators(ctx, &actuators);
         }
 
         // compute board time
@@ -123,12 +214,13 @@ static void zephyr_sim_entry_point(void* p0, void* p1, void* p2)
             LOG_DBG("wait: msec %lld\n", wait_msec);
             k_msleep(wait_msec);
         } else {
-            struct timespec request, remaining;
-            request.tv_sec = 0;
-            request.tv_nsec = 1000000;
-            nanosleep(&request, &remaining);
+            // board is ahead of the sim, block until the native thread
+            // hands over new messages, this stalls the simulated cpu which
+            // is what we want while waiting for the sim to catch up
+            sil_native_wait(ctx, 1);
         }
     }
+#endif
     printf("zephyr main loop finished\n");
 }
 
@@ -144,6 +236,57 @@ static int start()
     return 0;
 }
 
+static int cmd_stats(const struct shell* sh, size_t argc, char** argv)
+{
+    shell_print(sh, "%-20s %6s %8s %10s", "topic", "level", "dropped", "high water");
+    for (int i = 0; i < SIL_TOPIC_COUNT; i++) {
+        struct sil_ring* ring = &g_ctx.ring[i];
+        shell_print(sh, "%-20s %6d %8d %10d/%d",
+            synapse_topic_registry[ring->topic_id].name,
+            (int)(atomic_get(&ring->head) - atomic_get(&ring->tail)),
+            (int)atomic_get(&ring->dropped),
+            (int)atomic_get(&ring->high_water), SIL_RING_DEPTH);
+    }
+    return 0;
+}
+
+static int compare_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int cmd_latency(const struct shell* sh, size_t argc, char** argv)
+{
+    static uint32_t sorted[LATENCY_SAMPLES];
+    atomic_val_t total = atomic_get(&g_latency_count);
+    size_t n = MIN((size_t)total, LATENCY_SAMPLES);
+    if (n == 0) {
+        shell_print(sh, "no samples");
+        return 0;
+    }
+    memcpy(sorted, g_latency_us, n * sizeof(sorted[0]));
+    qsort(sorted, n, sizeof(sorted[0]), compare_u32);
+    shell_print(sh, "mode: %s",
+        IS_ENABLED(CONFIG_CEREBRI_DREAM_SIL_POLL_SLEEP) ? "sleep poll" : "event");
+    shell_print(sh, "samples: %d of %d", (int)n, (int)total);
+    shell_print(sh, "median: %d us", sorted[n / 2]);
+    shell_print(sh, "p99: %d us", sorted[(n * 99) / 100]);
+    shell_print(sh, "max: %d us", sorted[n - 1]);
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        atomic_set(&g_latency_count, 0);
+    }
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_dream_sil,
+    SHELL_CMD(stats, NULL, "sim message ring statistics", cmd_stats),
+    SHELL_CMD_ARG(latency, NULL, "receive to publish latency [reset]", cmd_latency, 1, 1),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(dream_sil, &sub_dream_sil, "dream sil commands", NULL);
+
 SYS_INIT(start, POST_KERNEL, 0);
 
 // vi: ts=4 sw=4 et
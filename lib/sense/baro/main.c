@@ -39,7 +39,7 @@ typedef struct context_t {
     // devices
     const struct device* baro_dev[CONFIG_CEREBRI_SENSE_BARO_COUNT];
     // raw readings
-    double baro_raw[CONFIG_CEREBRI_SENSE_BARO_COUNT];
+    float baro_raw[CONFIG_CEREBRI_SENSE_BARO_COUNT];
 } context_t;
 
 static context_t g_ctx = {
@@ -83,7 +83,7 @@ static const struct device* sensor_check(const struct device* const dev)
 void baro_work_handler(struct k_work* work_item)
 {
     context_t* ctx = CONTAINER_OF(work_item, context_t, work_item);
-    double baro_data_array[CONFIG_CEREBRI_SENSE_BARO_COUNT][2] = {};
+    float baro_data_array[CONFIG_CEREBRI_SENSE_BARO_COUNT][2] = {};
     for (int i = 0; i < CONFIG_CEREBRI_SENSE_BARO_COUNT; i++) {
         // default all data to zero
         struct sensor_value baro_press = {};
@@ -99,16 +99,16 @@ void baro_work_handler(struct k_work* work_item)
                 baro_temp.val1, baro_temp.val2);
         }
 
-        baro_data_array[i][0] = baro_press.val1 + baro_press.val2 * 1e-6;
-        baro_data_array[i][1] = baro_temp.val1 + baro_temp.val2 * 1e-6;
+        baro_data_array[i][0] = sensor_value_to_float(&baro_press);
+        baro_data_array[i][1] = sensor_value_to_float(&baro_temp);
     }
 
     // select first baro for data for now: TODO implement voting
     // TODO add barmetric formula equation
-    double press = baro_data_array[0][0];
-    double temp = 15.0; // standard atmosphere temp in C
-    const float sea_press = 101.325;
-    double alt = ((pow((sea_press / press), 1 / 5.257) - 1.0) * (temp + 273.15)) / 0.0065;
+    float press = baro_data_array[0][0];
+    float temp = 15.0f; // standard atmosphere temp in C
+    const float sea_press = 101.325f;
+    float alt = ((powf((sea_press / press), 1 / 5.257f) - 1.0f) * (temp + 273.15f)) / 0.0065f;
     // LOG_DBG("press %10.4f, temp: %10.4f, alt: %10.4f", press, temp, alt);
 
     // publish altimeter
@@ -139,10 +139,12 @@ int sense_baro_entry_point(void* p0, void* p1, void* p2)
     ctx->baro_dev[0] = sensor_check(DEVICE_DT_GET(DT_ALIAS(baro0)));
 #if CONFIG_CEREBRI_SENSE_BARO_COUNT >= 2
     ctx->baro_dev[1] = sensor_check(DEVICE_DT_GET(DT_ALIAS(baro1)));
-#elif CONFIG_CEREBRI_SENSE_BARO_COUNT >= 3
+#endif
+#if CONFIG_CEREBRI_SENSE_BARO_COUNT >= 3
     ctx->baro_dev[2] = sensor_check(DEVICE_DT_GET(DT_ALIAS(baro2)));
-#elif CONFIG_CEREBRI_SENSE_BARO_COUNT == 4
-    ctrx->baro_dev[3] = sensor_check(DEVICE_DT_GET(DT_ALIAS(baro3)));
+#endif
+#if CONFIG_CEREBRI_SENSE_BARO_COUNT == 4
+    ctx->baro_dev[3] = sensor_check(DEVICE_DT_GET(DT_ALIAS(baro3)));
 #endif
 
     k_timer_start(&baro_timer, K_MSEC(100), K_MSEC(100));
@@ -0,0 +1,69 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+
+#include "delta.h"
+
+static void cross_add(float r[3], float k, const float a[3], const float b[3])
+{
+    r[0] += k * (a[1] * b[2] - a[2] * b[1]);
+    r[1] += k * (a[2] * b[0] - a[0] * b[2]);
+    r[2] += k * (a[0] * b[1] - a[1] * b[0]);
+}
+
+void imu_delta_reset(struct imu_delta_integrator* d)
+{
+    memset(d->alpha, 0, sizeof(d->alpha));
+    memset(d->v, 0, sizeof(d->v));
+    memset(d->beta, 0, sizeof(d->beta));
+    memset(d->gamma, 0, sizeof(d->gamma));
+    d->dt = 0;
+    d->samples = 0;
+}
+
+void imu_delta_add(struct imu_delta_integrator* d, const float omega[3],
+    const float accel[3], float dt)
+{
+    float dtheta[3];
+    float dv[3];
+    float alpha_c[3];
+    float v_c[3];
+
+    for (int i = 0; i < 3; i++) {
+        dtheta[i] = omega[i] * dt;
+        dv[i] = accel[i] * dt;
+        alpha_c[i] = d->alpha[i] + d->dtheta_last[i] / 6.0f;
+        v_c[i] = d->v[i] + d->dv_last[i] / 6.0f;
+    }
+
+    // coning
+    cross_add(d->beta, 0.5f, alpha_c, dtheta);
+
+    // sculling
+    cross_add(d->gamma, 0.5f, alpha_c, dv);
+    cross_add(d->gamma, 0.5f, v_c, dtheta);
+
+    for (int i = 0; i < 3; i++) {
+        d->alpha[i] += dtheta[i];
+        d->v[i] += dv[i];
+        d->dtheta_last[i] = dtheta[i];
+        d->dv_last[i] = dv[i];
+    }
+    d->dt += dt;
+    d->samples++;
+}
+
+void imu_delta_get(const struct imu_delta_integrator* d,
+    float delta_angle[3], float delta_velocity[3])
+{
+    for (int i = 0; i < 3; i++) {
+        delta_angle[i] = d->alpha[i] + d->beta[i];
+        delta_velocity[i] = d->v[i] + d->gamma[i];
+    }
+    // rotation compensation
+    cross_add(delta_velocity, 0.5f, d->alpha, d->v);
+}
+
+// vi: ts=4 sw=4 et
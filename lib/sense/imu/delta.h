@@ -0,0 +1,49 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SENSE_IMU_DELTA_H
+#define CEREBRI_SENSE_IMU_DELTA_H
+
+#include <stdint.h>
+
+/*
+ * Integration of high rate gyro and accel samples into a delta angle and
+ * a delta velocity over a publish interval, with the two sample coning
+ * and sculling corrections of Savage, Strapdown Inertial Navigation
+ * Integration Algorithm Design, 1998.
+ *
+ * The delta angle is the rotation vector from the body frame at the
+ * start of the interval to the one at its end. The delta velocity is in
+ * the body frame at the start of the interval, it includes the rotation
+ * compensation of the specific force.
+ */
+
+struct imu_delta_integrator {
+    // sums of the delta angles and velocities of the samples
+    float alpha[3];
+    float v[3];
+    // coning and sculling corrections
+    float beta[3];
+    float gamma[3];
+    // last sample, kept across intervals by the two sample corrections
+    float dtheta_last[3];
+    float dv_last[3];
+    float dt;
+    uint32_t samples;
+};
+
+// start a new interval
+void imu_delta_reset(struct imu_delta_integrator* d);
+
+// integrate a sample of angular velocity, rad/s, and specific force,
+// m/s^2, held for dt seconds
+void imu_delta_add(struct imu_delta_integrator* d, const float omega[3],
+    const float accel[3], float dt);
+
+// delta angle, rad, and delta velocity, m/s, of the interval
+void imu_delta_get(const struct imu_delta_integrator* d,
+    float delta_angle[3], float delta_velocity[3]);
+
+#endif // CEREBRI_SENSE_IMU_DELTA_H
+// vi: ts=4 sw=4 et
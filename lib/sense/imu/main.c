@@ -6,31 +6,79 @@
 #include <sys/types.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
+#include <zephyr/init.h>
 #include <zephyr/logging/log.h>
 
 #include <cerebri/core/common.h>
+#include <cerebri/core/trace.h>
+#include <cerebri/sense/imu.h>
 
 #include <synapse_topic_list.h>
 
 #include <zros/private/zros_node_struct.h>
 #include <zros/private/zros_pub_struct.h>
 #include <zros/private/zros_sub_struct.h>
+#include <zros/private/zros_topic_struct.h>
+#include <zros/zros_broker.h>
 #include <zros/zros_node.h>
 #include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
+#include "vote.h"
+
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+#include "stream.h"
+#endif
+
 LOG_MODULE_REGISTER(sense_imu, CONFIG_CEREBRI_SENSE_IMU_LOG_LEVEL);
 
 #define THREAD_STACK_SIZE 2048
 #define THREAD_PRIORITY 6
 
-static const double g_accel = 9.8;
+#define ACCEL_COUNT CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT
+#define GYRO_COUNT CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT
+
+static const float g_accel = 9.8f;
 static const int g_calibration_count = 100;
 
+#if defined(CONFIG_CEREBRI_SENSE_IMU_FUSION_MEDIAN)
+#define FUSION IMU_VOTE_FUSION_MEDIAN
+#elif defined(CONFIG_CEREBRI_SENSE_IMU_FUSION_WEIGHTED)
+#define FUSION IMU_VOTE_FUSION_WEIGHTED
+#else
+#define FUSION IMU_VOTE_FUSION_PRIMARY
+#endif
+
+static const struct imu_vote_config g_accel_vote_config = {
+    .fusion = FUSION,
+    .stuck_count = CONFIG_CEREBRI_SENSE_IMU_VOTE_STUCK_COUNT,
+    .noise_max = CONFIG_CEREBRI_SENSE_IMU_VOTE_ACCEL_NOISE_MAX_MM_S2 * 1e-3f,
+    .error_max = CONFIG_CEREBRI_SENSE_IMU_VOTE_ACCEL_ERROR_MAX_MM_S2 * 1e-3f,
+    .alpha = 0.02f,
+};
+
+static const struct imu_vote_config g_gyro_vote_config = {
+    .fusion = FUSION,
+    .stuck_count = CONFIG_CEREBRI_SENSE_IMU_VOTE_STUCK_COUNT,
+    .noise_max = CONFIG_CEREBRI_SENSE_IMU_VOTE_GYRO_NOISE_MAX_MRAD_S * 1e-3f,
+    .error_max = CONFIG_CEREBRI_SENSE_IMU_VOTE_GYRO_ERROR_MAX_MRAD_S * 1e-3f,
+    .alpha = 0.02f,
+};
+
+ZROS_TOPIC_DEFINE(imu_health, struct imu_health);
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+ZROS_TOPIC_DEFINE(imu_delta, struct imu_delta);
+#endif
+
 extern struct k_work_q g_high_priority_work_q;
 void imu_work_handler(struct k_work* work);
 void imu_timer_handler(struct k_timer* dummy);
 
+struct welford {
+    float mean[3];
+    float m2[3];
+};
+
 typedef struct context_t {
     // work
     struct k_work work_item;
@@ -42,20 +90,40 @@ typedef struct context_t {
     synapse_msgs_Status status;
     synapse_msgs_Status_Mode last_mode;
     bool calibrated;
+    int calibration_samples;
+    atomic_t ready;
     // publications
     struct zros_pub pub_imu;
+    struct zros_pub pub_imu_health;
+    struct imu_health health;
+    int64_t health_ticks_last;
     // subscriptions
     struct zros_sub sub_status;
     // devices
-    const struct device* accel_dev[CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT];
-    const struct device* gyro_dev[CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT];
+    const struct device* accel_dev[ACCEL_COUNT];
+    const struct device* gyro_dev[GYRO_COUNT];
     // raw readings
-    double gyro_raw[CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT][3];
-    double accel_raw[CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT][3];
+    float gyro_raw[GYRO_COUNT][3];
+    float accel_raw[ACCEL_COUNT][3];
     // bias
-    double gyro_bias[CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT][3];
-    double accel_bias[CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT][3];
-    double accel_scale[CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT];
+    float gyro_bias[GYRO_COUNT][3];
+    float accel_bias[ACCEL_COUNT][3];
+    float accel_scale[ACCEL_COUNT];
+    // calibration statistics
+    struct welford accel_stats[ACCEL_COUNT];
+    struct welford gyro_stats[GYRO_COUNT];
+    // redundancy
+    struct imu_vote accel_vote;
+    struct imu_vote gyro_vote;
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+    // fifo streams, by gyro
+    struct imu_stream stream[GYRO_COUNT];
+    float stream_accel[GYRO_COUNT][3];
+    struct imu_delta delta[GYRO_COUNT];
+    bool delta_valid[GYRO_COUNT];
+    struct imu_delta imu_delta;
+    struct zros_pub pub_imu_delta;
+#endif
 } context_t;
 
 static context_t g_ctx = {
@@ -77,6 +145,8 @@ static context_t g_ctx = {
     .status = synapse_msgs_Status_init_default,
     .last_mode = synapse_msgs_Status_Mode_MODE_UNKNOWN,
     .calibrated = false,
+    .calibration_samples = 0,
+    .ready = ATOMIC_INIT(0),
     .pub_imu = {},
     .sub_status = {},
     .accel_dev = {},
@@ -85,6 +155,8 @@ static context_t g_ctx = {
     .accel_raw = {},
     .gyro_bias = {},
     .accel_bias = {},
+    .accel_vote = {},
+    .gyro_vote = {},
 };
 
 static void imu_init(context_t* ctx)
@@ -92,32 +164,118 @@ static void imu_init(context_t* ctx)
     // initialize node
     zros_node_init(&ctx->node, "sense_imu");
     zros_pub_init(&ctx->pub_imu, &ctx->node, &topic_imu, &ctx->imu);
+    zros_pub_init(&ctx->pub_imu_health, &ctx->node, &topic_imu_health, &ctx->health);
+    imu_vote_init(&ctx->accel_vote, ACCEL_COUNT, &g_accel_vote_config);
+    imu_vote_init(&ctx->gyro_vote, GYRO_COUNT, &g_gyro_vote_config);
     zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 1);
 
     // setup accel devices
 
     ctx->accel_dev[0] = get_device(DEVICE_DT_GET(DT_ALIAS(accel0)));
-#if CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT >= 2
+#if ACCEL_COUNT >= 2
     ctx->accel_dev[1] = get_device(DEVICE_DT_GET(DT_ALIAS(accel1)));
-#elif CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT >= 3
+#endif
+#if ACCEL_COUNT >= 3
     ctx->accel_dev[2] = get_device(DEVICE_DT_GET(DT_ALIAS(accel2)));
-#elif CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT == 4
+#endif
+#if ACCEL_COUNT == 4
     ctx->accel_dev[3] = get_device(DEVICE_DT_GET(DT_ALIAS(accel3)));
 #endif
 
     // setup gyro devices
     ctx->gyro_dev[0] = get_device(DEVICE_DT_GET(DT_ALIAS(gyro0)));
-#if CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT >= 2
+#if GYRO_COUNT >= 2
     ctx->gyro_dev[1] = get_device(DEVICE_DT_GET(DT_ALIAS(gyro1)));
-#elif CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT >= 3
+#endif
+#if GYRO_COUNT >= 3
     ctx->gyro_dev[2] = get_device(DEVICE_DT_GET(DT_ALIAS(gyro2)));
-#elif CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT == 4
+#endif
+#if GYRO_COUNT == 4
     ctx->gyro_dev[3] = get_device(DEVICE_DT_GET(DT_ALIAS(gyro3)));
 #endif
+
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+    zros_pub_init(&ctx->pub_imu_delta, &ctx->node, &topic_imu_delta, &ctx->imu_delta);
+    for (int i = 0; i < GYRO_COUNT; i++) {
+        int rc = imu_stream_start(&ctx->stream[i], i);
+        if (rc < 0) {
+            LOG_WRN("gyro %d not streaming (%d), polled", i, rc);
+        }
+    }
+#endif
 }
 
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+// take the samples streamed since the last read, a stream without new
+// samples keeps its last reading
+static void imu_read_stream(context_t* ctx)
+{
+    imu_stream_drain();
+    for (int i = 0; i < GYRO_COUNT; i++) {
+        int samples = imu_stream_take(&ctx->stream[i], ctx->gyro_raw[i],
+            ctx->stream_accel[i], &ctx->delta[i]);
+        ctx->delta_valid[i] = samples > 0;
+        ctx->delta[i].sensor = i;
+    }
+}
+
+static bool gyro_streamed(const context_t* ctx, int i)
+{
+    return ctx->stream[i].active;
+}
+
+// accel of a combined imu, read with the streamed gyro of its device
+static bool accel_streamed(context_t* ctx, int i)
+{
+    for (int j = 0; j < GYRO_COUNT; j++) {
+        const struct imu_stream* s = &ctx->stream[j];
+        if (s->active && s->has_accel && ctx->gyro_dev[j] == ctx->accel_dev[i]) {
+            memcpy(ctx->accel_raw[i], ctx->stream_accel[j], sizeof(ctx->accel_raw[i]));
+            return true;
+        }
+    }
+    return false;
+}
+
+// correct the samples integrated into the deltas
+static void imu_stream_calibrate(context_t* ctx)
+{
+    for (int j = 0; j < GYRO_COUNT; j++) {
+        struct imu_stream* s = &ctx->stream[j];
+        memcpy(s->gyro_bias, ctx->gyro_bias[j], sizeof(s->gyro_bias));
+        for (int i = 0; i < ACCEL_COUNT; i++) {
+            if (ctx->accel_dev[i] == ctx->gyro_dev[j]) {
+                memcpy(s->accel_bias, ctx->accel_bias[i], sizeof(s->accel_bias));
+                s->accel_scale = ctx->accel_scale[i];
+            }
+        }
+    }
+}
+
+static void imu_publish_delta(context_t* ctx)
+{
+    int i = ctx->gyro_vote.primary;
+    if (ctx->delta_valid[i]) {
+        ctx->imu_delta = ctx->delta[i];
+        zros_pub_update(&ctx->pub_imu_delta);
+    }
+}
+#else
+static inline void imu_read_stream(context_t* ctx) { }
+
+static inline bool gyro_streamed(const context_t* ctx, int i) { return false; }
+
+static inline bool accel_streamed(context_t* ctx, int i) { return false; }
+
+static inline void imu_stream_calibrate(context_t* ctx) { }
+
+static inline void imu_publish_delta(context_t* ctx) { }
+#endif
+
 void imu_read(context_t* ctx)
 {
+    imu_read_stream(ctx);
+
     for (int i = 0; i < MAX(CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT,
                         CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT);
          i++) {
@@ -126,12 +284,12 @@ void imu_read(context_t* ctx)
         struct sensor_value gyro_value[3] = {};
 
         // get accel if device present
-        if (i < CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT) {
+        if (i < CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT && !accel_streamed(ctx, i)) {
             if (ctx->accel_dev[i] != NULL) {
                 sensor_sample_fetch(ctx->accel_dev[i]);
                 sensor_channel_get(ctx->accel_dev[i], SENSOR_CHAN_ACCEL_XYZ, accel_value);
                 for (int j = 0; j < 3; j++) {
-                    ctx->accel_raw[i][j] = accel_value[j].val1 + accel_value[j].val2 * 1e-6;
+                    ctx->accel_raw[i][j] = sensor_value_to_float(&accel_value[j]);
                 }
                 LOG_DBG("accel %d: %d.%06d %d.%06d %d.%06d", i,
                     accel_value[0].val1, accel_value[0].val2,
@@ -141,15 +299,15 @@ void imu_read(context_t* ctx)
         }
 
         // get gyro if device present
-        if (i < CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT) {
+        if (i < CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT && !gyro_streamed(ctx, i)) {
             if (ctx->gyro_dev[i] != NULL) {
                 // don't resample if it is the same device as accel, want same timestamp
-                if (ctx->gyro_dev[i] != ctx->accel_dev[i]) {
+                if (i >= ACCEL_COUNT || ctx->gyro_dev[i] != ctx->accel_dev[i]) {
                     sensor_sample_fetch(ctx->gyro_dev[i]);
                 }
                 sensor_channel_get(ctx->gyro_dev[i], SENSOR_CHAN_GYRO_XYZ, gyro_value);
                 for (int j = 0; j < 3; j++) {
-                    ctx->gyro_raw[i][j] = gyro_value[j].val1 + gyro_value[j].val2 * 1e-6;
+                    ctx->gyro_raw[i][j] = sensor_value_to_float(&gyro_value[j]);
                 }
                 LOG_DBG("gyro %d: %d.%06d %d.%06d %d.%06d", i,
                     gyro_value[0].val1, gyro_value[0].val2,
@@ -160,153 +318,178 @@ void imu_read(context_t* ctx)
     }
 }
 
-void imu_calibrate(context_t* ctx)
+static void welford_reset(struct welford* w)
 {
-    // data
-    double accel_samples[g_calibration_count][CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT][3];
-    double gyro_samples[g_calibration_count][CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT][3];
-
-    // mean and std
-    double accel_mean[CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT][3];
-    double gyro_mean[CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT][3];
-    double accel_std[CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT][3];
-    double gyro_std[CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT][3];
-
-    // repeat until calibrated
-    while (true) {
-
-        LOG_INF("calibration started, keep level, don't move");
-
-        // reset sum to zero
-        memset(gyro_samples, 0, sizeof(gyro_samples));
-        memset(accel_samples, 0, sizeof(accel_samples));
-        memset(accel_mean, 0, sizeof(accel_mean));
-        memset(accel_std, 0, sizeof(accel_std));
-        memset(gyro_mean, 0, sizeof(gyro_mean));
-        memset(gyro_std, 0, sizeof(gyro_std));
-
-        // attempt to get samples
-        for (int i = 0; i < g_calibration_count; i++) {
-            k_msleep(5);
-            imu_read(ctx);
-
-            // get accel data
-            for (int j = 0; j < CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT; j++) {
-                for (int k = 0; k < 3; k++) {
-                    accel_samples[i][j][k] = ctx->accel_raw[j][k];
-                    accel_mean[j][k] += accel_samples[i][j][k];
-                }
-            }
-
-            // get gyro data
-            for (int j = 0; j < CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT; j++) {
-                for (int k = 0; k < 3; k++) {
-                    gyro_samples[i][j][k] = ctx->gyro_raw[j][k];
-                    gyro_mean[j][k] += gyro_samples[i][j][k];
-                }
-            }
-        }
-
-        // find accel mean
-        for (int j = 0; j < CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT; j++) {
-            for (int k = 0; k < 3; k++) {
-                accel_mean[j][k] /= g_calibration_count;
-            }
-        }
-
-        // find gyro mean
-        for (int j = 0; j < CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT; j++) {
-            for (int k = 0; k < 3; k++) {
-                gyro_mean[j][k] /= g_calibration_count;
-            }
-        }
-
-        // find std deviation
-        for (int i = 0; i < g_calibration_count; i++) {
-            // get accel data
-            for (int j = 0; j < CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT; j++) {
-                for (int k = 0; k < 3; k++) {
-                    double e = accel_samples[i][j][k] - accel_mean[j][k];
-                    accel_std[j][k] += e * e;
-                }
-            }
-
-            // get gyro data
-            for (int j = 0; j < CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT; j++) {
-                for (int k = 0; k < 3; k++) {
-                    double e = gyro_samples[i][j][k] - gyro_mean[j][k];
-                    gyro_std[j][k] += e * e;
-                }
-            }
-        }
-
-        for (int j = 0; j < CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT; j++) {
-            for (int k = 0; k < 3; k++) {
-                accel_std[j][k] = sqrt(accel_std[j][k] / g_calibration_count);
-            }
-        }
+    memset(w, 0, sizeof(*w));
+}
 
-        for (int j = 0; j < CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT; j++) {
-            for (int k = 0; k < 3; k++) {
-                gyro_std[j][k] = sqrt(gyro_std[j][k] / g_calibration_count);
-            }
-        }
+// running mean and sum of squared deviations, n is the count with x
+static void welford_add(struct welford* w, const float x[3], int n)
+{
+    for (int k = 0; k < 3; k++) {
+        float d = x[k] - w->mean[k];
+        w->mean[k] += d / n;
+        w->m2[k] += d * (x[k] - w->mean[k]);
+    }
+}
 
-        // check if calibration acceptable, and break if it is
-        // TODO implement calibration check
-        break;
+static void imu_calibrate_start(context_t* ctx)
+{
+    LOG_INF("calibration started, keep level, don't move");
+    ctx->calibration_samples = 0;
+    for (int j = 0; j < ACCEL_COUNT; j++) {
+        welford_reset(&ctx->accel_stats[j]);
+    }
+    for (int j = 0; j < GYRO_COUNT; j++) {
+        welford_reset(&ctx->gyro_stats[j]);
     }
+}
 
+static void imu_calibrate_finish(context_t* ctx)
+{
+    // TODO implement calibration check, and restart if not acceptable
     LOG_INF("calibration completed");
-    for (int j = 0; j < CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT; j++) {
-        ctx->accel_bias[j][0] = accel_mean[j][0];
-        ctx->accel_bias[j][1] = accel_mean[j][1];
+    for (int j = 0; j < ACCEL_COUNT; j++) {
+        const float* mean = ctx->accel_stats[j].mean;
+        const float* m2 = ctx->accel_stats[j].m2;
+        ctx->accel_bias[j][0] = mean[0];
+        ctx->accel_bias[j][1] = mean[1];
         ctx->accel_bias[j][2] = 0;
-        ctx->accel_scale[j] = sqrt(
-                                  accel_mean[j][0] * accel_mean[j][0] + accel_mean[j][1] * accel_mean[j][1] + accel_mean[j][2] * accel_mean[j][2])
-            / g_accel;
+        ctx->accel_scale[j] = sqrtf(mean[0] * mean[0] + mean[1] * mean[1] + mean[2] * mean[2]) / g_accel;
         LOG_INF("accel %d", j);
-        LOG_INF("mean: %10.4f %10.4f %10.4f", accel_mean[j][0], accel_mean[j][1], accel_mean[j][2]);
-        LOG_INF("std: %10.4f %10.4f %10.4f", accel_std[j][0], accel_std[j][1], accel_std[j][2]);
+        LOG_INF("mean: %10.4f %10.4f %10.4f", mean[0], mean[1], mean[2]);
+        LOG_INF("std: %10.4f %10.4f %10.4f",
+            sqrtf(m2[0] / g_calibration_count),
+            sqrtf(m2[1] / g_calibration_count),
+            sqrtf(m2[2] / g_calibration_count));
         LOG_INF("scale %10.4f", ctx->accel_scale[j]);
     }
 
-    for (int j = 0; j < CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT; j++) {
+    for (int j = 0; j < GYRO_COUNT; j++) {
+        const float* mean = ctx->gyro_stats[j].mean;
+        const float* m2 = ctx->gyro_stats[j].m2;
         LOG_INF("gyro %d", j);
-        LOG_INF("mean: %10.4f %10.4f %10.4f", gyro_mean[j][0], gyro_mean[j][1], gyro_mean[j][2]);
-        LOG_INF("std: %10.4f %10.4f %10.4f", gyro_std[j][0], gyro_std[j][1], gyro_std[j][2]);
+        LOG_INF("mean: %10.4f %10.4f %10.4f", mean[0], mean[1], mean[2]);
+        LOG_INF("std: %10.4f %10.4f %10.4f",
+            sqrtf(m2[0] / g_calibration_count),
+            sqrtf(m2[1] / g_calibration_count),
+            sqrtf(m2[2] / g_calibration_count));
         for (int k = 0; k < 3; k++) {
-            ctx->gyro_bias[j][k] = gyro_mean[j][k];
+            ctx->gyro_bias[j][k] = mean[k];
         }
     }
+    imu_stream_calibrate(ctx);
     ctx->calibrated = true;
 }
 
+// take one calibration sample per step, so the caller is never blocked
+static void imu_calibrate_step(context_t* ctx)
+{
+    if (ctx->calibration_samples == 0) {
+        imu_calibrate_start(ctx);
+    }
+
+    imu_read(ctx);
+    int n = ++ctx->calibration_samples;
+    for (int j = 0; j < ACCEL_COUNT; j++) {
+        welford_add(&ctx->accel_stats[j], ctx->accel_raw[j], n);
+    }
+    for (int j = 0; j < GYRO_COUNT; j++) {
+        welford_add(&ctx->gyro_stats[j], ctx->gyro_raw[j], n);
+    }
+
+    if (n == g_calibration_count) {
+        imu_calibrate_finish(ctx);
+    }
+}
+
+// time of the primary gyro sample, the mean of the streamed samples is
+// stamped with the last one
+static int64_t imu_sample_ticks(const context_t* ctx)
+{
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+    const struct imu_stream* s = &ctx->stream[ctx->gyro_vote.primary];
+    if (s->active && s->timestamp_valid) {
+        return k_ns_to_ticks_floor64(s->timestamp_ns);
+    }
+#endif
+    return k_uptime_ticks();
+}
+
+static bool health_update(struct imu_health_sensors* h, const struct imu_vote* v)
+{
+    bool changed = h->primary != v->primary || h->disagree != v->disagree;
+    h->count = v->count;
+    h->primary = v->primary;
+    h->disagree = v->disagree;
+    h->failovers = v->failovers;
+    for (int i = 0; i < v->count; i++) {
+        changed = changed || h->faults[i] != v->sensor[i].faults;
+        h->faults[i] = v->sensor[i].faults;
+    }
+    return changed;
+}
+
+static void imu_health_publish(context_t* ctx)
+{
+    int64_t ticks = k_uptime_ticks();
+    bool changed = health_update(&ctx->health.accel, &ctx->accel_vote);
+    changed = health_update(&ctx->health.gyro, &ctx->gyro_vote) || changed;
+    if (changed || ticks - ctx->health_ticks_last >= CONFIG_SYS_CLOCK_TICKS_PER_SEC) {
+        ctx->health.uptime_ticks = ticks;
+        ctx->health_ticks_last = ticks;
+        zros_pub_update(&ctx->pub_imu_health);
+    }
+}
+
 void imu_publish(context_t* ctx)
 {
-    // TODO implement voting
-    static const int accel_select = 0;
-    static const int gyro_select = 0;
+    float accel[ACCEL_COUNT][3];
+    float gyro[GYRO_COUNT][3];
+    float accel_fused[3];
+    float gyro_fused[3];
+
+    // calibrated samples of each sensor
+    for (int i = 0; i < ACCEL_COUNT; i++) {
+        for (int j = 0; j < 3; j++) {
+            accel[i][j] = (ctx->accel_raw[i][j] - ctx->accel_bias[i][j]) / ctx->accel_scale[i];
+        }
+    }
+    for (int i = 0; i < GYRO_COUNT; i++) {
+        for (int j = 0; j < 3; j++) {
+            gyro[i][j] = ctx->gyro_raw[i][j] - ctx->gyro_bias[i][j];
+        }
+    }
+
+    // vote
+    if (imu_vote_update(&ctx->accel_vote, (const float(*)[3])accel, accel_fused)) {
+        LOG_WRN("accel failover to %d", ctx->accel_vote.primary);
+    }
+    if (imu_vote_update(&ctx->gyro_vote, (const float(*)[3])gyro, gyro_fused)) {
+        LOG_WRN("gyro failover to %d", ctx->gyro_vote.primary);
+    }
+    imu_health_publish(ctx);
+    imu_publish_delta(ctx);
 
     // update message
-    stamp_header(&ctx->imu.header, k_uptime_ticks());
+    int64_t stamp_ticks = imu_sample_ticks(ctx);
+    stamp_header(&ctx->imu.header, stamp_ticks);
     ctx->imu.header.seq++;
-    ctx->imu.angular_velocity.x = ctx->gyro_raw[gyro_select][0] - ctx->gyro_bias[gyro_select][0];
-    ctx->imu.angular_velocity.y = ctx->gyro_raw[gyro_select][1] - ctx->gyro_bias[gyro_select][1];
-    ctx->imu.angular_velocity.z = ctx->gyro_raw[gyro_select][2] - ctx->gyro_bias[gyro_select][2];
-    ctx->imu.linear_acceleration.x = (ctx->accel_raw[accel_select][0] - ctx->accel_bias[accel_select][0]) / ctx->accel_scale[accel_select];
-    ctx->imu.linear_acceleration.y = (ctx->accel_raw[accel_select][1] - ctx->accel_bias[accel_select][1]) / ctx->accel_scale[accel_select];
-    ctx->imu.linear_acceleration.z = (ctx->accel_raw[accel_select][2] - ctx->accel_bias[accel_select][2]) / ctx->accel_scale[accel_select];
+    ctx->imu.angular_velocity.x = gyro_fused[0];
+    ctx->imu.angular_velocity.y = gyro_fused[1];
+    ctx->imu.angular_velocity.z = gyro_fused[2];
+    ctx->imu.linear_acceleration.x = accel_fused[0];
+    ctx->imu.linear_acceleration.y = accel_fused[1];
+    ctx->imu.linear_acceleration.z = accel_fused[2];
 
     // publish message
+    trace_sample(TRACE_TOPIC_IMU, ctx->imu.header.seq, stamp_ticks);
     zros_pub_update(&ctx->pub_imu);
     // LOG_INF("publish imu");
 }
 
-void imu_work_handler(struct k_work* work)
+static int imu_step(context_t* ctx)
 {
-    context_t* ctx = CONTAINER_OF(work, context_t, work_item);
-
     // update status
     if (zros_sub_update_available(&ctx->sub_status)) {
         zros_sub_update(&ctx->sub_status);
@@ -315,17 +498,33 @@ void imu_work_handler(struct k_work* work)
     // handle calibration request
     if (ctx->status.mode == synapse_msgs_Status_Mode_MODE_CALIBRATION && ctx->last_mode != synapse_msgs_Status_Mode_MODE_CALIBRATION) {
         ctx->calibrated = false;
+        ctx->calibration_samples = 0;
     }
     ctx->last_mode = ctx->status.mode;
 
     if (!ctx->calibrated) {
-        LOG_INF("calibrating");
-        imu_calibrate(ctx);
-        return;
+        imu_calibrate_step(ctx);
+        return -EBUSY;
     }
 
     imu_read(ctx);
     imu_publish(ctx);
+    return 0;
+}
+
+void imu_work_handler(struct k_work* work)
+{
+    context_t* ctx = CONTAINER_OF(work, context_t, work_item);
+    imu_step(ctx);
+}
+
+int sense_imu_step(void)
+{
+    context_t* ctx = &g_ctx;
+    if (!atomic_get(&ctx->ready)) {
+        return -EAGAIN;
+    }
+    return imu_step(ctx);
 }
 
 void imu_timer_handler(struct k_timer* timer)
@@ -340,10 +539,24 @@ int sense_imu_entry_point(context_t* ctx)
     imu_init(ctx);
     // delay initiali calibration 1 s
     k_msleep(1000);
+    atomic_set(&ctx->ready, 1);
+#if !defined(CONFIG_CEREBRI_SENSE_IMU_SYNCHRONOUS)
     k_timer_start(&ctx->timer, K_MSEC(5), K_MSEC(5));
+#endif
+    return 0;
+}
+
+static int sense_imu_add_topic(void)
+{
+    zros_broker_add_topic(&topic_imu_health);
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+    zros_broker_add_topic(&topic_imu_delta);
+#endif
     return 0;
 }
 
+SYS_INIT(sense_imu_add_topic, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 K_THREAD_DEFINE(sense_imu, THREAD_STACK_SIZE,
     sense_imu_entry_point, &g_ctx, NULL, NULL,
     THREAD_PRIORITY, 0, 100);
@@ -0,0 +1,204 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/rtio/rtio.h>
+
+#include "stream.h"
+
+LOG_MODULE_DECLARE(sense_imu);
+
+#define GYRO_COUNT CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT
+
+// the stream api and the fifo triggers came with zephyr 3.6, before it
+// every gyro is polled
+#if defined(SENSOR_DT_STREAM_IODEV)
+#define BLOCK_SIZE 64
+#define BLOCK_COUNT (CONFIG_CEREBRI_SENSE_IMU_STREAM_BUFFER_SIZE / BLOCK_SIZE)
+
+// read the fifo when it reaches its watermark, drop it if it overflows
+#define STREAM_TRIGGERS                                          \
+    {SENSOR_TRIG_FIFO_WATERMARK, SENSOR_STREAM_DATA_INCLUDE}, \
+    {SENSOR_TRIG_FIFO_FULL, SENSOR_STREAM_DATA_NOP}
+
+SENSOR_DT_STREAM_IODEV(imu_stream_iodev_0, DT_ALIAS(gyro0), STREAM_TRIGGERS);
+#if GYRO_COUNT >= 2
+SENSOR_DT_STREAM_IODEV(imu_stream_iodev_1, DT_ALIAS(gyro1), STREAM_TRIGGERS);
+#endif
+#if GYRO_COUNT >= 3
+SENSOR_DT_STREAM_IODEV(imu_stream_iodev_2, DT_ALIAS(gyro2), STREAM_TRIGGERS);
+#endif
+#if GYRO_COUNT == 4
+SENSOR_DT_STREAM_IODEV(imu_stream_iodev_3, DT_ALIAS(gyro3), STREAM_TRIGGERS);
+#endif
+
+static struct rtio_iodev* const g_iodev[GYRO_COUNT] = {
+    &imu_stream_iodev_0,
+#if GYRO_COUNT >= 2
+    &imu_stream_iodev_1,
+#endif
+#if GYRO_COUNT >= 3
+    &imu_stream_iodev_2,
+#endif
+#if GYRO_COUNT == 4
+    &imu_stream_iodev_3,
+#endif
+};
+
+RTIO_DEFINE_WITH_MEMPOOL(imu_rtio, 4, 8, BLOCK_COUNT, BLOCK_SIZE, sizeof(void*));
+
+int imu_stream_start(struct imu_stream* s, int index)
+{
+    const struct sensor_read_config* cfg = g_iodev[index]->data;
+    const struct sensor_driver_api* api = cfg->sensor->api;
+    struct rtio_sqe* handle;
+
+    memset(s, 0, sizeof(*s));
+    s->iodev = g_iodev[index];
+    s->accel_scale = 1;
+
+    if (api->submit == NULL || sensor_get_decoder(cfg->sensor, &s->decoder) != 0) {
+        return -ENOTSUP;
+    }
+
+    // the stream completes on the imu_rtio queue until it fails
+    s->active = true;
+    int rc = sensor_stream(s->iodev, &imu_rtio, s, &handle);
+    if (rc < 0) {
+        s->active = false;
+        return rc;
+    }
+    return 0;
+}
+
+static inline float q31_to_float(q31_t value, int8_t shift)
+{
+    return ldexpf(value, shift - 31);
+}
+
+// integrate every frame of a burst
+static void stream_decode(struct imu_stream* s, const uint8_t* buf)
+{
+    struct sensor_three_axis_data gyro;
+    struct sensor_three_axis_data accel;
+    uint32_t gyro_fit = 0;
+    uint32_t accel_fit = 0;
+    uint16_t accel_frames = 0;
+
+    s->has_accel = s->decoder->get_frame_count(buf, SENSOR_CHAN_ACCEL_XYZ, 0, &accel_frames) == 0
+        && accel_frames > 0;
+
+    while (s->decoder->decode(buf, SENSOR_CHAN_GYRO_XYZ, 0, &gyro_fit, 1, &gyro) > 0) {
+        float omega[3];
+        float f[3] = {};
+        uint64_t t = gyro.header.base_timestamp_ns + gyro.readings[0].timestamp_delta;
+
+        for (int k = 0; k < 3; k++) {
+            omega[k] = q31_to_float(gyro.readings[0].values[k], gyro.shift);
+        }
+        // accel frames pair with the gyro frames of a combined imu
+        if (s->has_accel && s->decoder->decode(buf, SENSOR_CHAN_ACCEL_XYZ, 0, &accel_fit, 1, &accel) > 0) {
+            for (int k = 0; k < 3; k++) {
+                f[k] = q31_to_float(accel.readings[0].values[k], accel.shift);
+            }
+        }
+
+        if (!s->timestamp_valid) {
+            // the first sample only starts the clock
+            s->timestamp_ns = t;
+            s->timestamp_valid = true;
+            continue;
+        } else if (t <= s->timestamp_ns) {
+            LOG_DBG("dropped sample out of order");
+            continue;
+        }
+        // the gap between samples fits 32 bits
+        float dt = (uint32_t)(t - s->timestamp_ns) * 1e-9f;
+        s->timestamp_ns = t;
+
+        float omega_c[3];
+        float f_c[3];
+        for (int k = 0; k < 3; k++) {
+            s->gyro_sum[k] += omega[k];
+            s->accel_sum[k] += f[k];
+            omega_c[k] = omega[k] - s->gyro_bias[k];
+            f_c[k] = (f[k] - s->accel_bias[k]) / s->accel_scale;
+        }
+        s->samples++;
+        s->dt += dt;
+        imu_delta_add(&s->delta, omega_c, f_c, dt);
+    }
+}
+
+void imu_stream_drain(void)
+{
+    struct rtio_cqe* cqe;
+
+    while ((cqe = rtio_cqe_consume(&imu_rtio)) != NULL) {
+        struct imu_stream* s = cqe->userdata;
+        int result = cqe->result;
+        uint8_t* buf = NULL;
+        uint32_t len = 0;
+        int rc = rtio_cqe_get_mempool_buffer(&imu_rtio, cqe, &buf, &len);
+        rtio_cqe_release(&imu_rtio, cqe);
+
+        if (result < 0 || rc != 0) {
+            // the stream is not resubmitted after an error
+            LOG_ERR("stream failed %d, polling", result < 0 ? result : rc);
+            s->active = false;
+        } else {
+            stream_decode(s, buf);
+        }
+
+        if (buf != NULL) {
+            rtio_release_buffer(&imu_rtio, buf, len);
+        }
+    }
+}
+#else
+int imu_stream_start(struct imu_stream* s, int index)
+{
+    ARG_UNUSED(index);
+    memset(s, 0, sizeof(*s));
+    s->accel_scale = 1;
+    return -ENOTSUP;
+}
+
+void imu_stream_drain(void)
+{
+}
+#endif
+
+int imu_stream_take(struct imu_stream* s, float gyro[3], float accel[3],
+    struct imu_delta* delta)
+{
+    int samples = s->samples;
+    if (samples == 0) {
+        return 0;
+    }
+
+    for (int k = 0; k < 3; k++) {
+        gyro[k] = s->gyro_sum[k] / samples;
+        accel[k] = s->accel_sum[k] / samples;
+    }
+    delta->timestamp_ns = s->timestamp_ns;
+    delta->dt_us = s->dt * 1e6f;
+    delta->samples = samples;
+    imu_delta_get(&s->delta, delta->delta_angle, delta->delta_velocity);
+
+    s->samples = 0;
+    s->dt = 0;
+    memset(s->gyro_sum, 0, sizeof(s->gyro_sum));
+    memset(s->accel_sum, 0, sizeof(s->accel_sum));
+    imu_delta_reset(&s->delta);
+    return samples;
+}
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,62 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SENSE_IMU_STREAM_H
+#define CEREBRI_SENSE_IMU_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/rtio/rtio.h>
+
+#include <cerebri/sense/imu.h>
+
+#include "delta.h"
+
+/*
+ * FIFO streaming of the gyros through the asynchronous sensor API.
+ *
+ * The driver reads its hardware FIFO in bursts on the watermark
+ * interrupt, and timestamps the samples from it. Draining decodes every
+ * sample of the completed bursts, without blocking, into the mean of the
+ * samples and the coning and sculling corrected deltas since the last
+ * take. A combined imu gives its accel samples in the same frames.
+ *
+ * A device whose driver doesn't stream keeps being polled.
+ */
+
+struct imu_stream {
+    struct rtio_iodev* iodev;
+    const struct sensor_decoder_api* decoder;
+    bool active;
+    bool has_accel;
+    // time of the last sample
+    uint64_t timestamp_ns;
+    bool timestamp_valid;
+    // correction of the samples integrated into the deltas
+    float gyro_bias[3];
+    float accel_bias[3];
+    float accel_scale;
+    // since the last take, raw
+    uint32_t samples;
+    float dt;
+    float gyro_sum[3];
+    float accel_sum[3];
+    struct imu_delta_integrator delta;
+};
+
+// start streaming gyro index, returns -ENOTSUP if its driver doesn't stream
+int imu_stream_start(struct imu_stream* s, int index);
+
+// decode all completed bursts of the streams
+void imu_stream_drain(void);
+
+// mean raw samples and deltas since the last take, returns the number of
+// samples, with 0 the outputs are left untouched
+int imu_stream_take(struct imu_stream* s, float gyro[3], float accel[3],
+    struct imu_delta* delta);
+
+#endif // CEREBRI_SENSE_IMU_STREAM_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,199 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+
+#include "vote.h"
+
+void imu_vote_init(struct imu_vote* v, int count, const struct imu_vote_config* config)
+{
+    memset(v, 0, sizeof(*v));
+    v->config = config;
+    if (count < 1) {
+        count = 1;
+    } else if (count > IMU_VOTE_MAX_SENSORS) {
+        count = IMU_VOTE_MAX_SENSORS;
+    }
+    v->count = count;
+}
+
+// median of n <= IMU_VOTE_MAX_SENSORS values, sorts x
+static float median(float* x, int n)
+{
+    for (int i = 1; i < n; i++) {
+        float xi = x[i];
+        int j = i;
+        for (; j > 0 && x[j - 1] > xi; j--) {
+            x[j] = x[j - 1];
+        }
+        x[j] = xi;
+    }
+    return (n % 2) ? x[n / 2] : 0.5f * (x[n / 2 - 1] + x[n / 2]);
+}
+
+// set fault above the limit, clear below half of it
+static uint8_t hysteresis(uint8_t faults, uint8_t fault, float ms, float limit)
+{
+    if (ms > limit * limit) {
+        return faults | fault;
+    } else if (ms < 0.25f * limit * limit) {
+        return faults & ~fault;
+    }
+    return faults;
+}
+
+// stuck and noise faults, from the samples of each sensor alone
+static void update_sensors(struct imu_vote* v, const float sample[][3])
+{
+    const struct imu_vote_config* cfg = v->config;
+
+    for (int i = 0; i < v->count; i++) {
+        struct imu_vote_sensor* s = &v->sensor[i];
+        float d2 = 0;
+        // bitwise, a stuck sensor repeats its sample exactly
+        bool repeat = memcmp(sample[i], s->last, sizeof(s->last)) == 0;
+        for (int k = 0; k < 3; k++) {
+            // second difference, zero for a sample changing linearly
+            float d = sample[i][k] - 2.0f * s->last[k] + s->prev[k];
+            d2 += d * d;
+            s->prev[k] = v->started ? s->last[k] : sample[i][k];
+            s->last[k] = sample[i][k];
+        }
+        if (!v->started) {
+            continue;
+        }
+
+        // white noise of variance s2 gives a second difference of variance 6 s2
+        s->repeat_count = repeat ? s->repeat_count + 1 : 0;
+        s->noise_ms += cfg->alpha * (d2 / 6.0f - s->noise_ms);
+
+        if (s->repeat_count >= cfg->stuck_count) {
+            s->faults |= IMU_FAULT_STUCK;
+        } else if (s->repeat_count == 0) {
+            s->faults &= ~IMU_FAULT_STUCK;
+        }
+        s->faults = hysteresis(s->faults, IMU_FAULT_NOISY, s->noise_ms, cfg->noise_max);
+    }
+}
+
+// disagreement with the per axis median of the sensors that are
+// neither stuck nor noisy, attributed when 3 or more of them vote
+static void update_consensus(struct imu_vote* v, const float sample[][3])
+{
+    const struct imu_vote_config* cfg = v->config;
+    const uint8_t independent = IMU_FAULT_STUCK | IMU_FAULT_NOISY;
+
+    int voter[IMU_VOTE_MAX_SENSORS];
+    int m = 0;
+    for (int i = 0; i < v->count; i++) {
+        if ((v->sensor[i].faults & independent) == 0) {
+            voter[m++] = i;
+        }
+    }
+
+    float center[3] = {};
+    if (m > 0) {
+        float x[IMU_VOTE_MAX_SENSORS];
+        for (int k = 0; k < 3; k++) {
+            for (int j = 0; j < m; j++) {
+                x[j] = sample[voter[j]][k];
+            }
+            center[k] = median(x, m);
+        }
+    }
+
+    for (int i = 0; i < v->count; i++) {
+        struct imu_vote_sensor* s = &v->sensor[i];
+        float e2 = 0;
+        for (int k = 0; k < 3; k++) {
+            float e = sample[i][k] - center[k];
+            e2 += e * e;
+        }
+        s->error_ms = v->started ? s->error_ms + cfg->alpha * (e2 - s->error_ms) : e2;
+        if (m >= 3) {
+            s->faults = hysteresis(s->faults, IMU_FAULT_DISAGREE, s->error_ms, cfg->error_max);
+        } else {
+            s->faults &= ~IMU_FAULT_DISAGREE;
+        }
+    }
+
+    // with 2 voters each is half the separation from the center
+    if (m == 2) {
+        float separation_ms = 4 * v->sensor[voter[0]].error_ms;
+        v->disagree = hysteresis(v->disagree ? 1 : 0, 1, separation_ms, cfg->error_max) != 0;
+    } else {
+        v->disagree = false;
+    }
+}
+
+static bool failover(struct imu_vote* v)
+{
+    if (v->sensor[v->primary].faults == 0) {
+        return false;
+    }
+
+    int best = -1;
+    for (int i = 0; i < v->count; i++) {
+        const struct imu_vote_sensor* s = &v->sensor[i];
+        if (s->faults == 0 && (best < 0 || s->noise_ms < v->sensor[best].noise_ms)) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        // keep the primary when no sensor is healthy
+        return false;
+    }
+    v->primary = best;
+    v->failovers++;
+    return true;
+}
+
+bool imu_vote_update(struct imu_vote* v, const float sample[][3], float fused[3])
+{
+    const struct imu_vote_config* cfg = v->config;
+    float x[IMU_VOTE_MAX_SENSORS];
+
+    update_sensors(v, sample);
+    update_consensus(v, sample);
+    v->started = true;
+
+    bool changed = failover(v);
+
+    int healthy[IMU_VOTE_MAX_SENSORS];
+    int n = 0;
+    for (int i = 0; i < v->count; i++) {
+        if (v->sensor[i].faults == 0) {
+            healthy[n++] = i;
+        }
+    }
+
+    if (cfg->fusion == IMU_VOTE_FUSION_PRIMARY || v->disagree || n == 0) {
+        memcpy(fused, sample[v->primary], sizeof(float) * 3);
+    } else if (cfg->fusion == IMU_VOTE_FUSION_MEDIAN) {
+        for (int k = 0; k < 3; k++) {
+            for (int j = 0; j < n; j++) {
+                x[j] = sample[healthy[j]][k];
+            }
+            fused[k] = median(x, n);
+        }
+    } else {
+        // inverse noise weights, floored so a quiet sensor can't dominate
+        float noise_floor = 1e-4f * cfg->noise_max * cfg->noise_max;
+        float w_sum = 0;
+        for (int j = 0; j < n; j++) {
+            x[j] = 1.0f / (v->sensor[healthy[j]].noise_ms + noise_floor);
+            w_sum += x[j];
+        }
+        for (int k = 0; k < 3; k++) {
+            fused[k] = 0;
+            for (int j = 0; j < n; j++) {
+                fused[k] += x[j] * sample[healthy[j]][k];
+            }
+            fused[k] /= w_sum;
+        }
+    }
+    return changed;
+}
+
+// vi: ts=4 sw=4 et
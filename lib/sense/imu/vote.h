@@ -0,0 +1,82 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SENSE_IMU_VOTE_H
+#define CEREBRI_SENSE_IMU_VOTE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cerebri/sense/imu.h>
+
+/*
+ * Redundancy management of up to IMU_VOTE_MAX_SENSORS sensors measuring the same 3 axis
+ * vector, one instance for the accelerometers and one for the gyros.
+ *
+ * Each update scores the health of every sensor from the sample it
+ * gives:
+ *  - stuck, the sample repeats exactly for stuck_count updates
+ *  - noisy, the rms noise exceeds noise_max, estimated from the second
+ *    difference of the samples so motion at a steady rate of change
+ *    doesn't count as noise
+ *  - disagree, the distance to the per axis median of the sensors
+ *    neither stuck nor noisy exceeds error_max, only attributed when 3
+ *    or more of them vote, with 2 a disagreement is flagged but
+ *    nobody can be blamed for it
+ * Noise and error are exponentially averaged, a fault clears when its
+ * metric falls below half of the limit.
+ *
+ * The primary sensor is kept while healthy, otherwise the healthy
+ * sensor with the lowest noise takes over. The fused output is the
+ * median, or noise weighted mean, of the healthy sensors, or the
+ * primary alone when the sensors disagree or none is healthy. There
+ * is no allocation, the cost is a few hundred flops per update.
+ */
+
+enum imu_vote_fusion {
+    IMU_VOTE_FUSION_PRIMARY,
+    IMU_VOTE_FUSION_MEDIAN,
+    IMU_VOTE_FUSION_WEIGHTED,
+};
+
+struct imu_vote_config {
+    enum imu_vote_fusion fusion;
+    uint32_t stuck_count;
+    float noise_max;
+    float error_max;
+    // weight of a new sample in the noise and error averages
+    float alpha;
+};
+
+struct imu_vote_sensor {
+    // the last two samples
+    float last[3];
+    float prev[3];
+    uint32_t repeat_count;
+    // mean square of the noise about the local trend, and of the
+    // distance to the consensus
+    float noise_ms;
+    float error_ms;
+    // enum imu_fault bits
+    uint8_t faults;
+};
+
+struct imu_vote {
+    const struct imu_vote_config* config;
+    int count;
+    int primary;
+    bool disagree;
+    bool started;
+    uint32_t failovers;
+    struct imu_vote_sensor sensor[IMU_VOTE_MAX_SENSORS];
+};
+
+void imu_vote_init(struct imu_vote* v, int count, const struct imu_vote_config* config);
+
+// vote on one sample per sensor, writes the fused sample, returns true
+// if the primary sensor changed
+bool imu_vote_update(struct imu_vote* v, const float sample[][3], float fused[3]);
+
+#endif // CEREBRI_SENSE_IMU_VOTE_H
+// vi: ts=4 sw=4 et
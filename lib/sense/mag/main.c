@@ -54,7 +54,7 @@ static context_t g_ctx = {
 void mag_work_handler(struct k_work* work)
 {
     context_t* ctx = CONTAINER_OF(work, context_t, work_item);
-    double mag_data_array[CONFIG_CEREBRI_SENSE_MAG_COUNT][3] = {};
+    float mag_data_array[CONFIG_CEREBRI_SENSE_MAG_COUNT][3] = {};
     for (int i = 0; i < CONFIG_CEREBRI_SENSE_MAG_COUNT; i++) {
         // default all data to zero
         struct sensor_value mag_value[3] = {};
@@ -70,12 +70,12 @@ void mag_work_handler(struct k_work* work)
         }
 
         for (int j = 0; j < 3; j++) {
-            mag_data_array[i][j] = mag_value[j].val1 + mag_value[j].val2 * 1e-6;
+            mag_data_array[i][j] = sensor_value_to_float(&mag_value[j]);
         }
     }
 
     // select first mag for data for now: TODO implement voting
-    double mag[3] = {
+    float mag[3] = {
         mag_data_array[0][0],
         mag_data_array[0][1],
         mag_data_array[0][2]
@@ -103,9 +103,11 @@ int sense_mag_entry_point(context_t* ctx)
     ctx->device[0] = get_device(DEVICE_DT_GET(DT_ALIAS(mag0)));
 #if CONFIG_CEREBRI_SENSE_MAG_COUNT >= 2
     ctx->device[1] = get_device(DEVICE_DT_GET(DT_ALIAS(mag1)));
-#elif CONFIG_CEREBRI_SENSE_MAG_COUNT >= 3
+#endif
+#if CONFIG_CEREBRI_SENSE_MAG_COUNT >= 3
     ctx->device[2] = get_device(DEVICE_DT_GET(DT_ALIAS(mag2)));
-#elif CONFIG_CEREBRI_SENSE_MAG_COUNT >= 4
+#endif
+#if CONFIG_CEREBRI_SENSE_MAG_COUNT == 4
     ctx->device[3] = get_device(DEVICE_DT_GET(DT_ALIAS(mag3)));
 #endif
 
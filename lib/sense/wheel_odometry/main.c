@@ -55,7 +55,9 @@ static context_t g_ctx = {
 void wheel_odometry_work_handler(struct k_work* work)
 {
     context_t* ctx = CONTAINER_OF(work, context_t, work_item);
-    double data_array[N_SENSORS];
+    // micro radians, a float would lose the resolution of the
+    // accumulated rotation
+    int64_t data_array[N_SENSORS];
     for (int i = 0; i < N_SENSORS; i++) {
         // default all data to zero
         struct sensor_value value = {};
@@ -67,13 +69,11 @@ void wheel_odometry_work_handler(struct k_work* work)
             LOG_DBG("rotation %d: %d.%06d", i, value.val1, value.val2);
         }
 
-        for (int j = 0; j < N_SENSORS; j++) {
-            data_array[i] = value.val1 + value.val2 * 1e-6;
-        }
+        data_array[i] = sensor_value_to_micro(&value);
     }
 
     // select first wheel encoder for data for now: TODO implement voting
-    double rotation = -data_array[0]; // account for negative rotation of encoder
+    double rotation = -data_array[0] * 1e-6; // account for negative rotation of encoder
 
     // publish msg
     stamp_header(&ctx->data.header, k_uptime_ticks());
@@ -1,6 +1,8 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
 
+#include <string.h>
+
 #include <zros/private/zros_node_struct.h>
 #include <zros/private/zros_sub_struct.h>
 #include <zros/zros_node.h>
@@ -11,6 +13,8 @@
 
 #include <pb_decode.h>
 
+#include <cerebri/synapse/batch.h>
+
 #include <synapse_tinyframe/SynapseTopics.h>
 #include <synapse_tinyframe/TinyFrame.h>
 #include <synapse_tinyframe/utils.h>
@@ -34,32 +38,42 @@ struct context {
 
 static struct context g_ctx;
 
-#define TOPIC_LISTENER(CHANNEL, CLASS)                                            \
-    static TF_Result CHANNEL##_listener(TinyFrame* tf, TF_Msg* frame)             \
-    {                                                                             \
-        CLASS msg = CLASS##_init_default;                                         \
-        pb_istream_t stream = pb_istream_from_buffer(frame->data, frame->len);    \
-        int rc = pb_decode(&stream, CLASS##_fields, &msg);                        \
-        if (rc) {                                                                 \
-            zros_topic_publish(&topic_##CHANNEL, &msg);                           \
-            LOG_DBG("%s decoding\n", #CHANNEL);                                   \
-        } else {                                                                  \
-            LOG_WRN("%s decoding failed: %s\n", #CHANNEL, PB_GET_ERROR(&stream)); \
-        }                                                                         \
-        return TF_STAY;                                                           \
-    }
-
-// topic listeners
-TOPIC_LISTENER(bezier_trajectory, synapse_msgs_BezierTrajectory)
-TOPIC_LISTENER(joy, synapse_msgs_Joy)
-TOPIC_LISTENER(clock_offset, synapse_msgs_Time)
+// topics received from the ground station
+static const enum synapse_topic_id g_rx_topics[] = {
+    SYNAPSE_TOPIC_ID_bezier_trajectory,
+    SYNAPSE_TOPIC_ID_joy,
+    SYNAPSE_TOPIC_ID_clock_offset,
+#ifdef CONFIG_CEREBRI_CORE_BEZIER_PLANNER
+    SYNAPSE_TOPIC_ID_bezier_waypoints,
+#endif
 #ifdef CONFIG_CEREBRI_DREAM_HIL
-TOPIC_LISTENER(battery_state, synapse_msgs_BatteryState)
-TOPIC_LISTENER(imu, synapse_msgs_Imu)
-TOPIC_LISTENER(magnetic_field, synapse_msgs_MagneticField)
-TOPIC_LISTENER(nav_sat_fix, synapse_msgs_NavSatFix)
-TOPIC_LISTENER(wheel_odometry, synapse_msgs_WheelOdometry)
+    SYNAPSE_TOPIC_ID_battery_state,
+    SYNAPSE_TOPIC_ID_imu,
+    SYNAPSE_TOPIC_ID_magnetic_field,
+    SYNAPSE_TOPIC_ID_nav_sat_fix,
+    SYNAPSE_TOPIC_ID_wheel_odometry,
 #endif
+};
+
+static TF_Result topic_listener(TinyFrame* tf, TF_Msg* frame)
+{
+    const struct synapse_topic_info* info = synapse_topic_from_tf(frame->type);
+    if (info == NULL) {
+        return TF_STAY;
+    }
+    // only used by the rx thread
+    static union synapse_topic_msg msg;
+    memset(&msg, 0, info->msg_size);
+    pb_istream_t stream = pb_istream_from_buffer(frame->data, frame->len);
+    int rc = pb_decode(&stream, info->fields, &msg);
+    if (rc) {
+        zros_topic_publish(info->topic, &msg);
+        LOG_DBG("%s decoding\n", info->name);
+    } else {
+        LOG_WRN("%s decoding failed: %s\n", info->name, PB_GET_ERROR(&stream));
+    }
+    return TF_STAY;
+}
 
 static TF_Result genericListener(TinyFrame* tf, TF_Msg* msg)
 {
@@ -117,37 +131,16 @@ static int init(struct context* ctx)
 
     // add tinyframe listeners
     ret = TF_AddGenericListener(&ctx->tf, genericListener);
-    if (ret < 0)
-        return ret;
-    ret = TF_AddTypeListener(&ctx->tf, SYNAPSE_BEZIER_TRAJECTORY_TOPIC, bezier_trajectory_listener);
     if (ret < 0)
         return ret;
     ret = TF_AddTypeListener(&ctx->tf, SYNAPSE_CMD_VEL_TOPIC, cmd_vel_listener);
     if (ret < 0)
         return ret;
-    ret = TF_AddTypeListener(&ctx->tf, SYNAPSE_JOY_TOPIC, joy_listener);
-    if (ret < 0)
-        return ret;
-    ret = TF_AddTypeListener(&ctx->tf, SYNAPSE_CLOCK_OFFSET_TOPIC, clock_offset_listener);
-    if (ret < 0)
-        return ret;
-#ifdef CONFIG_CEREBRI_DREAM_HIL
-    ret = TF_AddTypeListener(&ctx->tf, SYNAPSE_BATTERY_STATE_TOPIC, battery_state_listener);
-    if (ret < 0)
-        return ret;
-    ret = TF_AddTypeListener(&ctx->tf, SYNAPSE_IMU_TOPIC, imu_listener);
-    if (ret < 0)
-        return ret;
-    ret = TF_AddTypeListener(&ctx->tf, SYNAPSE_MAGNETIC_FIELD_TOPIC, magnetic_field_listener);
-    if (ret < 0)
-        return ret;
-    ret = TF_AddTypeListener(&ctx->tf, SYNAPSE_NAV_SAT_FIX_TOPIC, nav_sat_fix_listener);
-    if (ret < 0)
-        return ret;
-    ret = TF_AddTypeListener(&ctx->tf, SYNAPSE_WHEEL_ODOMETRY_TOPIC, wheel_odometry_listener);
-    if (ret < 0)
-        return ret;
-#endif
+    for (size_t i = 0; i < ARRAY_SIZE(g_rx_topics); i++) {
+        ret = TF_AddTypeListener(&ctx->tf, synapse_topic_registry[g_rx_topics[i]].tf_type, topic_listener);
+        if (ret < 0)
+            return ret;
+    }
 
     ctx->running = ATOMIC_INIT(1);
     return ret;
@@ -164,6 +157,26 @@ static int fini(struct context* ctx)
     return ret;
 };
 
+static void accept_datagram(struct context* ctx, const uint8_t* buf, size_t len)
+{
+    if (!synapse_batch_is_batch(buf, len)) {
+        TF_Accept(&ctx->tf, buf, len);
+        return;
+    }
+
+    // split batched datagram into frames
+    struct synapse_batch_iter it;
+    synapse_batch_iter_init(&it, buf, len);
+    const uint8_t* frame = NULL;
+    int frame_len = 0;
+    while ((frame_len = synapse_batch_next(&it, &frame)) > 0) {
+        TF_Accept(&ctx->tf, frame, frame_len);
+    }
+    if (frame_len < 0) {
+        LOG_WRN("malformed batch, len: %d", (int)len);
+    }
+}
+
 static void run(void* p0, void* p1, void* p2)
 {
     int ret = 0;
@@ -190,7 +203,7 @@ static void run(void* p0, void* p1, void* p2)
         if (received < 0) {
             LOG_ERR("connection error: %d", errno);
         } else if (received > 0) {
-            TF_Accept(&ctx->tf, ctx->udp.rx_buf, received);
+            accept_datagram(ctx, (const uint8_t*)ctx->udp.rx_buf, received);
         }
 
         // update status
@@ -1,17 +1,17 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/net/socket.h>
 
+#include <cerebri/core/instance.h>
+
 #include "udp_rx.h"
 
 LOG_MODULE_DECLARE(syn_eth_rx);
 
-#define MY_PORT 4242
-
 int udp_rx_init(struct udp_rx* ctx)
 {
     ctx->addr.sin_addr.s_addr = INADDR_ANY;
     ctx->addr.sin_family = AF_INET;
-    ctx->addr.sin_port = htons(MY_PORT);
+    ctx->addr.sin_port = htons(cerebri_instance_port(CEREBRI_PORT_SYNAPSE));
     ctx->sock = zsock_socket(((struct sockaddr*)&ctx->addr)->sa_family, SOCK_DGRAM, IPPROTO_UDP);
     if (ctx->sock < 0) {
         LOG_ERR("failed ot create UDP socket: %d", errno);
@@ -42,11 +42,11 @@ int udp_rx_fini(struct udp_rx* ctx)
 int udp_rx_receive(struct udp_rx* ctx)
 {
     uint32_t addr;
-    zsock_inet_pton(AF_INET, CONFIG_NET_CONFIG_PEER_IPV4_ADDR, &addr);
+    zsock_inet_pton(AF_INET, cerebri_instance_peer_ipv4(), &addr);
     struct sockaddr_in client_addr = {
         .sin_addr.s_addr = addr,
         .sin_family = AF_INET,
-        .sin_port = htons(MY_PORT)
+        .sin_port = htons(cerebri_instance_port(CEREBRI_PORT_SYNAPSE))
     };
     socklen_t client_addr_len = sizeof(client_addr);
     int ret = 0;
@@ -1,6 +1,8 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
 
+#include <string.h>
+
 #include <zros/private/zros_node_struct.h>
 #include <zros/private/zros_sub_struct.h>
 
@@ -17,83 +19,197 @@
 #include <synapse_tinyframe/TinyFrame.h>
 #include <synapse_tinyframe/utils.h>
 
+#include <cerebri/synapse/tf_pb.h>
+
 #define MY_STACK_SIZE 8192
 #define MY_PRIORITY 1
 
-LOG_MODULE_REGISTER(syn_eth_tx, LOG_LEVEL_DBG);
+// upper bound of tinyframe header and checksum bytes added to a payload
+#define TF_FRAME_OVERHEAD 16
 
-#define TOPIC_PUBLISHER(DATA, CLASS, TOPIC)                                   \
-    {                                                                         \
-        TF_Msg msg;                                                           \
-        TF_ClearMsg(&msg);                                                    \
-        uint8_t buf[CLASS##_size];                                            \
-        memset(buf, 0, CLASS##_size);                                         \
-        pb_ostream_t stream = pb_ostream_from_buffer((pu8)buf, sizeof(buf));  \
-        int rc = pb_encode(&stream, CLASS##_fields, DATA);                    \
-        if (rc) {                                                             \
-            msg.type = TOPIC;                                                 \
-            msg.data = buf;                                                   \
-            msg.len = stream.bytes_written;                                   \
-            TF_Send(&ctx->tf, &msg);                                          \
-        } else {                                                              \
-            printf("%s encoding failed: %s\n", #DATA, PB_GET_ERROR(&stream)); \
-        }                                                                     \
-    }
+#define CYCLE_TICKS (CONFIG_CEREBRI_SYNAPSE_ETH_TX_CYCLE_MS * CONFIG_SYS_CLOCK_TICKS_PER_SEC / 1000)
+
+LOG_MODULE_REGISTER(syn_eth_tx, LOG_LEVEL_DBG);
 
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
 static struct k_thread g_my_thread_data;
 
+// telemetry topic, scheduled against the per cycle byte budget
+struct telem_topic {
+    const struct synapse_topic_info* info;
+    void* msg;
+    // lower value is sent first
+    uint8_t priority;
+    // cycles a sample may wait for budget before it is dropped
+    uint8_t queue_depth;
+    // target downlink rate, 0 disables the topic
+    atomic_t rate_hz;
+    // scheduler state
+    struct zros_sub sub;
+    bool pending;
+    uint8_t waited;
+    uint32_t cycle_deferred;
+    int64_t ticks_next;
+    // statistics
+    uint32_t sent;
+    uint32_t deferred;
+    uint32_t dropped;
+};
+
+#define TELEM_TOPIC(NAME, PRIORITY, DEPTH, RATE)                    \
+    {                                                               \
+        .info = &synapse_topic_registry[SYNAPSE_TOPIC_ID_##NAME],   \
+        .msg = &g_ctx.NAME,                                         \
+        .priority = PRIORITY,                                       \
+        .queue_depth = DEPTH,                                       \
+        .rate_hz = ATOMIC_INIT(RATE),                               \
+    }
+
+enum {
+    TELEM_STATUS,
+    TELEM_ESTIMATOR_ODOMETRY,
+    TELEM_NAV_SAT_FIX,
+    TELEM_ACTUATORS,
+    TELEM_COUNT,
+};
+
 struct context {
     // zros node handle
     struct zros_node node;
-    // subscriptions
-    struct zros_sub
-        sub_actuators,
-        sub_estimator_odometry,
-        sub_nav_sat_fix,
-        sub_status;
     // topic data
     synapse_msgs_Actuators actuators;
     synapse_msgs_NavSatFix nav_sat_fix;
     synapse_msgs_Odometry estimator_odometry;
     synapse_msgs_Status status;
+    // telemetry table, and indices sorted by priority
+    struct telem_topic telem[TELEM_COUNT];
+    uint8_t order[TELEM_COUNT];
     // connections
     struct udp_tx udp;
     // tinyframe
     TinyFrame tf;
+    // budget cycle count
+    uint32_t cycle;
     // status
     atomic_t running;
 };
 
-static struct context g_ctx;
+static struct context g_ctx = {
+    .telem = {
+        [TELEM_STATUS] = TELEM_TOPIC(status, 0, 4, SYNAPSE_TOPIC_RATE_HZ_status),
+        [TELEM_ESTIMATOR_ODOMETRY] = TELEM_TOPIC(estimator_odometry, 1, 1,
+            SYNAPSE_TOPIC_RATE_HZ_estimator_odometry),
+        [TELEM_NAV_SAT_FIX] = TELEM_TOPIC(nav_sat_fix, 2, 2, SYNAPSE_TOPIC_RATE_HZ_nav_sat_fix),
+        // disabled by default, enable from shell
+        [TELEM_ACTUATORS] = TELEM_TOPIC(actuators, 3, 1, 0),
+    },
+};
 
 static void tf_write(TinyFrame* tf, const uint8_t* buf, uint32_t len)
 {
     struct context* ctx = tf->userdata;
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_BATCH)
+    if (ctx->udp.record_open) {
+        udp_tx_batch_append(&ctx->udp, buf, len);
+        return;
+    }
+#endif
     udp_tx_send(&ctx->udp, buf, len);
 }
 
-static void send_uptime(struct context* ctx)
+static bool tf_send_pb(struct context* ctx, TF_TYPE type,
+    const pb_msgdesc_t* fields, const void* src, size_t size)
+{
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_BATCH)
+    // frames too large for a batch fall through and are sent directly
+    if (udp_tx_batch_begin(&ctx->udp, size + TF_FRAME_OVERHEAD) == 0) {
+        bool rc = synapse_tf_send_pb_sized(&ctx->tf, type, fields, src, size);
+        udp_tx_batch_end(&ctx->udp);
+        return rc;
+    }
+#endif
+    return synapse_tf_send_pb_sized(&ctx->tf, type, fields, src, size);
+}
+
+static void send_uptime(struct context* ctx, int32_t* budget)
 {
-    TF_Msg msg;
-    TF_ClearMsg(&msg);
-    uint8_t buf[synapse_msgs_Time_size];
-    pb_ostream_t stream = pb_ostream_from_buffer((pu8)buf, sizeof(buf));
     int64_t ticks = k_uptime_ticks();
     int64_t sec = ticks / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
     int32_t nanosec = (ticks - sec * CONFIG_SYS_CLOCK_TICKS_PER_SEC) * 1e9 / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
     synapse_msgs_Time message;
     message.sec = sec;
     message.nanosec = nanosec;
-    int rc = pb_encode(&stream, synapse_msgs_Time_fields, &message);
-    if (rc) {
-        msg.type = SYNAPSE_UPTIME_TOPIC;
-        msg.data = buf;
-        msg.len = stream.bytes_written;
-        TF_Send(&ctx->tf, &msg);
-    } else {
-        printf("uptime encoding failed: %s\n", PB_GET_ERROR(&stream));
+    size_t size = 0;
+    if (!pb_get_encoded_size(&size, synapse_msgs_Time_fields, &message)
+        || !tf_send_pb(ctx, SYNAPSE_UPTIME_TOPIC, synapse_msgs_Time_fields, &message, size)) {
+        printf("uptime encoding failed\n");
+        return;
+    }
+    *budget -= size + TF_FRAME_OVERHEAD;
+}
+
+// next point of the grid after ticks that lies in the future, missed
+// periods are skipped rather than sent back to back
+static int64_t next_period(int64_t ticks, int64_t period, int64_t now)
+{
+    ticks += period;
+    if (ticks <= now) {
+        ticks += ((now - ticks) / period + 1) * period;
+    }
+    return ticks;
+}
+
+static void telem_service(struct context* ctx, struct telem_topic* t, int64_t now, int32_t* budget)
+{
+    if (zros_sub_update_available(&t->sub)) {
+        zros_sub_update(&t->sub);
+        if (!t->pending) {
+            t->pending = true;
+            t->waited = 0;
+        }
+    }
+
+    int32_t rate_hz = atomic_get(&t->rate_hz);
+    if (rate_hz <= 0) {
+        t->pending = false;
+        return;
+    }
+
+    if (!t->pending || now < t->ticks_next) {
+        return;
+    }
+
+    size_t size = 0;
+    if (!pb_get_encoded_size(&size, t->info->fields, t->msg)) {
+        printf("%s encoding failed\n", t->info->name);
+        t->pending = false;
+        return;
     }
+
+    // out of budget, hold the sample for up to queue depth cycles
+    int32_t cost = size + TF_FRAME_OVERHEAD;
+    if (cost > *budget) {
+        if (t->cycle_deferred != ctx->cycle) {
+            t->cycle_deferred = ctx->cycle;
+            t->deferred++;
+            if (++t->waited > t->queue_depth) {
+                t->pending = false;
+                t->dropped++;
+            }
+        }
+        return;
+    }
+
+    if (!tf_send_pb(ctx, t->info->tf_type, t->info->fields, t->msg, size)) {
+        printf("%s encoding failed\n", t->info->name);
+    }
+    *budget -= cost;
+    t->sent++;
+    t->pending = false;
+    t->waited = 0;
+
+    // advance on a fixed grid so rate holds without bursting after a stall
+    t->ticks_next = next_period(t->ticks_next, CONFIG_SYS_CLOCK_TICKS_PER_SEC / rate_hz, now);
 }
 
 static int init(struct context* ctx)
@@ -102,26 +218,28 @@ static int init(struct context* ctx)
     // initialize node
     zros_node_init(&ctx->node, "syn_eth_tx");
 
-    // initialize node subscriptions
-    ret = zros_sub_init(&ctx->sub_actuators, &ctx->node, &topic_actuators, &ctx->actuators, 15);
-    if (ret < 0) {
-        LOG_ERR("init actuators failed: %d", ret);
-        return ret;
-    }
-    ret = zros_sub_init(&ctx->sub_estimator_odometry, &ctx->node, &topic_estimator_odometry, &ctx->estimator_odometry, 15);
-    if (ret < 0) {
-        LOG_ERR("sub init estimator odometry failed: %d", ret);
-        return ret;
-    }
-    ret = zros_sub_init(&ctx->sub_nav_sat_fix, &ctx->node, &topic_nav_sat_fix, &ctx->nav_sat_fix, 15);
-    if (ret < 0) {
-        LOG_ERR("sub init nav_sat_fix failed: %d", ret);
-        return ret;
+    // initialize node subscriptions, rate limiting is done by the scheduler
+    for (int i = 0; i < TELEM_COUNT; i++) {
+        struct telem_topic* t = &ctx->telem[i];
+        ret = zros_sub_init(&t->sub, &ctx->node, t->info->topic, t->msg,
+            CONFIG_CEREBRI_SYNAPSE_ETH_TX_MAX_RATE_HZ);
+        if (ret < 0) {
+            LOG_ERR("sub init %s failed: %d", t->info->name, ret);
+            return ret;
+        }
+        t->pending = false;
+        t->waited = 0;
+        t->cycle_deferred = 0;
+        t->ticks_next = 0;
     }
-    ret = zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 15);
-    if (ret < 0) {
-        LOG_ERR("sub init status failed: %d", ret);
-        return ret;
+
+    // sort telemetry by priority
+    for (int i = 0; i < TELEM_COUNT; i++) {
+        int j = i;
+        for (; j > 0 && ctx->telem[ctx->order[j - 1]].priority > ctx->telem[i].priority; j--) {
+            ctx->order[j] = ctx->order[j - 1];
+        }
+        ctx->order[j] = i;
     }
 
     // initialize udp
@@ -147,13 +265,15 @@ static int init(struct context* ctx)
 static int fini(struct context* ctx)
 {
     int ret = 0;
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_BATCH)
+    udp_tx_batch_flush(&ctx->udp);
+#endif
     ret = udp_tx_fini(&ctx->udp);
 
     // close subscriptions
-    zros_sub_fini(&ctx->sub_actuators);
-    zros_sub_fini(&ctx->sub_estimator_odometry);
-    zros_sub_fini(&ctx->sub_nav_sat_fix);
-    zros_sub_fini(&ctx->sub_status);
+    for (int i = 0; i < TELEM_COUNT; i++) {
+        zros_sub_fini(&ctx->telem[i].sub);
+    }
 
     return ret;
 };
@@ -174,49 +294,59 @@ static void run(void* p0, void* p1, void* p2)
     }
 
     int64_t ticks_last_uptime = 0;
+    int64_t ticks_cycle = k_uptime_ticks();
+    int64_t ticks_wake = ticks_cycle;
+    int32_t budget = 0;
 
     LOG_INF("running");
 
-    // subscribe to topics
-
     // while running
     while (atomic_get(&ctx->running)) {
+        // wake on new samples, or when a held sample becomes due
+        struct k_poll_event events[TELEM_COUNT];
+        for (int i = 0; i < TELEM_COUNT; i++) {
+            events[i] = *zros_sub_get_event(&ctx->telem[i].sub);
+        }
+        k_poll(events, TELEM_COUNT, K_TIMEOUT_ABS_TICKS(ticks_wake));
         int64_t now = k_uptime_ticks();
 
-        struct k_poll_event events[] = {
-            *zros_sub_get_event(&ctx->sub_status),
-            *zros_sub_get_event(&ctx->sub_estimator_odometry),
-            *zros_sub_get_event(&ctx->sub_nav_sat_fix),
-        };
-
-        int rc = 0;
-        rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
-        if (rc != 0) {
-            LOG_WRN("poll timeout");
-        }
+        // refill the budget once per cycle, skip missed cycles instead of
+        // catching up
+        if (now >= ticks_cycle) {
+            ctx->cycle++;
+            budget = CONFIG_CEREBRI_SYNAPSE_ETH_TX_BUDGET_BYTES;
+            ticks_cycle = next_period(ticks_cycle, CYCLE_TICKS, now);
 
-        if (zros_sub_update_available(&ctx->sub_nav_sat_fix)) {
-            zros_sub_update(&ctx->sub_nav_sat_fix);
-            TOPIC_PUBLISHER(&ctx->nav_sat_fix, synapse_msgs_NavSatFix, SYNAPSE_NAV_SAT_FIX_TOPIC);
-        }
+            if (now - ticks_last_uptime > CONFIG_SYS_CLOCK_TICKS_PER_SEC) {
+                send_uptime(ctx, &budget);
+                ticks_last_uptime = now;
+            }
 
-        if (zros_sub_update_available(&ctx->sub_status)) {
-            zros_sub_update(&ctx->sub_status);
-            TOPIC_PUBLISHER(&ctx->status, synapse_msgs_Status, SYNAPSE_STATUS_TOPIC);
+            // tell tinyframe time has passed
+            TF_Tick(&ctx->tf);
         }
 
-        if (zros_sub_update_available(&ctx->sub_estimator_odometry)) {
-            zros_sub_update(&ctx->sub_estimator_odometry);
-            TOPIC_PUBLISHER(&ctx->estimator_odometry, synapse_msgs_Odometry, SYNAPSE_ODOMETRY_TOPIC);
+        // fill budget by priority
+        ticks_wake = ticks_cycle;
+        for (int i = 0; i < TELEM_COUNT; i++) {
+            struct telem_topic* t = &ctx->telem[ctx->order[i]];
+            telem_service(ctx, t, now, &budget);
+            // samples held by the rate limit are sent when due, samples
+            // held by the budget at the next cycle
+            if (t->pending && t->ticks_next > now) {
+                ticks_wake = MIN(ticks_wake, t->ticks_next);
+            }
         }
 
-        if (now - ticks_last_uptime > CONFIG_SYS_CLOCK_TICKS_PER_SEC) {
-            send_uptime(ctx);
-            ticks_last_uptime = now;
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_BATCH)
+        // flush the batch at its deadline, else wake up for it
+        int64_t batch_ticks_remaining = udp_tx_batch_ticks_remaining(&ctx->udp, now);
+        if (batch_ticks_remaining == 0) {
+            udp_tx_batch_flush(&ctx->udp);
+        } else if (batch_ticks_remaining > 0) {
+            ticks_wake = MIN(ticks_wake, now + batch_ticks_remaining);
         }
-
-        // tell tinyframe time has passed
-        TF_Tick(&ctx->tf);
+#endif
     }
 
     // deconstructor
@@ -264,6 +394,44 @@ static int cmd_status(const struct shell* sh,
     size_t argc, char** argv, void* data)
 {
     shell_print(sh, "running: %d", (int)atomic_get(&g_ctx.running));
+    shell_print(sh, "%-20s %4s %4s %5s %8s %8s %8s", "topic",
+        "prio", "hz", "depth", "sent", "deferred", "dropped");
+    for (int i = 0; i < TELEM_COUNT; i++) {
+        const struct telem_topic* t = &g_ctx.telem[i];
+        shell_print(sh, "%-20s %4d %4d %5d %8d %8d %8d", t->info->name,
+            t->priority, (int)atomic_get(&t->rate_hz), t->queue_depth,
+            t->sent, t->deferred, t->dropped);
+    }
+    return 0;
+}
+
+static int cmd_rate(const struct shell* sh,
+    size_t argc, char** argv)
+{
+    struct telem_topic* t = NULL;
+    for (int i = 0; i < TELEM_COUNT; i++) {
+        if (strcmp(argv[1], g_ctx.telem[i].info->name) == 0) {
+            t = &g_ctx.telem[i];
+        }
+    }
+    if (t == NULL) {
+        shell_error(sh, "unknown topic: %s", argv[1]);
+        return -EINVAL;
+    }
+
+    if (argc < 3) {
+        shell_print(sh, "%s: %d Hz", t->info->name, (int)atomic_get(&t->rate_hz));
+        return 0;
+    }
+
+    int err = 0;
+    unsigned long rate_hz = shell_strtoul(argv[2], 10, &err);
+    if (err != 0 || rate_hz > CONFIG_CEREBRI_SYNAPSE_ETH_TX_MAX_RATE_HZ) {
+        shell_error(sh, "rate must be 0-%d Hz", CONFIG_CEREBRI_SYNAPSE_ETH_TX_MAX_RATE_HZ);
+        return -EINVAL;
+    }
+    atomic_set(&t->rate_hz, rate_hz);
+    shell_print(sh, "%s: %d Hz", t->info->name, (int)rate_hz);
     return 0;
 }
 
@@ -271,6 +439,7 @@ SHELL_STATIC_SUBCMD_SET_CREATE(sub_syn_eth_tx,
     SHELL_CMD(start, NULL, "start", cmd_start),
     SHELL_CMD(stop, NULL, "stop", cmd_stop),
     SHELL_CMD(status, NULL, "status", cmd_status),
+    SHELL_CMD_ARG(rate, NULL, "get/set topic rate: rate <topic> [hz]", cmd_rate, 2, 1),
     SHELL_SUBCMD_SET_END);
 
 /* Creating root (level 0) command "demo" */
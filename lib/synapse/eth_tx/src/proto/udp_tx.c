@@ -2,19 +2,28 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/net/socket.h>
 #include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <cerebri/synapse/batch.h>
+
+#include <cerebri/core/instance.h>
 
 #include "udp_tx.h"
 
 LOG_MODULE_DECLARE(syn_eth_tx);
 
-#define MY_PORT 4242
-
 int udp_tx_init(struct udp_tx* ctx)
 {
     ctx->sock = -1;
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_BATCH)
+    ctx->batch_len = 0;
+    ctx->batch_count = 0;
+    ctx->record_open = false;
+    ctx->record_overflow = false;
+#endif
     ctx->addr.sin_addr.s_addr = INADDR_ANY;
     ctx->addr.sin_family = AF_INET;
-    ctx->addr.sin_port = htons(MY_PORT);
+    ctx->addr.sin_port = htons(cerebri_instance_port(CEREBRI_PORT_SYNAPSE));
 
     ctx->sock = zsock_socket(((struct sockaddr*)&ctx->addr)->sa_family, SOCK_DGRAM, IPPROTO_UDP);
     if (ctx->sock < 0) {
@@ -39,11 +48,11 @@ int udp_tx_send(struct udp_tx* ctx, const uint8_t* buf, size_t len)
 {
     int ret = 0;
     uint32_t addr;
-    zsock_inet_pton(AF_INET, CONFIG_NET_CONFIG_PEER_IPV4_ADDR, &addr);
+    zsock_inet_pton(AF_INET, cerebri_instance_peer_ipv4(), &addr);
     struct sockaddr_in dest_addr = {
         .sin_addr.s_addr = addr,
         .sin_family = AF_INET,
-        .sin_port = htons(MY_PORT)
+        .sin_port = htons(cerebri_instance_port(CEREBRI_PORT_SYNAPSE))
     };
 
     ret = zsock_sendto(ctx->sock, buf, len, ZSOCK_MSG_DONTWAIT,
@@ -66,4 +75,84 @@ int udp_tx_send(struct udp_tx* ctx, const uint8_t* buf, size_t len)
     return ret;
 }
 
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_BATCH)
+int udp_tx_batch_begin(struct udp_tx* ctx, size_t len)
+{
+    size_t needed = SYNAPSE_BATCH_RECORD_HEADER_SIZE + len;
+
+    // frame can never fit in a batch, caller sends it on its own
+    if (SYNAPSE_BATCH_HEADER_SIZE + needed > sizeof(ctx->batch_buf)) {
+        return -ENOSPC;
+    }
+
+    // make room for the frame
+    if (ctx->batch_len + needed > sizeof(ctx->batch_buf)
+        || ctx->batch_count == SYNAPSE_BATCH_MAX_COUNT) {
+        udp_tx_batch_flush(ctx);
+    }
+
+    // start new batch
+    if (ctx->batch_count == 0) {
+        ctx->batch_buf[0] = SYNAPSE_BATCH_MAGIC;
+        ctx->batch_len = SYNAPSE_BATCH_HEADER_SIZE;
+        ctx->batch_ticks = k_uptime_ticks();
+    }
+
+    // reserve record length, written when the record ends
+    ctx->record_start = ctx->batch_len;
+    ctx->batch_len += SYNAPSE_BATCH_RECORD_HEADER_SIZE;
+    ctx->record_open = true;
+    ctx->record_overflow = false;
+    return 0;
+}
+
+int udp_tx_batch_append(struct udp_tx* ctx, const uint8_t* buf, size_t len)
+{
+    if (ctx->batch_len + len > sizeof(ctx->batch_buf)) {
+        LOG_ERR("batch overflow, dropping frame");
+        ctx->record_overflow = true;
+        return -ENOSPC;
+    }
+    memcpy(&ctx->batch_buf[ctx->batch_len], buf, len);
+    ctx->batch_len += len;
+    return 0;
+}
+
+void udp_tx_batch_end(struct udp_tx* ctx)
+{
+    size_t len = ctx->batch_len - ctx->record_start - SYNAPSE_BATCH_RECORD_HEADER_SIZE;
+    if (ctx->record_overflow || len == 0) {
+        // discard partial record
+        ctx->batch_len = ctx->record_start;
+    } else {
+        sys_put_le16(len, &ctx->batch_buf[ctx->record_start]);
+        ctx->batch_count++;
+    }
+    ctx->record_open = false;
+    ctx->record_overflow = false;
+}
+
+int udp_tx_batch_flush(struct udp_tx* ctx)
+{
+    int ret = 0;
+    if (ctx->batch_count > 0) {
+        ctx->batch_buf[1] = ctx->batch_count;
+        ret = udp_tx_send(ctx, ctx->batch_buf, ctx->batch_len);
+    }
+    ctx->batch_len = 0;
+    ctx->batch_count = 0;
+    return ret;
+}
+
+int64_t udp_tx_batch_ticks_remaining(struct udp_tx* ctx, int64_t now)
+{
+    if (ctx->batch_count == 0) {
+        return -1;
+    }
+    int64_t deadline = ctx->batch_ticks
+        + CONFIG_CEREBRI_SYNAPSE_ETH_TX_BATCH_DEADLINE_MS * CONFIG_SYS_CLOCK_TICKS_PER_SEC / 1000;
+    return MAX(deadline - now, 0);
+}
+#endif
+
 // vi: ts=4 sw=4 et
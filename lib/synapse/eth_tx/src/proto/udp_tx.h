@@ -6,11 +6,28 @@
 struct udp_tx {
     int sock;
     struct sockaddr_in addr;
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_BATCH)
+    uint8_t batch_buf[CONFIG_CEREBRI_SYNAPSE_ETH_TX_BATCH_SIZE];
+    size_t batch_len;
+    size_t record_start;
+    uint8_t batch_count;
+    int64_t batch_ticks;
+    bool record_open;
+    bool record_overflow;
+#endif
 };
 
 int udp_tx_init(struct udp_tx* ctx);
 int udp_tx_fini(struct udp_tx* ctx);
 int udp_tx_send(struct udp_tx* ctx, const uint8_t* buf, size_t len);
 
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_BATCH)
+int udp_tx_batch_begin(struct udp_tx* ctx, size_t len);
+int udp_tx_batch_append(struct udp_tx* ctx, const uint8_t* buf, size_t len);
+void udp_tx_batch_end(struct udp_tx* ctx);
+int udp_tx_batch_flush(struct udp_tx* ctx);
+int64_t udp_tx_batch_ticks_remaining(struct udp_tx* ctx, int64_t now);
+#endif
+
 #endif // SYNAPSE_UDP_UDP_TX_H_
 // vi: ts=4 sw=4 et
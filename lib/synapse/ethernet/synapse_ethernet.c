@@ -19,6 +19,9 @@
 #include <synapse_tinyframe/TinyFrame.h>
 #include <synapse_tinyframe/utils.h>
 
+#include <cerebri/core/instance.h>
+#include <cerebri/synapse/tf_pb.h>
+
 #include <zros/private/zros_node_struct.h>
 #include <zros/private/zros_sub_struct.h>
 #include <zros/zros_node.h>
@@ -34,7 +37,6 @@ LOG_MODULE_REGISTER(synapse_ethernet, CONFIG_CEREBRI_SYNAPSE_ETHERNET_LOG_LEVEL)
 #define MY_PRIORITY 3
 
 #define RX_BUF_SIZE 2048
-#define BIND_PORT 4242
 
 typedef struct context_s {
     struct zros_node node;
@@ -76,36 +78,31 @@ static context_t g_ctx = {
     .error_count = 0,
 };
 
-#define TOPIC_LISTENER(CHANNEL, CLASS)                                            \
-    static TF_Result CHANNEL##_listener(TinyFrame* tf, TF_Msg* frame)             \
-    {                                                                             \
-        CLASS msg = CLASS##_init_default;                                         \
-        pb_istream_t stream = pb_istream_from_buffer(frame->data, frame->len);    \
-        int rc = pb_decode(&stream, CLASS##_fields, &msg);                        \
-        if (rc) {                                                                 \
-            zros_topic_publish(&topic_##CHANNEL, &msg);                           \
-            LOG_DBG("%s decoding\n", #CHANNEL);                                   \
-        } else {                                                                  \
-            LOG_WRN("%s decoding failed: %s\n", #CHANNEL, PB_GET_ERROR(&stream)); \
-        }                                                                         \
-        return TF_STAY;                                                           \
+static TF_Result topic_listener(TinyFrame* tf, TF_Msg* frame)
+{
+    const struct synapse_topic_info* info = synapse_topic_from_tf(frame->type);
+    if (info == NULL) {
+        return TF_STAY;
     }
+    // only used by the ethernet thread
+    static union synapse_topic_msg msg;
+    memset(&msg, 0, info->msg_size);
+    pb_istream_t stream = pb_istream_from_buffer(frame->data, frame->len);
+    int rc = pb_decode(&stream, info->fields, &msg);
+    if (rc) {
+        zros_topic_publish(info->topic, &msg);
+        LOG_DBG("%s decoding\n", info->name);
+    } else {
+        LOG_WRN("%s decoding failed: %s\n", info->name, PB_GET_ERROR(&stream));
+    }
+    return TF_STAY;
+}
 
-#define TOPIC_PUBLISHER(DATA, CLASS, TOPIC)                                   \
-    {                                                                         \
-        TF_Msg msg;                                                           \
-        TF_ClearMsg(&msg);                                                    \
-        uint8_t buf[CLASS##_size];                                            \
-        pb_ostream_t stream = pb_ostream_from_buffer((pu8)buf, sizeof(buf));  \
-        int rc = pb_encode(&stream, CLASS##_fields, DATA);                    \
-        if (rc) {                                                             \
-            msg.type = TOPIC;                                                 \
-            msg.data = buf;                                                   \
-            msg.len = stream.bytes_written;                                   \
-            TF_Send(&ctx->tf, &msg);                                          \
-        } else {                                                              \
-            printf("%s encoding failed: %s\n", #DATA, PB_GET_ERROR(&stream)); \
-        }                                                                     \
+#define TOPIC_PUBLISHER(DATA, CLASS, TOPIC)                                \
+    {                                                                      \
+        if (!synapse_tf_send_pb(&ctx->tf, TOPIC, CLASS##_fields, DATA)) {  \
+            printf("%s encoding failed\n", #DATA);                         \
+        }                                                                  \
     }
 
 static void write_ethernet(TinyFrame* tf, const uint8_t* buf, uint32_t len)
@@ -163,24 +160,22 @@ static TF_Result genericListener(TinyFrame* tf, TF_Msg* msg)
     return TF_STAY;
 }
 
-// ROS -> Cerebri
-// TOPIC_LISTENER(actuators, synapse_msgs_Actuators)
-// TOPIC_LISTENER(altimeter, synapse_msgs_Altimeter)
-// TOPIC_LISTENER(external_odometry, synapse_msgs_Odometry)
-TOPIC_LISTENER(bezier_trajectory, synapse_msgs_BezierTrajectory)
-// cmd_vel requires custom
-// TOPIC_LISTENER(cmd_vel, synapse_msgs_Twist)
-TOPIC_LISTENER(joy, synapse_msgs_Joy)
-// TOPIC_LISTENER(led_array, synapse_msgs_LEDArray)
-TOPIC_LISTENER(clock_offset, synapse_msgs_Time)
-
+// ROS -> Cerebri, cmd_vel requires custom listener
+static const enum synapse_topic_id g_rx_topics[] = {
+    SYNAPSE_TOPIC_ID_bezier_trajectory,
+    SYNAPSE_TOPIC_ID_joy,
+    SYNAPSE_TOPIC_ID_clock_offset,
+#ifdef CONFIG_CEREBRI_CORE_BEZIER_PLANNER
+    SYNAPSE_TOPIC_ID_bezier_waypoints,
+#endif
 #ifdef CONFIG_CEREBRI_DREAM_HIL
-TOPIC_LISTENER(battery_state, synapse_msgs_BatteryState)
-TOPIC_LISTENER(imu, synapse_msgs_Imu)
-TOPIC_LISTENER(magnetic_field, synapse_msgs_MagneticField)
-TOPIC_LISTENER(nav_sat_fix, synapse_msgs_NavSatFix)
-TOPIC_LISTENER(wheel_odometry, synapse_msgs_WheelOdometry)
+    SYNAPSE_TOPIC_ID_battery_state,
+    SYNAPSE_TOPIC_ID_imu,
+    SYNAPSE_TOPIC_ID_magnetic_field,
+    SYNAPSE_TOPIC_ID_nav_sat_fix,
+    SYNAPSE_TOPIC_ID_wheel_odometry,
 #endif
+};
 
 static bool set_blocking_enabled(int fd, bool blocking)
 {
@@ -205,24 +200,14 @@ static void synapse_ethernet_init(context_t* ctx)
 
 static void send_uptime(context_t* ctx)
 {
-    TF_Msg msg;
-    TF_ClearMsg(&msg);
-    uint8_t buf[synapse_msgs_Time_size];
-    pb_ostream_t stream = pb_ostream_from_buffer((pu8)buf, sizeof(buf));
     int64_t ticks = k_uptime_ticks();
     int64_t sec = ticks / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
     int32_t nanosec = (ticks - sec * CONFIG_SYS_CLOCK_TICKS_PER_SEC) * 1e9 / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
     synapse_msgs_Time message;
     message.sec = sec;
     message.nanosec = nanosec;
-    int rc = pb_encode(&stream, synapse_msgs_Time_fields, &message);
-    if (rc) {
-        msg.type = SYNAPSE_UPTIME_TOPIC;
-        msg.data = buf;
-        msg.len = stream.bytes_written;
-        TF_Send(&ctx->tf, &msg);
-    } else {
-        printf("uptime encoding failed: %s\n", PB_GET_ERROR(&stream));
+    if (!synapse_tf_send_pb(&ctx->tf, SYNAPSE_UPTIME_TOPIC, synapse_msgs_Time_fields, &message)) {
+        printf("uptime encoding failed\n");
     }
 }
 
@@ -243,7 +228,7 @@ static void ethernet_entry_point(context_t* ctx)
 
     ctx->bind_addr.sin_family = AF_INET;
     ctx->bind_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    ctx->bind_addr.sin_port = htons(BIND_PORT);
+    ctx->bind_addr.sin_port = htons(cerebri_instance_port(CEREBRI_PORT_SYNAPSE));
 
     if (zsock_bind(ctx->serv, (struct sockaddr*)&ctx->bind_addr, sizeof(ctx->bind_addr)) < 0) {
         LOG_ERR("bind: %d", errno);
@@ -257,25 +242,14 @@ static void ethernet_entry_point(context_t* ctx)
 
     // ROS -> Cerebri
     TF_AddGenericListener(&ctx->tf, genericListener);
-    // TF_AddTypeListener(&ctx->tf, SYNAPSE_ACTUATORS_TOPIC, actuators_listener);
-    // TF_AddTypeListener(&ctx->tf, SYNAPSE_ALTIMETER_TOPIC, altimeter_listener);
-    // TF_AddTypeListener(&ctx->tf, SYNAPSE_ODOMETRY_TOPIC, external_odometry_listener);
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_BEZIER_TRAJECTORY_TOPIC, bezier_trajectory_listener);
     TF_AddTypeListener(&ctx->tf, SYNAPSE_CMD_VEL_TOPIC, cmd_vel_listener);
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_JOY_TOPIC, joy_listener);
-    // TF_AddTypeListener(&ctx->tf, SYNAPSE_LED_ARRAY_TOPIC, led_array_listener);
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_CLOCK_OFFSET_TOPIC, clock_offset_listener);
-
-#ifdef CONFIG_CEREBRI_DREAM_HIL
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_BATTERY_STATE_TOPIC, battery_state_listener);
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_IMU_TOPIC, imu_listener);
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_MAGNETIC_FIELD_TOPIC, magnetic_field_listener);
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_NAV_SAT_FIX_TOPIC, nav_sat_fix_listener);
-    TF_AddTypeListener(&ctx->tf, SYNAPSE_WHEEL_ODOMETRY_TOPIC, wheel_odometry_listener);
-#endif
+    for (size_t i = 0; i < ARRAY_SIZE(g_rx_topics); i++) {
+        TF_AddTypeListener(&ctx->tf, synapse_topic_registry[g_rx_topics[i]].tf_type, topic_listener);
+    }
 
     while (1) {
-        LOG_INF("socket waiting for connection on port: %d", BIND_PORT);
+        LOG_INF("socket waiting for connection on port: %d",
+            cerebri_instance_port(CEREBRI_PORT_SYNAPSE));
         struct sockaddr_in client_addr;
         socklen_t client_addr_len = sizeof(client_addr);
         char addr_str[32];
@@ -0,0 +1,94 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+
+#include <zephyr/fs/fs.h>
+#include <zephyr/logging/log.h>
+
+#include <cerebri/synapse/log_format.h>
+
+#include "log_backend.h"
+
+LOG_MODULE_DECLARE(synapse_log);
+
+// file system backend, flash/SD on target
+
+static struct fs_file_t g_file;
+static bool g_open = false;
+static size_t g_length = 0;
+
+static int write_header(void)
+{
+    struct synapse_log_header header = {
+        .version = SYNAPSE_LOG_VERSION,
+        .header_size = sizeof(struct synapse_log_header),
+        .length = g_length,
+    };
+    memcpy(header.magic, SYNAPSE_LOG_MAGIC, sizeof(header.magic));
+
+    int ret = fs_seek(&g_file, 0, FS_SEEK_SET);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = fs_write(&g_file, &header, sizeof(header));
+    if (ret < 0) {
+        return ret;
+    }
+    return ret == sizeof(header) ? 0 : -ENOSPC;
+}
+
+int log_backend_open(void)
+{
+    fs_file_t_init(&g_file);
+    int ret = fs_open(&g_file, CONFIG_CEREBRI_SYNAPSE_LOG_PATH, FS_O_CREATE | FS_O_RDWR);
+    if (ret < 0) {
+        LOG_ERR("failed to open %s: %d", CONFIG_CEREBRI_SYNAPSE_LOG_PATH, ret);
+        return ret;
+    }
+    g_open = true;
+    g_length = 0;
+
+    ret = fs_truncate(&g_file, 0);
+    if (ret == 0) {
+        ret = write_header();
+    }
+    if (ret < 0) {
+        LOG_ERR("failed to write header: %d", ret);
+        fs_close(&g_file);
+        g_open = false;
+        return ret;
+    }
+    LOG_INF("logging to %s", CONFIG_CEREBRI_SYNAPSE_LOG_PATH);
+    return 0;
+}
+
+int log_backend_write(const uint8_t* buf, size_t len)
+{
+    if (!g_open) {
+        return -EBADF;
+    }
+    ssize_t ret = fs_write(&g_file, buf, len);
+    if (ret < 0) {
+        return ret;
+    } else if (ret != len) {
+        return -ENOSPC;
+    }
+    g_length += len;
+    // keep the log readable after a power loss
+    return fs_sync(&g_file);
+}
+
+int log_backend_close(void)
+{
+    if (!g_open) {
+        return 0;
+    }
+    int ret = write_header();
+    int ret_close = fs_close(&g_file);
+    g_open = false;
+    return ret < 0 ? ret : ret_close;
+}
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,118 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerebri/core/instance.h>
+#include <cerebri/synapse/log_format.h>
+
+#include "log_backend.h"
+
+// native_sim backend, compiled for the host, appends to an mmap'd file
+// that grows in CONFIG_CEREBRI_SYNAPSE_LOG_NATIVE_CHUNK_SIZE steps
+
+#define CHUNK_SIZE CONFIG_CEREBRI_SYNAPSE_LOG_NATIVE_CHUNK_SIZE
+
+static int g_fd = -1;
+static uint8_t* g_map = NULL;
+static size_t g_map_size = 0;
+static size_t g_offset = 0;
+
+static struct synapse_log_header* header(void)
+{
+    return (struct synapse_log_header*)g_map;
+}
+
+static int reserve(size_t size)
+{
+    if (size <= g_map_size) {
+        return 0;
+    }
+    size_t new_size = ((size + CHUNK_SIZE - 1) / CHUNK_SIZE) * CHUNK_SIZE;
+    if (ftruncate(g_fd, new_size) < 0) {
+        return -errno;
+    }
+    void* map = g_map == NULL
+        ? mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, g_fd, 0)
+        : mremap(g_map, g_map_size, new_size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) {
+        return -errno;
+    }
+    g_map = map;
+    g_map_size = new_size;
+    return 0;
+}
+
+int log_backend_open(void)
+{
+    char path[256];
+    if (g_cerebri_instance.id == 0) {
+        snprintf(path, sizeof(path), "%s", CONFIG_CEREBRI_SYNAPSE_LOG_PATH);
+    } else {
+        snprintf(path, sizeof(path), "%s.%d", CONFIG_CEREBRI_SYNAPSE_LOG_PATH, g_cerebri_instance.id);
+    }
+
+    g_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (g_fd < 0) {
+        printf("synapse_log: failed to open %s: %d\n", path, errno);
+        return -errno;
+    }
+
+    int ret = reserve(sizeof(struct synapse_log_header));
+    if (ret < 0) {
+        printf("synapse_log: failed to map %s: %d\n", path, ret);
+        close(g_fd);
+        g_fd = -1;
+        return ret;
+    }
+
+    memcpy(header()->magic, SYNAPSE_LOG_MAGIC, sizeof(header()->magic));
+    header()->version = SYNAPSE_LOG_VERSION;
+    header()->header_size = sizeof(struct synapse_log_header);
+    header()->length = 0;
+    g_offset = sizeof(struct synapse_log_header);
+    printf("synapse_log: logging to %s\n", path);
+    return 0;
+}
+
+int log_backend_write(const uint8_t* buf, size_t len)
+{
+    if (g_map == NULL) {
+        return -EBADF;
+    }
+    int ret = reserve(g_offset + len);
+    if (ret < 0) {
+        return ret;
+    }
+    memcpy(&g_map[g_offset], buf, len);
+    g_offset += len;
+    // readers may follow the log while it is written
+    header()->length = g_offset - sizeof(struct synapse_log_header);
+    return 0;
+}
+
+int log_backend_close(void)
+{
+    if (g_map == NULL) {
+        return 0;
+    }
+    header()->length = g_offset - sizeof(struct synapse_log_header);
+    msync(g_map, g_map_size, MS_SYNC);
+    munmap(g_map, g_map_size);
+    g_map = NULL;
+    g_map_size = 0;
+
+    // drop the unused tail of the last chunk
+    int ret = ftruncate(g_fd, g_offset) < 0 ? -errno : 0;
+    close(g_fd);
+    g_fd = -1;
+    return ret;
+}
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,30 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_LOG_BACKEND_H_
+#define SYNAPSE_LOG_BACKEND_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Storage of the flight log, not thread safe, calls are serialized by
+ * ordering rather than a lock. open and close run on the logger
+ * thread, open before any flush work is submitted and close after the
+ * flush work is drained with k_work_flush, write only runs in the
+ * flush work in between. The file system backend writes to flash/SD
+ * on target, on native_sim the log is an mmap'd host file.
+ */
+
+// create the log file and write its header, returns 0 or negative errno
+int log_backend_open(void);
+
+// append record bytes, returns 0 or negative errno
+int log_backend_write(const uint8_t* buf, size_t len);
+
+// update the header length and close
+int log_backend_close(void);
+
+#endif // SYNAPSE_LOG_BACKEND_H_
+// vi: ts=4 sw=4 et
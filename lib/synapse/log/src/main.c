@@ -0,0 +1,402 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+
+#include <string.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_sub_struct.h>
+#include <zros/zros_node.h>
+#include <zros/zros_sub.h>
+
+#include <pb_encode.h>
+
+#include <synapse_topic_list.h>
+
+#include <cerebri/synapse/log_format.h>
+
+#include "log_backend.h"
+
+LOG_MODULE_REGISTER(synapse_log, CONFIG_CEREBRI_SYNAPSE_LOG_LOG_LEVEL);
+
+#define MY_STACK_SIZE 4096
+#define MY_PRIORITY 12
+
+#define FLUSH_STACK_SIZE 2048
+#define FLUSH_PRIORITY 13
+
+#define BLOCK_SIZE CONFIG_CEREBRI_SYNAPSE_LOG_BLOCK_SIZE
+#define BLOCK_COUNT CONFIG_CEREBRI_SYNAPSE_LOG_BLOCK_COUNT
+
+BUILD_ASSERT(SYNAPSE_TOPIC_ID_COUNT <= UINT8_MAX, "topic id must fit the log record");
+
+static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+static struct k_thread g_my_thread_data;
+
+static K_THREAD_STACK_DEFINE(g_flush_stack_area, FLUSH_STACK_SIZE);
+static struct k_work_q g_flush_work_q;
+
+/*
+ * Records are encoded by the logger thread into a ring of preallocated
+ * blocks. Full blocks are written out by a work item on a low priority
+ * queue, so storage latency never blocks the logger or the threads
+ * publishing the topics. If every block is waiting to be written the
+ * record is dropped and counted.
+ */
+struct log_block {
+    uint8_t data[BLOCK_SIZE];
+    size_t used;
+};
+
+struct context {
+    // zros node handle
+    struct zros_node node;
+    struct zros_sub sub[SYNAPSE_TOPIC_ID_COUNT];
+    // zros subscriptions copy into this, updates are handled one at a time
+    union synapse_topic_msg msg;
+    // topics to log
+    ATOMIC_DEFINE(enabled, SYNAPSE_TOPIC_ID_COUNT);
+    // blocks, head is being filled, [tail, head) wait to be written
+    struct log_block block[BLOCK_COUNT];
+    atomic_t head;
+    atomic_t tail;
+    int64_t ticks_block;
+    struct k_work flush_work;
+    // status
+    atomic_t running;
+    struct k_sem start_sem;
+    // statistics
+    atomic_t records;
+    atomic_t dropped;
+    atomic_t bytes_written;
+    atomic_t write_errors;
+};
+
+static void flush_work_handler(struct k_work* work);
+
+static struct context g_ctx = {
+    .head = ATOMIC_INIT(0),
+    .tail = ATOMIC_INIT(0),
+    .flush_work = Z_WORK_INITIALIZER(flush_work_handler),
+    .running = ATOMIC_INIT(0),
+    .start_sem = Z_SEM_INITIALIZER(g_ctx.start_sem, 0, 1),
+};
+
+static struct log_block* block_get(struct context* ctx, atomic_val_t index)
+{
+    return &ctx->block[index % BLOCK_COUNT];
+}
+
+static void flush_work_handler(struct k_work* work)
+{
+    struct context* ctx = CONTAINER_OF(work, struct context, flush_work);
+    while (atomic_get(&ctx->tail) != atomic_get(&ctx->head)) {
+        struct log_block* block = block_get(ctx, atomic_get(&ctx->tail));
+        int ret = log_backend_write(block->data, block->used);
+        if (ret < 0) {
+            atomic_inc(&ctx->write_errors);
+        } else {
+            atomic_add(&ctx->bytes_written, block->used);
+        }
+        atomic_inc(&ctx->tail);
+    }
+}
+
+// hand the block being filled to the flush work, false if the ring is full
+static bool block_close(struct context* ctx)
+{
+    atomic_val_t head = atomic_get(&ctx->head);
+    if (head + 1 - atomic_get(&ctx->tail) >= BLOCK_COUNT) {
+        return false;
+    }
+    block_get(ctx, head + 1)->used = 0;
+    atomic_set(&ctx->head, head + 1);
+    ctx->ticks_block = k_uptime_ticks();
+    k_work_submit_to_queue(&g_flush_work_q, &ctx->flush_work);
+    return true;
+}
+
+// reserve space for a record and write its header, returns the payload or NULL
+static uint8_t* record_begin(struct context* ctx, uint8_t topic, uint8_t kind, size_t len)
+{
+    size_t size = sizeof(struct synapse_log_record) + len;
+    if (size > BLOCK_SIZE) {
+        atomic_inc(&ctx->dropped);
+        return NULL;
+    }
+
+    struct log_block* block = block_get(ctx, atomic_get(&ctx->head));
+    if (block->used + size > BLOCK_SIZE) {
+        if (!block_close(ctx)) {
+            atomic_inc(&ctx->dropped);
+            return NULL;
+        }
+        block = block_get(ctx, atomic_get(&ctx->head));
+    }
+
+    struct synapse_log_record record = {
+        .len = len,
+        .topic = topic,
+        .kind = kind,
+        .stamp_ns = k_ticks_to_ns_floor64(k_uptime_ticks()),
+    };
+    memcpy(&block->data[block->used], &record, sizeof(record));
+    return &block->data[block->used + sizeof(record)];
+}
+
+static void record_end(struct context* ctx, size_t len)
+{
+    block_get(ctx, atomic_get(&ctx->head))->used += sizeof(struct synapse_log_record) + len;
+    atomic_inc(&ctx->records);
+}
+
+static void log_topic_name(struct context* ctx, int id)
+{
+    const char* name = synapse_topic_registry[id].name;
+    size_t len = strlen(name);
+    uint8_t* payload = record_begin(ctx, id, SYNAPSE_LOG_KIND_TOPIC, len);
+    if (payload != NULL) {
+        memcpy(payload, name, len);
+        record_end(ctx, len);
+    }
+}
+
+static void log_msg(struct context* ctx, int id)
+{
+    const struct synapse_topic_info* info = &synapse_topic_registry[id];
+    size_t size = 0;
+    if (!pb_get_encoded_size(&size, info->fields, &ctx->msg)) {
+        LOG_ERR("%s encoding failed", info->name);
+        return;
+    }
+
+    // encode straight into the block
+    uint8_t* payload = record_begin(ctx, id, SYNAPSE_LOG_KIND_MSG, size);
+    if (payload == NULL) {
+        return;
+    }
+    pb_ostream_t stream = pb_ostream_from_buffer(payload, size);
+    if (!pb_encode(&stream, info->fields, &ctx->msg)) {
+        LOG_ERR("%s encoding failed: %s", info->name, PB_GET_ERROR(&stream));
+        return;
+    }
+    record_end(ctx, size);
+}
+
+static int enable_topic(struct context* ctx, const char* name)
+{
+    for (int i = 0; i < SYNAPSE_TOPIC_ID_COUNT; i++) {
+        if (strcmp(name, synapse_topic_registry[i].name) == 0) {
+            atomic_set_bit(ctx->enabled, i);
+            return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+static void enable_default_topics(struct context* ctx)
+{
+    char topics[] = CONFIG_CEREBRI_SYNAPSE_LOG_TOPICS;
+    char* save = NULL;
+    for (char* name = strtok_r(topics, " ,", &save); name != NULL;
+         name = strtok_r(NULL, " ,", &save)) {
+        if (enable_topic(ctx, name) < 0) {
+            LOG_WRN("unknown topic: %s", name);
+        }
+    }
+}
+
+static int init(struct context* ctx, struct k_poll_event* events, uint8_t* event_topic, int* n_events)
+{
+    int ret = log_backend_open();
+    if (ret < 0) {
+        return ret;
+    }
+
+    atomic_set(&ctx->head, 0);
+    atomic_set(&ctx->tail, 0);
+    ctx->block[0].used = 0;
+    ctx->ticks_block = k_uptime_ticks();
+
+    // subscribe at full rate to the enabled topics
+    *n_events = 0;
+    for (int i = 0; i < SYNAPSE_TOPIC_ID_COUNT; i++) {
+        if (!atomic_test_bit(ctx->enabled, i)) {
+            continue;
+        }
+        ret = zros_sub_init(&ctx->sub[i], &ctx->node, synapse_topic_registry[i].topic,
+            &ctx->msg, CONFIG_CEREBRI_SYNAPSE_LOG_MAX_RATE_HZ);
+        if (ret < 0) {
+            LOG_ERR("sub init %s failed: %d", synapse_topic_registry[i].name, ret);
+            continue;
+        }
+        events[*n_events] = *zros_sub_get_event(&ctx->sub[i]);
+        event_topic[*n_events] = i;
+        (*n_events)++;
+        log_topic_name(ctx, i);
+    }
+    return 0;
+}
+
+static int fini(struct context* ctx, const uint8_t* event_topic, int n_events)
+{
+    for (int i = 0; i < n_events; i++) {
+        zros_sub_fini(&ctx->sub[event_topic[i]]);
+    }
+
+    // write the partial block, then wait for the flush to finish
+    if (block_get(ctx, atomic_get(&ctx->head))->used > 0) {
+        while (!block_close(ctx)) {
+            k_msleep(10);
+        }
+    }
+    k_work_submit_to_queue(&g_flush_work_q, &ctx->flush_work);
+    struct k_work_sync sync;
+    k_work_flush(&ctx->flush_work, &sync);
+    return log_backend_close();
+}
+
+static void run(void* p0, void* p1, void* p2)
+{
+    struct context* ctx = p0;
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+
+    static struct k_poll_event events[SYNAPSE_TOPIC_ID_COUNT];
+    static uint8_t event_topic[SYNAPSE_TOPIC_ID_COUNT];
+    const k_timeout_t flush_period = K_MSEC(CONFIG_CEREBRI_SYNAPSE_LOG_FLUSH_MS);
+
+    zros_node_init(&ctx->node, "synapse_log");
+    enable_default_topics(ctx);
+    if (IS_ENABLED(CONFIG_CEREBRI_SYNAPSE_LOG_AUTOSTART)) {
+        atomic_set(&ctx->running, 1);
+        k_sem_give(&ctx->start_sem);
+    }
+
+    while (true) {
+        k_sem_take(&ctx->start_sem, K_FOREVER);
+
+        int n_events = 0;
+        int ret = init(ctx, events, event_topic, &n_events);
+        if (ret < 0) {
+            LOG_ERR("init failed: %d", ret);
+            atomic_set(&ctx->running, 0);
+            continue;
+        }
+        LOG_INF("logging %d topics", n_events);
+
+        while (atomic_get(&ctx->running)) {
+            k_poll(events, n_events, flush_period);
+
+            for (int i = 0; i < n_events; i++) {
+                struct zros_sub* sub = &ctx->sub[event_topic[i]];
+                if (zros_sub_update_available(sub)) {
+                    zros_sub_update(sub);
+                    log_msg(ctx, event_topic[i]);
+                }
+                events[i].state = K_POLL_STATE_NOT_READY;
+            }
+
+            // write partial blocks periodically, bounds data lost on a crash
+            if (k_uptime_ticks() - ctx->ticks_block > k_ms_to_ticks_ceil64(CONFIG_CEREBRI_SYNAPSE_LOG_FLUSH_MS)
+                && block_get(ctx, atomic_get(&ctx->head))->used > 0) {
+                block_close(ctx);
+            }
+        }
+
+        ret = fini(ctx, event_topic, n_events);
+        if (ret < 0) {
+            LOG_ERR("fini failed: %d", ret);
+        }
+        LOG_INF("stopped");
+    }
+}
+
+static int start()
+{
+    struct k_work_queue_config flush_cfg = {
+        .name = "synapse_log_flush",
+    };
+    k_work_queue_start(&g_flush_work_q, g_flush_stack_area,
+        K_THREAD_STACK_SIZEOF(g_flush_stack_area), FLUSH_PRIORITY, &flush_cfg);
+
+    k_tid_t tid = k_thread_create(&g_my_thread_data, g_my_stack_area,
+        K_THREAD_STACK_SIZEOF(g_my_stack_area),
+        run,
+        &g_ctx, NULL, NULL,
+        MY_PRIORITY, 0, K_FOREVER);
+    k_thread_name_set(tid, "synapse_log");
+    k_thread_start(tid);
+    return 0;
+}
+
+static int cmd_start(const struct shell* sh, size_t argc, char** argv)
+{
+    if (atomic_get(&g_ctx.running)) {
+        shell_print(sh, "already running");
+        return 0;
+    }
+
+    // topics given replace the enabled set
+    if (argc > 1) {
+        for (int i = 0; i < SYNAPSE_TOPIC_ID_COUNT; i++) {
+            atomic_clear_bit(g_ctx.enabled, i);
+        }
+        for (size_t i = 1; i < argc; i++) {
+            if (enable_topic(&g_ctx, argv[i]) < 0) {
+                shell_error(sh, "unknown topic: %s", argv[i]);
+                return -EINVAL;
+            }
+        }
+    }
+
+    atomic_set(&g_ctx.running, 1);
+    k_sem_give(&g_ctx.start_sem);
+    return 0;
+}
+
+static int cmd_stop(const struct shell* sh, size_t argc, char** argv)
+{
+    if (!atomic_get(&g_ctx.running)) {
+        shell_print(sh, "not running");
+        return 0;
+    }
+    atomic_set(&g_ctx.running, 0);
+    return 0;
+}
+
+static int cmd_status(const struct shell* sh, size_t argc, char** argv)
+{
+    shell_print(sh, "running: %d", (int)atomic_get(&g_ctx.running));
+    shell_fprintf(sh, SHELL_NORMAL, "topics:");
+    for (int i = 0; i < SYNAPSE_TOPIC_ID_COUNT; i++) {
+        if (atomic_test_bit(g_ctx.enabled, i)) {
+            shell_fprintf(sh, SHELL_NORMAL, " %s", synapse_topic_registry[i].name);
+        }
+    }
+    shell_print(sh, "");
+    shell_print(sh, "records: %d", (int)atomic_get(&g_ctx.records));
+    shell_print(sh, "dropped: %d", (int)atomic_get(&g_ctx.dropped));
+    shell_print(sh, "bytes written: %d", (int)atomic_get(&g_ctx.bytes_written));
+    shell_print(sh, "write errors: %d", (int)atomic_get(&g_ctx.write_errors));
+    shell_print(sh, "blocks pending: %d/%d",
+        (int)(atomic_get(&g_ctx.head) - atomic_get(&g_ctx.tail)), BLOCK_COUNT);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_synapse_log,
+    SHELL_CMD_ARG(start, NULL, "start logging: start [topic ...]", cmd_start, 1, 16),
+    SHELL_CMD(stop, NULL, "stop logging", cmd_stop),
+    SHELL_CMD(status, NULL, "status", cmd_status),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(synapse_log, &sub_synapse_log, "synapse flight log commands", NULL);
+
+SYS_INIT(start, APPLICATION, 0);
+
+// vi: ts=4 sw=4 et
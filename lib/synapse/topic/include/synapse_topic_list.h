@@ -5,8 +5,13 @@
 #ifndef SYNAPSE_TOPIC_LIST_H
 #define SYNAPSE_TOPIC_LIST_H
 
+#include <zephyr/sys/util_macro.h>
+
 #include <zros/zros_topic.h>
 
+#include <pb.h>
+#include <synapse_tinyframe/SynapseTopics.h>
+
 #include <synapse_protobuf/actuators.pb.h>
 #include <synapse_protobuf/altimeter.pb.h>
 #include <synapse_protobuf/battery_state.pb.h>
@@ -52,26 +57,108 @@ enum {
     JOY_AXES_YAW = 4,
 };
 
+/********************************************************************
+ * topic dictionary
+ *
+ * (name, message class, tinyframe type, snprint function, default rate hz,
+ *  sim input)
+ *
+ * sim input is 1 for the topics the simulator publishes in SIL, see
+ * lib/dream/sil/sil_context.h.
+ *
+ * Adding a topic to this list declares and defines it, registers it with
+ * the broker, and makes it available to the shell and synapse links.
+ ********************************************************************/
+#define SYNAPSE_TOPIC_TF_NONE (-1)
+
+// the waypoints of the onboard planner have no synapse_tinyframe type yet
+#define SYNAPSE_TOPIC_TF_BEZIER_WAYPOINTS CONFIG_CEREBRI_SYNAPSE_TOPIC_BEZIER_WAYPOINTS_TF
+
+#define SYNAPSE_TOPIC_DICTIONARY()                                                                                \
+    (actuators, synapse_msgs_Actuators, SYNAPSE_ACTUATORS_TOPIC, snprint_actuators, 15, 0),                       \
+        (actuators_manual, synapse_msgs_Actuators, SYNAPSE_TOPIC_TF_NONE, snprint_actuators, 15, 0),              \
+        (altimeter, synapse_msgs_Altimeter, SYNAPSE_ALTIMETER_TOPIC, snprint_altimeter, 10, 1),                   \
+        (battery_state, synapse_msgs_BatteryState, SYNAPSE_BATTERY_STATE_TOPIC, snprint_battery_state, 1, 1),     \
+        (bezier_trajectory, synapse_msgs_BezierTrajectory, SYNAPSE_BEZIER_TRAJECTORY_TOPIC,                       \
+            snprint_bezier_trajectory, 1, 0),                                                                     \
+        (bezier_waypoints, synapse_msgs_BezierTrajectory, SYNAPSE_TOPIC_TF_BEZIER_WAYPOINTS,                      \
+            snprint_bezier_trajectory, 1, 0),                                                                     \
+        (clock_offset, synapse_msgs_Time, SYNAPSE_CLOCK_OFFSET_TOPIC, snprint_time, 1, 0),                        \
+        (cmd_vel, synapse_msgs_Twist, SYNAPSE_CMD_VEL_TOPIC, snprint_twist, 10, 0),                               \
+        (estimator_odometry, synapse_msgs_Odometry, SYNAPSE_ODOMETRY_TOPIC, snprint_odometry, 15, 0),             \
+        (external_odometry, synapse_msgs_Odometry, SYNAPSE_TOPIC_TF_NONE, snprint_odometry, 10, 0),               \
+        (imu, synapse_msgs_Imu, SYNAPSE_IMU_TOPIC, snprint_imu, 100, 1),                                          \
+        (joy, synapse_msgs_Joy, SYNAPSE_JOY_TOPIC, snprint_joy, 10, 0),                                           \
+        (led_array, synapse_msgs_LEDArray, SYNAPSE_LED_ARRAY_TOPIC, snprint_ledarray, 10, 0),                     \
+        (magnetic_field, synapse_msgs_MagneticField, SYNAPSE_MAGNETIC_FIELD_TOPIC,                                \
+            snprint_magnetic_field, 50, 1),                                                                       \
+        (nav_sat_fix, synapse_msgs_NavSatFix, SYNAPSE_NAV_SAT_FIX_TOPIC, snprint_navsatfix, 15, 1),               \
+        (safety, synapse_msgs_Safety, SYNAPSE_TOPIC_TF_NONE, snprint_safety, 10, 0),                              \
+        (status, synapse_msgs_Status, SYNAPSE_STATUS_TOPIC, snprint_status, 15, 0),                               \
+        (wheel_odometry, synapse_msgs_WheelOdometry, SYNAPSE_WHEEL_ODOMETRY_TOPIC,                                \
+            snprint_wheel_odometry, 100, 1)
+
+// expand dictionary entry (tuple) with macro F
+#define SYNAPSE_TOPIC_EXPAND(F, entry) F entry
+
 /********************************************************************
  * topics
  ********************************************************************/
-ZROS_TOPIC_DECLARE(topic_actuators, synapse_msgs_Actuators);
-ZROS_TOPIC_DECLARE(topic_actuators_manual, synapse_msgs_Actuators);
-ZROS_TOPIC_DECLARE(topic_altimeter, synapse_msgs_Altimeter);
-ZROS_TOPIC_DECLARE(topic_battery_state, synapse_msgs_BatteryState);
-ZROS_TOPIC_DECLARE(topic_bezier_trajectory, synapse_msgs_BezierTrajectory);
-ZROS_TOPIC_DECLARE(topic_clock_offset, synapse_msgs_Time);
-ZROS_TOPIC_DECLARE(topic_cmd_vel, synapse_msgs_Twist);
-ZROS_TOPIC_DECLARE(topic_estimator_odometry, synapse_msgs_Odometry);
-ZROS_TOPIC_DECLARE(topic_external_odometry, synapse_msgs_Odometry);
-ZROS_TOPIC_DECLARE(topic_imu, synapse_msgs_Imu);
-ZROS_TOPIC_DECLARE(topic_joy, synapse_msgs_Joy);
-ZROS_TOPIC_DECLARE(topic_led_array, synapse_msgs_LEDArray);
-ZROS_TOPIC_DECLARE(topic_magnetic_field, synapse_msgs_MagneticField);
-ZROS_TOPIC_DECLARE(topic_nav_sat_fix, synapse_msgs_NavSatFix);
-ZROS_TOPIC_DECLARE(topic_safety, synapse_msgs_Safety);
-ZROS_TOPIC_DECLARE(topic_status, synapse_msgs_Status);
-ZROS_TOPIC_DECLARE(topic_wheel_odometry, synapse_msgs_WheelOdometry);
+#define Z_SYNAPSE_TOPIC_DECLARE(NAME, CLASS, TF_TYPE, SNPRINT, RATE_HZ, SIM) \
+    ZROS_TOPIC_DECLARE(topic_##NAME, CLASS)
+#define Z_SYNAPSE_TOPIC_DECLARE_ENTRY(entry) SYNAPSE_TOPIC_EXPAND(Z_SYNAPSE_TOPIC_DECLARE, entry)
+
+FOR_EACH(Z_SYNAPSE_TOPIC_DECLARE_ENTRY, (;), SYNAPSE_TOPIC_DICTIONARY());
+
+/********************************************************************
+ * registry
+ ********************************************************************/
+#define Z_SYNAPSE_TOPIC_ID(NAME, CLASS, TF_TYPE, SNPRINT, RATE_HZ, SIM) SYNAPSE_TOPIC_ID_##NAME
+#define Z_SYNAPSE_TOPIC_ID_ENTRY(entry) SYNAPSE_TOPIC_EXPAND(Z_SYNAPSE_TOPIC_ID, entry)
+
+#define Z_SYNAPSE_TOPIC_RATE(NAME, CLASS, TF_TYPE, SNPRINT, RATE_HZ, SIM) SYNAPSE_TOPIC_RATE_HZ_##NAME = RATE_HZ
+#define Z_SYNAPSE_TOPIC_RATE_ENTRY(entry) SYNAPSE_TOPIC_EXPAND(Z_SYNAPSE_TOPIC_RATE, entry)
+
+#define Z_SYNAPSE_TOPIC_MSG(NAME, CLASS, TF_TYPE, SNPRINT, RATE_HZ, SIM) CLASS NAME
+#define Z_SYNAPSE_TOPIC_MSG_ENTRY(entry) SYNAPSE_TOPIC_EXPAND(Z_SYNAPSE_TOPIC_MSG, entry)
+
+// index of each topic in the registry, SYNAPSE_TOPIC_ID_<name>
+enum synapse_topic_id {
+    FOR_EACH(Z_SYNAPSE_TOPIC_ID_ENTRY, (, ), SYNAPSE_TOPIC_DICTIONARY()),
+    SYNAPSE_TOPIC_ID_COUNT,
+};
+
+// default rate of each topic, SYNAPSE_TOPIC_RATE_HZ_<name>
+enum {
+    FOR_EACH(Z_SYNAPSE_TOPIC_RATE_ENTRY, (, ), SYNAPSE_TOPIC_DICTIONARY()),
+};
+
+// storage large enough for any topic message
+union synapse_topic_msg {
+    FOR_EACH(Z_SYNAPSE_TOPIC_MSG_ENTRY, (;), SYNAPSE_TOPIC_DICTIONARY());
+};
+
+struct synapse_topic_info {
+    const char* name;
+    struct zros_topic* topic;
+    const pb_msgdesc_t* fields;
+    // size of the decoded message struct
+    size_t msg_size;
+    // maximum size of the encoded message
+    size_t encoded_size;
+    int (*snprint)(char* buf, size_t n, void* msg);
+    // tinyframe type, SYNAPSE_TOPIC_TF_NONE if not sent over synapse
+    int16_t tf_type;
+    uint16_t rate_hz;
+};
+
+extern const struct synapse_topic_info synapse_topic_registry[SYNAPSE_TOPIC_ID_COUNT];
+
+/*
+ * Find topic by tinyframe type, returns NULL if no topic uses it.
+ * If several topics share a type, the first in the dictionary is returned.
+ */
+const struct synapse_topic_info* synapse_topic_from_tf(int tf_type);
 
 #endif // SYNAPSE_TOPIC_LIST_H_
 // vi: ts=4 sw=4 et
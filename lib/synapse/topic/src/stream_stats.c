@@ -0,0 +1,149 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <math.h>
+
+#include "stream_stats.h"
+
+const uint32_t stream_stats_jitter_bin_us[STREAM_STATS_JITTER_BINS - 1] = {
+    10, 50, 100, 500, 1000, 5000, 10000
+};
+
+void p2_quantile_init(struct p2_quantile* e, double p)
+{
+    e->p = p;
+    e->count = 0;
+    for (int i = 0; i < 5; i++) {
+        e->n[i] = i + 1;
+    }
+    e->np[0] = 1;
+    e->np[1] = 1 + 2 * p;
+    e->np[2] = 1 + 4 * p;
+    e->np[3] = 3 + 2 * p;
+    e->np[4] = 5;
+    e->dn[0] = 0;
+    e->dn[1] = p / 2;
+    e->dn[2] = p;
+    e->dn[3] = (1 + p) / 2;
+    e->dn[4] = 1;
+}
+
+static double p2_parabolic(const struct p2_quantile* e, int i, int d)
+{
+    return e->q[i] + d / (e->n[i + 1] - e->n[i - 1])
+        * ((e->n[i] - e->n[i - 1] + d) * (e->q[i + 1] - e->q[i]) / (e->n[i + 1] - e->n[i])
+            + (e->n[i + 1] - e->n[i] - d) * (e->q[i] - e->q[i - 1]) / (e->n[i] - e->n[i - 1]));
+}
+
+static double p2_linear(const struct p2_quantile* e, int i, int d)
+{
+    return e->q[i] + d * (e->q[i + d] - e->q[i]) / (e->n[i + d] - e->n[i]);
+}
+
+void p2_quantile_add(struct p2_quantile* e, double x)
+{
+    // the first 5 samples initialize the markers, kept sorted
+    if (e->count < 5) {
+        int i = e->count++;
+        for (; i > 0 && e->q[i - 1] > x; i--) {
+            e->q[i] = e->q[i - 1];
+        }
+        e->q[i] = x;
+        return;
+    }
+    e->count++;
+
+    // cell of the sample, extending the extreme markers
+    int k = 0;
+    if (x < e->q[0]) {
+        e->q[0] = x;
+        k = 0;
+    } else if (x >= e->q[4]) {
+        e->q[4] = x;
+        k = 3;
+    } else {
+        for (k = 0; k < 3 && x >= e->q[k + 1]; k++) { }
+    }
+
+    for (int i = k + 1; i < 5; i++) {
+        e->n[i] += 1;
+    }
+    for (int i = 0; i < 5; i++) {
+        e->np[i] += e->dn[i];
+    }
+
+    // adjust the middle markers towards their desired positions
+    for (int i = 1; i < 4; i++) {
+        double d = e->np[i] - e->n[i];
+        if ((d >= 1 && e->n[i + 1] - e->n[i] > 1) || (d <= -1 && e->n[i - 1] - e->n[i] < -1)) {
+            int ds = d > 0 ? 1 : -1;
+            double q = p2_parabolic(e, i, ds);
+            if (e->q[i - 1] < q && q < e->q[i + 1]) {
+                e->q[i] = q;
+            } else {
+                e->q[i] = p2_linear(e, i, ds);
+            }
+            e->n[i] += ds;
+        }
+    }
+}
+
+double p2_quantile_get(const struct p2_quantile* e)
+{
+    if (e->count == 0) {
+        return NAN;
+    } else if (e->count < 5) {
+        // nearest rank of the few samples seen
+        int i = (int)(e->p * (e->count - 1) + 0.5);
+        return e->q[i];
+    }
+    return e->q[2];
+}
+
+void stream_stats_init(struct stream_stats* s)
+{
+    s->count = 0;
+    s->mean = 0;
+    s->m2 = 0;
+    s->min = INFINITY;
+    s->max = -INFINITY;
+    p2_quantile_init(&s->p50, 0.5);
+    p2_quantile_init(&s->p99, 0.99);
+    p2_quantile_init(&s->p999, 0.999);
+    for (int i = 0; i < STREAM_STATS_JITTER_BINS; i++) {
+        s->jitter[i] = 0;
+    }
+}
+
+void stream_stats_add(struct stream_stats* s, double x)
+{
+    s->count++;
+    double delta = x - s->mean;
+    s->mean += delta / s->count;
+    s->m2 += delta * (x - s->mean);
+
+    if (x < s->min) {
+        s->min = x;
+    }
+    if (x > s->max) {
+        s->max = x;
+    }
+
+    p2_quantile_add(&s->p50, x);
+    p2_quantile_add(&s->p99, x);
+    p2_quantile_add(&s->p999, x);
+
+    // deviation from the running mean, samples are periods in seconds
+    double jitter_us = fabs(x - s->mean) * 1e6;
+    int bin = 0;
+    for (; bin < STREAM_STATS_JITTER_BINS - 1 && jitter_us >= stream_stats_jitter_bin_us[bin]; bin++) { }
+    s->jitter[bin]++;
+}
+
+double stream_stats_std(const struct stream_stats* s)
+{
+    return s->count > 1 ? sqrt(s->m2 / (s->count - 1)) : 0;
+}
+
+// vi: ts=4 sw=4 et
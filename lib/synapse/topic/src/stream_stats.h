@@ -0,0 +1,51 @@
+/*
+ * Copyright CogniPilot Foundation 2024
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_TOPIC_STREAM_STATS_H_
+#define SYNAPSE_TOPIC_STREAM_STATS_H_
+
+#include <stdint.h>
+
+/*
+ * Constant memory statistics of an unbounded stream of samples, used by
+ * zros topic hz to characterize publication periods.
+ */
+
+// P-square quantile estimator (Jain and Chlamtac, 1985), 5 markers
+struct p2_quantile {
+    double p;
+    double q[5];
+    double n[5];
+    double np[5];
+    double dn[5];
+    uint32_t count;
+};
+
+void p2_quantile_init(struct p2_quantile* e, double p);
+void p2_quantile_add(struct p2_quantile* e, double x);
+double p2_quantile_get(const struct p2_quantile* e);
+
+// jitter histogram bin upper bounds, deviation from the mean period, us
+#define STREAM_STATS_JITTER_BINS 8
+extern const uint32_t stream_stats_jitter_bin_us[STREAM_STATS_JITTER_BINS - 1];
+
+struct stream_stats {
+    // Welford mean and sum of squared deviations
+    uint64_t count;
+    double mean;
+    double m2;
+    double min;
+    double max;
+    struct p2_quantile p50;
+    struct p2_quantile p99;
+    struct p2_quantile p999;
+    uint32_t jitter[STREAM_STATS_JITTER_BINS];
+};
+
+void stream_stats_init(struct stream_stats* s);
+void stream_stats_add(struct stream_stats* s, double x);
+double stream_stats_std(const struct stream_stats* s);
+
+#endif // SYNAPSE_TOPIC_STREAM_STATS_H_
+// vi: ts=4 sw=4 et
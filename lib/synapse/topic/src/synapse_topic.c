@@ -6,8 +6,8 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
 
-#include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include <zros/private/zros_node_struct.h>
 #include <zros/private/zros_pub_struct.h>
 #include <zros/private/zros_sub_struct.h>
@@ -21,18 +21,22 @@
 
 LOG_MODULE_REGISTER(zros_topic);
 
+#include "stream_stats.h"
 #include "synapse_shell_print.h"
 //#include "synapse_topic_list.h"
 
 extern struct k_work_q g_low_priority_work_q;
 
-typedef int msg_handler_t(const struct shell* sh, struct zros_topic* topic, void* msg, snprint_t* echo);
+#define HZ_MAX_TOPICS 4
+
+typedef int msg_handler_t(const struct shell* sh, const struct synapse_topic_info** info, int n, void* msg);
 void topic_work_handler(struct k_work* work);
 
 typedef struct context_t {
     struct k_work work_item;
     const struct shell* sh;
-    struct zros_topic* topic;
+    const struct synapse_topic_info* info[HZ_MAX_TOPICS];
+    int n_info;
     msg_handler_t* handler;
     struct k_mutex lock;
 } context_t;
@@ -40,29 +44,17 @@ typedef struct context_t {
 static context_t g_ctx = {
     .work_item = Z_WORK_INITIALIZER(topic_work_handler),
     .sh = NULL,
-    .topic = NULL,
+    .info = {},
+    .n_info = 0,
     .handler = NULL,
     .lock = Z_MUTEX_INITIALIZER(g_ctx.lock)
 };
 
-#define TOPIC_DICTIONARY()                                                     \
-    (actuators, &topic_actuators, "actuators"),                                \
-        (actuators_manual, &topic_actuators_manual, "actuators_manual"),       \
-        (altimeter, &topic_altimeter, "altimeter"),                            \
-        (battery_state, &topic_battery_state, "battery_state"),                \
-        (bezier_trajectory, &topic_bezier_trajectory, "bezier_trajectory"),    \
-        (clock_offset, &topic_clock_offset, "clock_offset"),                   \
-        (cmd_vel, &topic_cmd_vel, "cmd_vel"),                                  \
-        (estimator_odometry, &topic_estimator_odometry, "estimator_odometry"), \
-        (external_odometry, &topic_external_odometry, "external_odometry"),    \
-        (imu, &topic_imu, "imu"),                                              \
-        (joy, &topic_joy, "joy"),                                              \
-        (led_array, &topic_led_array, "led_array"),                            \
-        (magnetic_field, &topic_magnetic_field, "magnetic_field"),             \
-        (nav_sat_fix, &topic_nav_sat_fix, "nav_sat_fix"),                      \
-        (safety, &topic_safety, "safety"),                                     \
-        (status, &topic_status, "status"),                                     \
-        (wheel_odometry, &topic_wheel_odometry, "wheel_odometry")
+// shell dictionary (name, registry entry, syntax), built from the topic dictionary
+#define Z_TOPIC_SHELL_DICT(NAME, CLASS, TF_TYPE, SNPRINT, RATE_HZ, SIM) \
+    (NAME, &synapse_topic_registry[SYNAPSE_TOPIC_ID_##NAME], #NAME)
+#define Z_TOPIC_SHELL_DICT_ENTRY(entry) SYNAPSE_TOPIC_EXPAND(Z_TOPIC_SHELL_DICT, entry)
+#define TOPIC_DICTIONARY() FOR_EACH(Z_TOPIC_SHELL_DICT_ENTRY, (, ), SYNAPSE_TOPIC_DICTIONARY())
 
 static volatile bool keep_running = true;
 
@@ -71,90 +63,123 @@ static void shell_callback(const struct shell* sh, uint8_t* data, size_t len)
     keep_running = false;
 }
 
-static int topic_count_hz(const struct shell* sh, struct zros_topic* topic, void* msg, snprint_t* echo)
-{
+struct hz_topic {
+    const struct synapse_topic_info* info;
     struct zros_sub sub;
-    struct zros_node node;
-    zros_node_init(&node, "sub hz");
-    zros_sub_init(&sub, &node, topic, msg, 1000);
-    struct k_poll_event events[1] = {
-        *zros_sub_get_event(&sub),
-    };
-
-    int64_t ticks_start = k_uptime_ticks();
-    int64_t elapsed_ticks = 0;
-    const int64_t ticks_sample = 5 * CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-    int64_t ticks_remaining = ticks_sample;
+    struct stream_stats stats;
+    uint64_t cycle_last;
+};
 
-    static const int max_msg = 11;
-    int64_t msg_tick[max_msg];
-    double sample_sec[max_msg - 1];
+// 64 bit cycle counter, the tick is too coarse for periods of fast topics,
+// and the 32 bit counter wraps within seconds on fast cores
+static uint64_t hz_cycle_get(void)
+{
+#if defined(CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER)
+    return k_cycle_get_64();
+#else
+    return k_ticks_to_cyc_floor64(k_uptime_ticks());
+#endif
+}
 
-    int msg_count = 0;
+static void hz_print_stats(const struct shell* sh, struct hz_topic* t)
+{
+    const struct stream_stats* s = &t->stats;
+    if (s->count == 0) {
+        shell_print(sh, "%-20s no messages", t->info->name);
+        return;
+    }
+    shell_print(sh, "%-20s %8.2f Hz n %8llu  mean %8.3f std %7.3f min %8.3f max %8.3f"
+                    "  p50 %8.3f p99 %8.3f p99.9 %8.3f ms",
+        t->info->name, 1.0 / s->mean, s->count, s->mean * 1e3, stream_stats_std(s) * 1e3,
+        s->min * 1e3, s->max * 1e3, p2_quantile_get(&s->p50) * 1e3,
+        p2_quantile_get(&s->p99) * 1e3, p2_quantile_get(&s->p999) * 1e3);
+}
 
-    while (ticks_remaining > 0.1 * CONFIG_SYS_CLOCK_TICKS_PER_SEC && msg_count < max_msg) {
-        int rc = 0;
-        rc = k_poll(events, ARRAY_SIZE(events),
-            K_MSEC(1e3 * ticks_remaining / CONFIG_SYS_CLOCK_TICKS_PER_SEC));
-        if (rc != 0) {
-            char name[20];
-            zros_topic_get_name(topic, name, sizeof(name));
-            LOG_WRN("%s not published.", name);
+static void hz_print_jitter(const struct shell* sh, struct hz_topic* t)
+{
+    const struct stream_stats* s = &t->stats;
+    shell_print(sh, "%s jitter, deviation from mean period:", t->info->name);
+    for (int i = 0; i < STREAM_STATS_JITTER_BINS; i++) {
+        double percent = s->count > 0 ? 100.0 * s->jitter[i] / s->count : 0;
+        if (i < STREAM_STATS_JITTER_BINS - 1) {
+            shell_print(sh, "  < %6d us %10d %6.2f%%",
+                stream_stats_jitter_bin_us[i], s->jitter[i], percent);
+        } else {
+            shell_print(sh, " >= %6d us %10d %6.2f%%",
+                stream_stats_jitter_bin_us[i - 1], s->jitter[i], percent);
         }
+    }
+}
 
-        elapsed_ticks = k_uptime_ticks() - ticks_start;
-        ticks_remaining = ticks_sample - elapsed_ticks;
+static int topic_count_hz(const struct shell* sh, const struct synapse_topic_info** info, int n, void* msg)
+{
+    // guarded by the topic work lock, too large for the work queue stack
+    static struct hz_topic topics[HZ_MAX_TOPICS];
+    static union synapse_topic_msg msgs[HZ_MAX_TOPICS];
+    struct k_poll_event events[HZ_MAX_TOPICS];
+    struct zros_node node;
+    zros_node_init(&node, "sub hz");
 
-        if (zros_sub_update_available(&sub)) {
-            rc = zros_sub_update(&sub);
-            if (rc == 0) {
-                msg_tick[msg_count] = k_uptime_ticks();
-                msg_count++;
-            } else {
-                LOG_ERR("sub update failed");
+    for (int i = 0; i < n; i++) {
+        struct hz_topic* t = &topics[i];
+        t->info = info[i];
+        stream_stats_init(&t->stats);
+        t->cycle_last = 0;
+        zros_sub_init(&t->sub, &node, t->info->topic, &msgs[i], 1000);
+        events[i] = *zros_sub_get_event(&t->sub);
+    }
+
+    keep_running = true;
+    shell_print(sh, "press any key to exit");
+    shell_set_bypass(sh, shell_callback);
+
+    const double sec_per_cycle = 1.0 / sys_clock_hw_cycles_per_sec();
+    int64_t ticks_report = k_uptime_ticks() + CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+    bool first[HZ_MAX_TOPICS];
+    for (int i = 0; i < n; i++) {
+        first[i] = true;
+    }
+
+    while (keep_running) {
+        k_poll(events, n, K_TIMEOUT_ABS_TICKS(ticks_report));
+        uint64_t cycle = hz_cycle_get();
+
+        for (int i = 0; i < n; i++) {
+            struct hz_topic* t = &topics[i];
+            events[i].state = K_POLL_STATE_NOT_READY;
+            if (!zros_sub_update_available(&t->sub)) {
+                continue;
             }
+            zros_sub_update(&t->sub);
+            if (!first[i]) {
+                stream_stats_add(&t->stats, (cycle - t->cycle_last) * sec_per_cycle);
+            }
+            first[i] = false;
+            t->cycle_last = cycle;
         }
-    }
 
-    double mean = 0;
-    double min = 0;
-    double max = 0;
-    shell_print(sh, "sample   delta");
-    for (int i = 0; i < msg_count - 1; i++) {
-        sample_sec[i] = (float)(msg_tick[i + 1] - msg_tick[i]) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-        if (i == 0) {
-            min = sample_sec[i];
-            max = sample_sec[i];
-        } else {
-            if (sample_sec[i] < min) {
-                min = sample_sec[i];
-            } else if (sample_sec[i] > max) {
-                max = sample_sec[i];
+        if (k_uptime_ticks() >= ticks_report) {
+            ticks_report += CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+            for (int i = 0; i < n; i++) {
+                hz_print_stats(sh, &topics[i]);
             }
         }
-        mean += sample_sec[i];
-        shell_print(sh, "  %d  %10.6fs", i, sample_sec[i]);
     }
-    mean /= (msg_count - 1);
 
-    double std = 0;
-    for (int i = 0; i < msg_count - 1; i++) {
-        double v = sample_sec[i] - mean;
-        std += v * v;
+    shell_set_bypass(sh, NULL);
+    for (int i = 0; i < n; i++) {
+        hz_print_stats(sh, &topics[i]);
+        hz_print_jitter(sh, &topics[i]);
+        zros_sub_fini(&topics[i].sub);
     }
-    std = sqrt(std / (msg_count - 1));
-
-    zros_sub_fini(&sub);
     zros_node_fini(&node);
-
-    shell_print(sh, "average rate: %8.3f Hz\n"
-                    "min: %10.6fs, max: %10.6fs, std: %10.6fs, window: %d",
-        1.0 / mean, min, max, std, msg_count);
     return ZROS_OK;
 }
 
-static int topic_echo(const struct shell* sh, struct zros_topic* topic, void* msg, snprint_t* echo)
+static int topic_echo(const struct shell* sh, const struct synapse_topic_info** info, int n, void* msg)
 {
+    struct zros_topic* topic = info[0]->topic;
+    snprint_t* echo = info[0]->snprint;
     static char buf[2048] = {};
     struct zros_sub sub;
     struct zros_node node;
@@ -208,59 +233,12 @@ void topic_work_handler(struct k_work* work)
             return );
 
     const struct shell* sh = ctx->sh;
-    struct zros_topic* topic = ctx->topic;
     msg_handler_t* handler = ctx->handler;
 
-    if (topic == &topic_actuators || topic == &topic_actuators_manual) {
-        synapse_msgs_Actuators msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_actuators);
-    } else if (topic == &topic_altimeter) {
-        synapse_msgs_Altimeter msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_altimeter);
-    } else if (topic == &topic_battery_state) {
-        synapse_msgs_BatteryState msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_battery_state);
-    } else if (topic == &topic_bezier_trajectory) {
-        synapse_msgs_BezierTrajectory msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_bezier_trajectory);
-    } else if (topic == &topic_clock_offset) {
-        synapse_msgs_Time msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_time);
-    } else if (topic == &topic_cmd_vel) {
-        synapse_msgs_Twist msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_twist);
-    } else if (topic == &topic_status) {
-        synapse_msgs_Status msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_status);
-    } else if (topic == &topic_imu) {
-        synapse_msgs_Imu msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_imu);
-    } else if (topic == &topic_joy) {
-        synapse_msgs_Joy msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_joy);
-    } else if (topic == &topic_led_array) {
-        synapse_msgs_LEDArray msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_ledarray);
-    } else if (topic == &topic_magnetic_field) {
-        synapse_msgs_MagneticField msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_magnetic_field);
-    } else if (topic == &topic_nav_sat_fix) {
-        synapse_msgs_NavSatFix msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_navsatfix);
-    } else if (topic == &topic_estimator_odometry || topic == &topic_external_odometry) {
-        synapse_msgs_Odometry msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_odometry);
-    } else if (topic == &topic_safety) {
-        synapse_msgs_Safety msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_safety);
-    } else if (topic == &topic_wheel_odometry) {
-        synapse_msgs_WheelOdometry msg = {};
-        handler(sh, topic, &msg, (snprint_t*)&snprint_wheel_odometry);
-    } else {
-        char name[20];
-        zros_topic_get_name(topic, name, sizeof(name));
-        shell_print(sh, "%s not handled", name);
-    }
+    // guarded by lock, too large for the work queue stack
+    static union synapse_topic_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    handler(sh, ctx->info, ctx->n_info, &msg);
 
     // unlock mutex
     k_mutex_unlock(&ctx->lock);
@@ -268,22 +246,44 @@ void topic_work_handler(struct k_work* work)
 }
 
 static int cmd_zros_topic_hz(const struct shell* sh,
-    size_t argc, char** argv, void* data)
+    size_t argc, char** argv)
 {
-    struct zros_topic* topic = (struct zros_topic*)data;
+    if (argc - 1 > HZ_MAX_TOPICS) {
+        shell_error(sh, "at most %d topics", HZ_MAX_TOPICS);
+        return -EINVAL;
+    }
+    const struct synapse_topic_info* info[HZ_MAX_TOPICS];
+    for (size_t i = 1; i < argc; i++) {
+        info[i - 1] = NULL;
+        for (int j = 0; j < SYNAPSE_TOPIC_ID_COUNT; j++) {
+            if (strcmp(argv[i], synapse_topic_registry[j].name) == 0) {
+                info[i - 1] = &synapse_topic_registry[j];
+            }
+        }
+        if (info[i - 1] == NULL) {
+            shell_error(sh, "unknown topic: %s", argv[i]);
+            return -EINVAL;
+        }
+    }
+
+    if (k_work_is_pending(&g_ctx.work_item)) {
+        shell_error(sh, "topic handler busy");
+        return -EBUSY;
+    }
     g_ctx.sh = sh;
     g_ctx.handler = &topic_count_hz;
-    g_ctx.topic = topic;
+    memcpy(g_ctx.info, info, sizeof(info));
+    g_ctx.n_info = argc - 1;
     return k_work_submit_to_queue(&g_low_priority_work_q, &g_ctx.work_item);
 }
 
 static int cmd_zros_topic_echo(const struct shell* sh,
     size_t argc, char** argv, void* data)
 {
-    struct zros_topic* topic = (struct zros_topic*)data;
     g_ctx.sh = sh;
     g_ctx.handler = &topic_echo;
-    g_ctx.topic = topic;
+    g_ctx.info[0] = data;
+    g_ctx.n_info = 1;
     return k_work_submit_to_queue(&g_low_priority_work_q, &g_ctx.work_item);
 }
 
@@ -321,7 +321,8 @@ void sub_print_iterator(const struct zros_sub* sub, void* data)
 static int cmd_zros_topic_info(const struct shell* sh,
     size_t argc, char** argv, void* data)
 {
-    struct zros_topic* topic = (struct zros_topic*)data;
+    const struct synapse_topic_info* info = data;
+    struct zros_topic* topic = info->topic;
     shell_print(sh, "pubs");
     zros_topic_iterate_pub(topic, pub_print_iterator, (void*)sh);
     shell_print(sh, "subs");
@@ -344,14 +345,31 @@ static int cmd_zros_node_list(const struct shell* sh,
     return ZROS_OK;
 }
 
+// topic names for hz, each completed name offers the topics again
+static void hz_topic_get(size_t idx, struct shell_static_entry* entry);
+
+SHELL_DYNAMIC_CMD_CREATE(sub_zros_topic_hz, hz_topic_get);
+
+static void hz_topic_get(size_t idx, struct shell_static_entry* entry)
+{
+    if (idx < SYNAPSE_TOPIC_ID_COUNT) {
+        entry->syntax = synapse_topic_registry[idx].name;
+        entry->handler = NULL;
+        entry->help = NULL;
+        entry->subcmd = &sub_zros_topic_hz;
+    } else {
+        entry->syntax = NULL;
+    }
+}
+
 // level 2 (topic echo/hz/list)
 SHELL_SUBCMD_DICT_SET_CREATE(sub_zros_topic_echo, cmd_zros_topic_echo, TOPIC_DICTIONARY());
-SHELL_SUBCMD_DICT_SET_CREATE(sub_zros_topic_hz, cmd_zros_topic_hz, TOPIC_DICTIONARY());
 SHELL_SUBCMD_DICT_SET_CREATE(sub_zros_topic_info, cmd_zros_topic_info, TOPIC_DICTIONARY());
 
 SHELL_STATIC_SUBCMD_SET_CREATE(sub_zros_topic,
     SHELL_CMD(echo, &sub_zros_topic_echo, "Echo topic.", NULL),
-    SHELL_CMD(hz, &sub_zros_topic_hz, "Check topic pub rate.", NULL),
+    SHELL_CMD_ARG(hz, &sub_zros_topic_hz, "Topic pub rate statistics until a key is pressed: hz <topic> [topic ...]",
+        cmd_zros_topic_hz, 2, HZ_MAX_TOPICS - 1),
     SHELL_CMD(info, &sub_zros_topic_info, "Topic pubs and subs.", NULL),
     SHELL_CMD(list, NULL, "List topics.", cmd_zros_topic_list),
     SHELL_SUBCMD_SET_END);
@@ -10,6 +10,7 @@
 #include <zros/private/zros_topic_struct.h>
 #include <zros/zros_broker.h>
 
+#include "synapse_shell_print.h"
 #include "synapse_topic_list.h"
 
 //*******************************************************************
@@ -107,52 +108,65 @@ const char* fuel_str(synapse_msgs_Status_Fuel fuel)
 /********************************************************************
  * topics
  ********************************************************************/
-ZROS_TOPIC_DEFINE(actuators, synapse_msgs_Actuators);
-ZROS_TOPIC_DEFINE(actuators_manual, synapse_msgs_Actuators);
-ZROS_TOPIC_DEFINE(altimeter, synapse_msgs_Altimeter);
-ZROS_TOPIC_DEFINE(battery_state, synapse_msgs_BatteryState);
-ZROS_TOPIC_DEFINE(bezier_trajectory, synapse_msgs_BezierTrajectory);
-ZROS_TOPIC_DEFINE(clock_offset, synapse_msgs_Time);
-ZROS_TOPIC_DEFINE(cmd_vel, synapse_msgs_Twist);
-ZROS_TOPIC_DEFINE(status, synapse_msgs_Status);
-ZROS_TOPIC_DEFINE(imu, synapse_msgs_Imu);
-ZROS_TOPIC_DEFINE(joy, synapse_msgs_Joy);
-ZROS_TOPIC_DEFINE(led_array, synapse_msgs_LEDArray);
-ZROS_TOPIC_DEFINE(magnetic_field, synapse_msgs_MagneticField);
-ZROS_TOPIC_DEFINE(nav_sat_fix, synapse_msgs_NavSatFix);
-ZROS_TOPIC_DEFINE(estimator_odometry, synapse_msgs_Odometry);
-ZROS_TOPIC_DEFINE(external_odometry, synapse_msgs_Odometry);
-ZROS_TOPIC_DEFINE(safety, synapse_msgs_Safety);
-ZROS_TOPIC_DEFINE(wheel_odometry, synapse_msgs_WheelOdometry);
-
-static struct zros_topic* topic_list[] = {
-    &topic_actuators,
-    &topic_actuators_manual,
-    &topic_altimeter,
-    &topic_battery_state,
-    &topic_bezier_trajectory,
-    &topic_clock_offset,
-    &topic_cmd_vel,
-    &topic_status,
-    &topic_imu,
-    &topic_joy,
-    &topic_led_array,
-    &topic_magnetic_field,
-    &topic_nav_sat_fix,
-    &topic_estimator_odometry,
-    &topic_external_odometry,
-    &topic_safety,
-    &topic_wheel_odometry,
+#define Z_SYNAPSE_TOPIC_DEFINE(NAME, CLASS, TF_TYPE, SNPRINT, RATE_HZ, SIM) \
+    ZROS_TOPIC_DEFINE(NAME, CLASS)
+#define Z_SYNAPSE_TOPIC_DEFINE_ENTRY(entry) SYNAPSE_TOPIC_EXPAND(Z_SYNAPSE_TOPIC_DEFINE, entry)
+
+FOR_EACH(Z_SYNAPSE_TOPIC_DEFINE_ENTRY, (;), SYNAPSE_TOPIC_DICTIONARY());
+
+/********************************************************************
+ * registry
+ ********************************************************************/
+#define Z_SYNAPSE_TOPIC_INFO(NAME, CLASS, TF_TYPE, SNPRINT, RATE_HZ, SIM) \
+    [SYNAPSE_TOPIC_ID_##NAME] = {                                         \
+        .name = #NAME,                                                    \
+        .topic = &topic_##NAME,                                           \
+        .fields = CLASS##_fields,                                         \
+        .msg_size = sizeof(CLASS),                                        \
+        .encoded_size = CLASS##_size,                                     \
+        .snprint = (snprint_t*)&SNPRINT,                                  \
+        .tf_type = TF_TYPE,                                               \
+        .rate_hz = RATE_HZ,                                               \
+    }
+#define Z_SYNAPSE_TOPIC_INFO_ENTRY(entry) SYNAPSE_TOPIC_EXPAND(Z_SYNAPSE_TOPIC_INFO, entry)
+
+const struct synapse_topic_info synapse_topic_registry[SYNAPSE_TOPIC_ID_COUNT] = {
+    FOR_EACH(Z_SYNAPSE_TOPIC_INFO_ENTRY, (, ), SYNAPSE_TOPIC_DICTIONARY()),
 };
 
+// registry index + 1 by tinyframe type, 0 if unused
+static uint8_t g_tf_index[256];
+
+const struct synapse_topic_info* synapse_topic_from_tf(int tf_type)
+{
+    if (tf_type < 0 || tf_type >= (int)ARRAY_SIZE(g_tf_index) || g_tf_index[tf_type] == 0) {
+        return NULL;
+    }
+    return &synapse_topic_registry[g_tf_index[tf_type] - 1];
+}
+
 static int set_topic_list()
 {
-    for (size_t i = 0; i < ARRAY_SIZE(topic_list); i++) {
-        zros_broker_add_topic(topic_list[i]);
+    for (int i = 0; i < SYNAPSE_TOPIC_ID_COUNT; i++) {
+        zros_broker_add_topic(synapse_topic_registry[i].topic);
+    }
+    return 0;
+}
+
+static int set_tf_index()
+{
+    // map in reverse so the first topic using a tinyframe type wins
+    for (int i = SYNAPSE_TOPIC_ID_COUNT - 1; i >= 0; i--) {
+        int tf_type = synapse_topic_registry[i].tf_type;
+        if (tf_type >= 0 && tf_type < (int)ARRAY_SIZE(g_tf_index)) {
+            g_tf_index[tf_type] = i + 1;
+        }
     }
     return 0;
 }
 
+// tf index is needed by link threads started during application init
+SYS_INIT(set_tf_index, PRE_KERNEL_1, 0);
 SYS_INIT(set_topic_list, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
 
 // vi: ts=4 sw=4 et
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+# Copyright CogniPilot Foundation 2024
+# SPDX-License-Identifier: Apache-2.0
+"""
+Index a synapse flight log by topic and timestamp.
+
+The log format is described in include/cerebri/synapse/log_format.h. The
+index is written next to the log (<log>.idx) as fixed size entries
+
+    topic (u8) | stamp_ns (u64) | offset (u64) | len (u16)
+
+sorted by topic then stamp, preceded by the topic names, so a reader can
+binary search the time range of a topic and seek straight to its
+records. The index is rebuilt when it is older than the log.
+
+    log_index.py cerebri_log.bin                      summary per topic
+    log_index.py cerebri_log.bin -t imu -s 10 -e 12   records of imu in [10 s, 12 s)
+    log_index.py cerebri_log.bin -t imu --dump out    raw payloads, one file per record
+"""
+import argparse
+import bisect
+import os
+import struct
+import sys
+
+LOG_MAGIC = b"CBLG"
+LOG_HEADER = struct.Struct("<4sHHQ")
+LOG_RECORD = struct.Struct("<HBBQ")
+KIND_TOPIC = 0
+KIND_MSG = 1
+
+INDEX_MAGIC = b"CBLI"
+INDEX_HEADER = struct.Struct("<4sHQ")
+INDEX_ENTRY = struct.Struct("<BQQH")
+
+
+def scan(path):
+    """read every record header, returns topic names and message entries"""
+    names = {}
+    entries = []
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version, header_size, length = LOG_HEADER.unpack_from(data, 0)
+    if magic != LOG_MAGIC:
+        raise ValueError("%s is not a synapse log" % path)
+    end = header_size + length if length > 0 else len(data)
+    end = min(end, len(data))
+    offset = header_size
+    truncated = False
+    while offset + LOG_RECORD.size <= end:
+        size, topic, kind, stamp = LOG_RECORD.unpack_from(data, offset)
+        payload = offset + LOG_RECORD.size
+        if payload + size > end:
+            truncated = True
+            break
+        if kind == KIND_TOPIC:
+            names[topic] = data[payload:payload + size].decode()
+        elif kind == KIND_MSG:
+            entries.append((topic, stamp, payload, size))
+        offset = payload + size
+    if truncated or offset < end and length > 0:
+        print("warning: log truncated at offset %d" % offset, file=sys.stderr)
+    entries.sort()
+    return names, entries
+
+
+def write_index(path, names, entries):
+    with open(path, "wb") as f:
+        f.write(INDEX_HEADER.pack(INDEX_MAGIC, len(names), len(entries)))
+        for topic, name in sorted(names.items()):
+            encoded = name.encode()
+            f.write(struct.pack("<BB", topic, len(encoded)) + encoded)
+        for entry in entries:
+            f.write(INDEX_ENTRY.pack(*entry))
+
+
+def read_index(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, n_names, n_entries = INDEX_HEADER.unpack_from(data, 0)
+    if magic != INDEX_MAGIC:
+        raise ValueError("%s is not a synapse log index" % path)
+    offset = INDEX_HEADER.size
+    names = {}
+    for _ in range(n_names):
+        topic, size = struct.unpack_from("<BB", data, offset)
+        offset += 2
+        names[topic] = data[offset:offset + size].decode()
+        offset += size
+    entries = [INDEX_ENTRY.unpack_from(data, offset + i * INDEX_ENTRY.size)
+               for i in range(n_entries)]
+    return names, entries
+
+
+def load(log_path, rebuild=False):
+    index_path = log_path + ".idx"
+    if not rebuild and os.path.exists(index_path) \
+            and os.path.getmtime(index_path) >= os.path.getmtime(log_path):
+        return read_index(index_path)
+    names, entries = scan(log_path)
+    write_index(index_path, names, entries)
+    return names, entries
+
+
+def select(entries, topic, start_ns, end_ns):
+    """entries of topic with start_ns <= stamp < end_ns, by binary search"""
+    lo = bisect.bisect_left(entries, (topic, start_ns))
+    hi = bisect.bisect_left(entries, (topic, end_ns))
+    return entries[lo:hi]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="synapse log file")
+    parser.add_argument("-t", "--topic", help="topic name")
+    parser.add_argument("-s", "--start", type=float, default=0, help="start time, s")
+    parser.add_argument("-e", "--end", type=float, default=float("inf"), help="end time, s")
+    parser.add_argument("--dump", metavar="DIR", help="write selected payloads to DIR")
+    parser.add_argument("--rebuild", action="store_true", help="rebuild the index")
+    args = parser.parse_args()
+
+    names, entries = load(args.log, args.rebuild)
+
+    if args.topic is None:
+        print("%-24s %10s %12s %12s %10s" % ("topic", "records", "first (s)", "last (s)", "rate (Hz)"))
+        for topic, name in sorted(names.items(), key=lambda x: x[1]):
+            sel = select(entries, topic, 0, 2**64)
+            if len(sel) == 0:
+                print("%-24s %10d" % (name, 0))
+                continue
+            first, last = sel[0][1] * 1e-9, sel[-1][1] * 1e-9
+            rate = (len(sel) - 1) / (last - first) if last > first else 0
+            print("%-24s %10d %12.6f %12.6f %10.1f" % (name, len(sel), first, last, rate))
+        return
+
+    ids = [topic for topic, name in names.items() if name == args.topic]
+    if len(ids) == 0:
+        print("topic %s not in log" % args.topic, file=sys.stderr)
+        sys.exit(1)
+
+    end_ns = 2**64 if args.end == float("inf") else int(args.end * 1e9)
+    sel = select(entries, ids[0], int(args.start * 1e9), end_ns)
+    if args.dump:
+        os.makedirs(args.dump, exist_ok=True)
+        with open(args.log, "rb") as f:
+            for i, (_, stamp, offset, size) in enumerate(sel):
+                f.seek(offset)
+                with open(os.path.join(args.dump, "%s_%06d_%d.pb" % (args.topic, i, stamp)), "wb") as out:
+                    out.write(f.read(size))
+    for _, stamp, offset, size in sel:
+        print("%12.6f %10d %6d" % (stamp * 1e-9, offset, size))
+
+
+if __name__ == "__main__":
+    main()
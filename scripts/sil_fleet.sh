@@ -0,0 +1,99 @@
+#!/bin/bash
+# Copyright CogniPilot Foundation 2024
+# SPDX-License-Identifier: Apache-2.0
+#
+# Start several SIL vehicles on one host, each pinned to its own core.
+#
+# Instance i uses tap interface zeth<i>, the board address 10.42.<i>.1,
+# the peer address 10.42.<i>.2 and the ports base + stride * i + {1, 2},
+# (sim and synapse), the base and stride are read from the build's
+# CEREBRI_CORE_COMMON_INSTANCE_PORT_* Kconfig. Build the app for
+# native_sim first, e.g.
+#
+#   west build app/b3rb -b native_sim -d build/b3rb
+#   sudo scripts/sil_fleet.sh -s -n 4 -d build/b3rb
+#
+# The simulator / ros bridge of instance i connects to the same ports.
+
+set -e
+
+count=1
+build_dir=build
+first_core=0
+port_base=
+log_dir=
+setup_tap=0
+
+usage() {
+    echo "usage: $0 [-n count] [-d build dir] [-c first core] [-p port base] [-l log dir] [-s]"
+    echo "  -s  create and configure the zeth<i> tap interfaces (needs root)"
+    exit 1
+}
+
+while getopts "n:d:c:p:l:sh" opt; do
+    case $opt in
+        n) count=$OPTARG ;;
+        d) build_dir=$OPTARG ;;
+        c) first_core=$OPTARG ;;
+        p) port_base=$OPTARG ;;
+        l) log_dir=$OPTARG ;;
+        s) setup_tap=1 ;;
+        *) usage ;;
+    esac
+done
+
+exe=$build_dir/zephyr/zephyr.exe
+if [ ! -x "$exe" ]; then
+    echo "$exe not found, build the app for native_sim first"
+    exit 1
+fi
+
+# port layout of the build, see include/cerebri/core/instance.h
+config=$build_dir/zephyr/.config
+kconfig() {
+    sed -n "s/^CONFIG_$1=//p" "$config"
+}
+port_stride=$(kconfig CEREBRI_CORE_COMMON_INSTANCE_PORT_STRIDE)
+port_base=${port_base:-$(kconfig CEREBRI_CORE_COMMON_INSTANCE_PORT_BASE)}
+if [ -z "$port_stride" ] || [ -z "$port_base" ]; then
+    echo "instance ports not found in $config"
+    exit 1
+fi
+
+cores=$(nproc)
+if [ $((first_core + count)) -gt "$cores" ]; then
+    echo "warning: $count instances from core $first_core exceed $cores cores, cores are shared"
+fi
+
+log_dir=${log_dir:-$build_dir/sil_fleet}
+mkdir -p "$log_dir"
+
+pids=()
+stop() {
+    kill "${pids[@]}" 2>/dev/null || true
+    wait
+}
+trap stop INT TERM EXIT
+
+for ((i = 0; i < count; i++)); do
+    tap=zeth$i
+    if [ $setup_tap -eq 1 ] && ! ip link show "$tap" > /dev/null 2>&1; then
+        ip tuntap add "$tap" mode tap
+        ip addr add "10.42.$i.2/24" dev "$tap"
+        ip link set "$tap" up
+    fi
+
+    core=$(((first_core + i) % cores))
+    echo "instance $i: core $core, $tap, sim port $((port_base + port_stride * i + 1)), synapse port $((port_base + port_stride * i + 2))"
+    taskset -c "$core" "$exe" \
+        --instance=$i \
+        --port_base=$port_base \
+        --addr=10.42.$i.1 \
+        --peer=10.42.$i.2 \
+        --eth-if=$tap \
+        > "$log_dir/instance_$i.log" 2>&1 &
+    pids+=($!)
+done
+
+echo "logs in $log_dir, ctrl-c to stop"
+wait
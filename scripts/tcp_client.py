@@ -1,8 +1,18 @@
 #!/usr/bin/env python3
+import argparse
 import socket
 
-HOST = '192.0.2.1'
-PORT = 4242
+# ports as in lib/core/common/src/instance.c, port_base + id * stride + port
+parser = argparse.ArgumentParser(description="echo test over tcp to a cerebri instance")
+parser.add_argument("--host", default="192.0.2.1", help="address of the instance")
+parser.add_argument("-i", "--instance", type=int, default=0, help="instance id")
+parser.add_argument("-b", "--port-base", type=int, default=4240, help="instance port base")
+parser.add_argument("-s", "--stride", type=int, default=10, help="instance port stride")
+parser.add_argument("-p", "--port", type=int, default=2, help="port, 1 sil, 2 synapse")
+args = parser.parse_args()
+
+HOST = args.host
+PORT = args.port_base + args.instance * args.stride + args.port
 
 with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
     s.connect((HOST, PORT))
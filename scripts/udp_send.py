@@ -1,9 +1,19 @@
 #!/usr/bin/env python3
+import argparse
 import socket
 import time
 
-UDP_IP = "192.0.2.1"
-UDP_PORT = 4242
+# ports as in lib/core/common/src/instance.c, port_base + id * stride + port
+parser = argparse.ArgumentParser(description="send test udp messages to a cerebri instance")
+parser.add_argument("--ip", default="192.0.2.1", help="address of the instance")
+parser.add_argument("-i", "--instance", type=int, default=0, help="instance id")
+parser.add_argument("-b", "--port-base", type=int, default=4240, help="instance port base")
+parser.add_argument("-s", "--stride", type=int, default=10, help="instance port stride")
+parser.add_argument("-p", "--port", type=int, default=2, help="port, 1 sil, 2 synapse")
+args = parser.parse_args()
+
+UDP_IP = args.ip
+UDP_PORT = args.port_base + args.instance * args.stride + args.port
 MESSAGE = b"test"
 
 print("UDP target IP: %s" % UDP_IP)
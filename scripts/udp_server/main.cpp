@@ -3,10 +3,13 @@
 #include <boost/asio/ip/address.hpp>
 #include <boost/asio/placeholders.hpp>
 #include <boost/system/error_code.hpp>
+#include <cstring>
 #include <ctime>
 #include <iostream>
 #include <memory>
 
+#include <cerebri/synapse/batch.h>
+
 using boost::asio::ip::udp;
 
 std::string make_daytime_string()
@@ -20,7 +23,8 @@ class UDPServer {
 public:
     UDPServer(boost::asio::io_context& io_context,
         const char* local_ip, const char* local_port,
-        const char* remote_ip, const char* remote_port)
+        const char* remote_ip, const char* remote_port, bool split)
+        : split_(split)
     {
         udp::resolver resolver(io_context);
         local_endpoint_ = std::make_shared<udp::endpoint>(*resolver.resolve(
@@ -44,7 +48,10 @@ private:
     {
         std::cout << local_endpoint_->address().to_string()
                   << ":" << local_endpoint_->port() << ": received: " << bytes_received << std::endl;
-        if (!ec && bytes_received > 0) {
+        const uint8_t* buf = reinterpret_cast<const uint8_t*>(data_);
+        if (!ec && split_ && synapse_batch_is_batch(buf, bytes_received)) {
+            do_send_split(bytes_received);
+        } else if (!ec && bytes_received > 0) {
             do_send(bytes_received);
         } else {
             do_receive();
@@ -74,6 +81,31 @@ private:
             std::bind(&UDPServer::handle_send, this, std::placeholders::_1, std::placeholders::_2));
     }
 
+    // forward each frame of a batched datagram as its own datagram
+    void do_send_split(size_t bytes_received)
+    {
+        synapse_batch_iter it;
+        synapse_batch_iter_init(&it, reinterpret_cast<const uint8_t*>(data_), bytes_received);
+        const uint8_t* frame = nullptr;
+        int frame_len = 0;
+        int frames = 0;
+        while ((frame_len = synapse_batch_next(&it, &frame)) > 0) {
+            boost::system::error_code ec;
+            socket_->send_to(boost::asio::buffer(frame, frame_len), *remote_endpoint_, 0, ec);
+            if (ec) {
+                std::cerr << "send failed: " << ec.message() << std::endl;
+            }
+            frames++;
+        }
+        if (frame_len < 0) {
+            std::cerr << "malformed batch, len: " << bytes_received << std::endl;
+        }
+        std::cout << remote_endpoint_->address().to_string()
+                  << ":" << remote_endpoint_->port() << ": split: " << frames << std::endl;
+        do_receive();
+    }
+
+    bool split_;
     std::shared_ptr<udp::socket> socket_;
     std::shared_ptr<udp::endpoint> local_endpoint_;
     std::shared_ptr<udp::endpoint> remote_endpoint_;
@@ -81,15 +113,23 @@ private:
     char data_[max_length];
 };
 
-int main()
+int main(int argc, char** argv)
 {
+    // --split: forward batched datagrams as one datagram per frame
+    bool split = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--split") == 0) {
+            split = true;
+        }
+    }
+
     try {
         boost::asio::io_context io_context;
         const char* local_port = "4242";
         const char* local_ip = "192.0.2.2";
         const char* remote_port = "4242";
         const char* remote_ip = "192.0.2.1";
-        UDPServer server(io_context, local_ip, local_port, remote_ip, remote_port);
+        UDPServer server(io_context, local_ip, local_port, remote_ip, remote_port, split);
         std::cout << "running" << std::endl;
         io_context.run();
         std::cout << "finished" << std::endl;
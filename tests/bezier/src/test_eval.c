@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2024 CogniPilot Foundation
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <math.h>
+
+#include <zephyr/ztest.h>
+
+#include <cerebri/core/bezier.h>
+
+#define NSEC 1000000000ULL
+
+/********************************************************************
+ * the power basis evaluation of lib/core/bezier against de Casteljau
+ * on the control points, and its derivatives on the differenced
+ * control points
+ ********************************************************************/
+
+static const double g_x[BEZIER_POINTS] = { 0, 1, 3, 4, 4.5, 7 };
+static const double g_y[BEZIER_POINTS] = { 0, -0.5, 0.2, 2, 3.5, 3 };
+
+// point at beta in [0, 1] of the curve of n control points P
+static double de_casteljau(const double* P, int n, double beta)
+{
+    double b[BEZIER_POINTS];
+    for (int i = 0; i < n; i++) {
+        b[i] = P[i];
+    }
+    for (int k = n - 1; k > 0; k--) {
+        for (int i = 0; i < k; i++) {
+            b[i] = (1 - beta) * b[i] + beta * b[i + 1];
+        }
+    }
+    return b[0];
+}
+
+// position, velocity and acceleration t s into a curve of duration T
+static void reference(const double P[BEZIER_POINTS], double T, double t, double r[3])
+{
+    const int n = BEZIER_POINTS - 1;
+    double dP[BEZIER_POINTS - 1];
+    double ddP[BEZIER_POINTS - 2];
+    for (int i = 0; i < n; i++) {
+        dP[i] = n * (P[i + 1] - P[i]) / T;
+    }
+    for (int i = 0; i < n - 1; i++) {
+        ddP[i] = (n - 1) * (dP[i + 1] - dP[i]) / T;
+    }
+    r[0] = de_casteljau(P, n + 1, t / T);
+    r[1] = de_casteljau(dP, n, t / T);
+    r[2] = de_casteljau(ddP, n - 1, t / T);
+}
+
+static void check_ref(const struct bezier_ref* ref, double T, double t)
+{
+    double x[3], y[3];
+    reference(g_x, T, t, x);
+    reference(g_y, T, t, y);
+    double V2 = x[1] * x[1] + y[1] * y[1];
+
+    zassert_within(ref->x, x[0], 1e-9, "x at %f", t);
+    zassert_within(ref->y, y[0], 1e-9, "y at %f", t);
+    zassert_within(ref->V, sqrt(V2), 1e-9, "V at %f", t);
+    zassert_within(ref->psi, atan2(y[1], x[1]), 1e-9, "psi at %f", t);
+    zassert_within(ref->omega, (x[1] * y[2] - y[1] * x[2]) / V2, 1e-9, "omega at %f", t);
+}
+
+ZTEST(bezier_eval, test_curve_matches_de_casteljau)
+{
+    static const uint64_t durations[] = { NSEC / 10, 2 * NSEC, 37 * NSEC };
+    for (size_t k = 0; k < ARRAY_SIZE(durations); k++) {
+        struct bezier_curve curve;
+        bezier_curve_load(&curve, 5 * NSEC, 5 * NSEC + durations[k], g_x, g_y);
+        double T = (double)durations[k] * 1e-9;
+        for (int i = 0; i <= 100; i++) {
+            struct bezier_ref ref;
+            bezier_curve_eval(&curve, T * i / 100, &ref);
+            check_ref(&ref, T, T * i / 100);
+        }
+    }
+}
+
+ZTEST(bezier_eval, test_curve_ends)
+{
+    struct bezier_curve curve;
+    bezier_curve_load(&curve, 0, 4 * NSEC, g_x, g_y);
+
+    // the ends interpolate the first and the last control point
+    struct bezier_ref ref;
+    bezier_curve_eval(&curve, 0, &ref);
+    zassert_within(ref.x, g_x[0], 1e-12);
+    zassert_within(ref.y, g_y[0], 1e-12);
+    bezier_curve_eval(&curve, 4, &ref);
+    zassert_within(ref.x, g_x[BEZIER_POINTS - 1], 1e-9);
+    zassert_within(ref.y, g_y[BEZIER_POINTS - 1], 1e-9);
+}
+
+ZTEST(bezier_eval, test_stopped_curve)
+{
+    const double p[BEZIER_POINTS] = { 2, 2, 2, 2, 2, 2 };
+    struct bezier_curve curve;
+    bezier_curve_load(&curve, 0, NSEC, p, p);
+
+    struct bezier_ref ref;
+    bezier_curve_eval(&curve, 0.5, &ref);
+    zassert_within(ref.x, 2, 1e-12);
+    zassert_within(ref.V, 0, 1e-12);
+    zassert_within(ref.omega, 0, 1e-12);
+}
+
+static void load_trajectory(struct bezier_cache* cache, const uint64_t* time_stop, int count)
+{
+    static synapse_msgs_BezierTrajectory msg;
+    msg = (synapse_msgs_BezierTrajectory)synapse_msgs_BezierTrajectory_init_default;
+    msg.time_start = NSEC;
+    msg.curves_count = count;
+    for (int i = 0; i < count; i++) {
+        msg.curves[i].time_stop = time_stop[i];
+        msg.curves[i].x_count = BEZIER_POINTS;
+        msg.curves[i].y_count = BEZIER_POINTS;
+        for (int j = 0; j < BEZIER_POINTS; j++) {
+            // the curves join, each starts at the end of the previous
+            msg.curves[i].x[j] = g_x[j] + i * g_x[BEZIER_POINTS - 1];
+            msg.curves[i].y[j] = g_y[j] + i * g_y[BEZIER_POINTS - 1];
+        }
+    }
+    bezier_cache_load(cache, &msg);
+}
+
+ZTEST(bezier_eval, test_cache_walks_curves)
+{
+    static struct bezier_cache cache;
+    const uint64_t time_stop[] = { 3 * NSEC, 4 * NSEC, 8 * NSEC };
+    load_trajectory(&cache, time_stop, ARRAY_SIZE(time_stop));
+
+    struct bezier_ref ref;
+    zassert_equal(bezier_cache_eval(&cache, NSEC - 1, &ref), -EAGAIN);
+
+    // forward across the joins, the curve of each time
+    const uint64_t t[] = { NSEC, 2 * NSEC, 3 * NSEC, 3 * NSEC + 1, 5 * NSEC, 8 * NSEC - 1 };
+    const uint64_t start[] = { NSEC, NSEC, 3 * NSEC, 3 * NSEC, 4 * NSEC, 4 * NSEC };
+    const int index[] = { 0, 0, 1, 1, 2, 2 };
+    for (size_t i = 0; i < ARRAY_SIZE(t); i++) {
+        zassert_equal(bezier_cache_eval(&cache, t[i], &ref), 0);
+        zassert_equal(cache.index, index[i], "index at %d", (int)i);
+
+        double T = (double)(time_stop[index[i]] - start[i]) * 1e-9;
+        double x = de_casteljau(g_x, BEZIER_POINTS, (double)(t[i] - start[i]) * 1e-9 / T);
+        zassert_within(ref.x, x + index[i] * g_x[BEZIER_POINTS - 1], 1e-9);
+    }
+
+    // back in time, found again from the first curve
+    zassert_equal(bezier_cache_eval(&cache, 2 * NSEC, &ref), 0);
+    zassert_equal(cache.index, 0);
+
+    zassert_equal(bezier_cache_eval(&cache, 8 * NSEC, &ref), -ERANGE);
+}
+
+ZTEST(bezier_eval, test_cache_empty)
+{
+    static struct bezier_cache cache;
+    load_trajectory(&cache, NULL, 0);
+
+    struct bezier_ref ref;
+    zassert_equal(bezier_cache_eval(&cache, 2 * NSEC, &ref), -EAGAIN);
+}
+
+ZTEST_SUITE(bezier_eval, NULL, NULL, NULL, NULL, NULL);
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2024 CogniPilot Foundation
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_pub_struct.h>
+#include <zros/zros_node.h>
+#include <zros/zros_pub.h>
+
+#include <cerebri/core/bezier.h>
+
+#include "casadi/gen/b3rb.h"
+
+#define NSEC 1000000000ULL
+#define MSEC 1000000ULL
+
+/********************************************************************
+ * the onboard planner, with the bezier6_solve of b3rb, the waypoints
+ * published on topic_bezier_waypoints as the synapse links do for
+ * their tinyframe type
+ ********************************************************************/
+
+static struct bezier_planner_model g_model = {
+    .name = "test_planner",
+    .solve = bezier6_solve,
+    .solve_work = bezier6_solve_work,
+};
+
+static struct bezier_planner g_planner;
+static struct zros_node g_node;
+static struct zros_pub g_pub;
+static synapse_msgs_BezierTrajectory g_waypoints;
+
+static void* planner_setup(void)
+{
+    zassert_equal(bezier_planner_init(&g_planner, &g_model), 0);
+    zros_node_init(&g_node, "test_waypoints");
+    zros_pub_init(&g_pub, &g_node, &topic_bezier_waypoints, &g_waypoints);
+    return NULL;
+}
+
+static void planner_before(void* fixture)
+{
+    // no curves kept from the previous test
+    g_planner.plan_count = 0;
+    g_model.max_velocity = 2;
+    g_model.max_turn_angle = 0;
+    g_model.wheel_base = 0;
+    g_waypoints = (synapse_msgs_BezierTrajectory)synapse_msgs_BezierTrajectory_init_default;
+}
+
+static void waypoint(int i, uint64_t time_nsec, double x, double vx, double y, double vy)
+{
+    synapse_msgs_BezierCurve* c = &g_waypoints.curves[i];
+    c->time_stop = time_nsec;
+    c->x_count = 2;
+    c->y_count = 2;
+    c->x[0] = x;
+    c->x[1] = vx;
+    c->y[0] = y;
+    c->y[1] = vy;
+    g_waypoints.curves_count = MAX(g_waypoints.curves_count, i + 1);
+}
+
+static int plan(void)
+{
+    // past the rate of the planner subscription
+    k_sleep(K_MSEC(100));
+    zros_pub_update(&g_pub);
+    return bezier_planner_step(&g_planner);
+}
+
+// largest speed and steering angle along curve k of the plan
+static void curve_peaks(int k, double* V_max, double* turn_max)
+{
+    const synapse_msgs_BezierTrajectory* traj = &g_planner.trajectory;
+    uint64_t time_start = k == 0 ? traj->time_start : traj->curves[k - 1].time_stop;
+    struct bezier_curve curve;
+    bezier_curve_load(&curve, time_start, traj->curves[k].time_stop,
+        traj->curves[k].x, traj->curves[k].y);
+
+    double T = (double)(traj->curves[k].time_stop - time_start) * 1e-9;
+    *V_max = 0;
+    *turn_max = 0;
+    for (int i = 0; i <= 1000; i++) {
+        struct bezier_ref ref;
+        bezier_curve_eval(&curve, T * i / 1000, &ref);
+        *V_max = fmax(*V_max, ref.V);
+        if (ref.V > 1e-6) {
+            *turn_max = fmax(*turn_max, fabs(atan(g_model.wheel_base * ref.omega / ref.V)));
+        }
+    }
+}
+
+ZTEST(bezier_planner, test_feasible_shortened)
+{
+    // 5 m from rest to rest, the peak speed of the curve is 15/8 of the
+    // mean, the top speed is reached at 4.6875 s
+    waypoint(0, NSEC, 0, 0, 0, 0);
+    waypoint(1, 11 * NSEC, 5, 0, 0, 0);
+    zassert_equal(plan(), 1);
+
+    zassert_within(g_planner.duration[0], 4687500 * 1000ULL, 2 * MSEC);
+    zassert_equal(g_planner.trajectory.curves[0].time_stop, NSEC + g_planner.duration[0]);
+
+    double V_max, turn_max;
+    curve_peaks(0, &V_max, &turn_max);
+    zassert_true(V_max <= 2 * (1 + 1e-6), "V_max %f", V_max);
+    zassert_true(V_max > 2 * (1 - 1e-3), "V_max %f", V_max);
+}
+
+ZTEST(bezier_planner, test_short_lengthened)
+{
+    // given less than the shortest feasible, doubled then bisected
+    waypoint(0, NSEC, 0, 0, 0, 0);
+    waypoint(1, 3 * NSEC, 5, 0, 0, 0);
+    zassert_equal(plan(), 1);
+    zassert_within(g_planner.duration[0], 4687500 * 1000ULL, 2 * MSEC);
+}
+
+ZTEST(bezier_planner, test_turn_limited)
+{
+    // a quarter turn at 1 m/s, far slower than the speed alone allows
+    g_model.max_turn_angle = 0.4;
+    g_model.wheel_base = 0.3;
+    waypoint(0, NSEC, 0, 1, 0, 0);
+    waypoint(1, 31 * NSEC, 1, 0, 1, 1);
+    zassert_equal(plan(), 1);
+
+    double V_max, turn_max;
+    curve_peaks(0, &V_max, &turn_max);
+    zassert_true(V_max <= 2 * (1 + 1e-6), "V_max %f", V_max);
+    // between the samples of the search the angle may exceed a little
+    zassert_true(turn_max <= 0.4 * 1.02, "turn_max %f", turn_max);
+    zassert_true(turn_max > 0.4 * 0.9, "turn_max %f", turn_max);
+    zassert_true(g_planner.duration[0] < 30 * NSEC);
+}
+
+ZTEST(bezier_planner, test_infeasible_kept)
+{
+    // leaving at 3 m/s is above the top speed at any duration
+    waypoint(0, NSEC, 0, 3, 0, 0);
+    waypoint(1, 5 * NSEC, 5, 0, 0, 0);
+    zassert_equal(plan(), 1);
+    zassert_equal(g_planner.duration[0], 4 * NSEC);
+
+    // the curve is the one solved for the given duration
+    const synapse_msgs_BezierCurve* c = &g_planner.trajectory.curves[0];
+    zassert_equal(c->time_stop, 5 * NSEC);
+    zassert_within(c->x[BEZIER_POINTS - 1], 5, 1e-9);
+    zassert_within(c->x[1] - c->x[0], 3 * 4.0 / (BEZIER_POINTS - 1), 1e-9);
+}
+
+ZTEST(bezier_planner, test_hold_kept)
+{
+    // at rest at one point, nothing bounds the duration from below
+    waypoint(0, NSEC, 1, 0, 2, 0);
+    waypoint(1, 4 * NSEC, 1, 0, 2, 0);
+    waypoint(2, 9 * NSEC, 6, 0, 2, 0);
+    zassert_equal(plan(), 2);
+    zassert_equal(g_planner.duration[0], 3 * NSEC);
+    zassert_within(g_planner.duration[1], 4687500 * 1000ULL, 2 * MSEC);
+    zassert_equal(g_planner.trajectory.curves[1].time_stop,
+        NSEC + 3 * NSEC + g_planner.duration[1]);
+}
+
+ZTEST(bezier_planner, test_zero_duration_rejected)
+{
+    waypoint(0, NSEC, 0, 0, 0, 0);
+    waypoint(1, NSEC, 5, 0, 0, 0);
+    zassert_equal(plan(), -EINVAL);
+}
+
+ZTEST(bezier_planner, test_waypoints_routed)
+{
+    // the links publish each tinyframe type on its own topic
+    const struct synapse_topic_info* info = synapse_topic_from_tf(SYNAPSE_TOPIC_TF_BEZIER_WAYPOINTS);
+    zassert_not_null(info);
+    zassert_equal_ptr(info->topic, &topic_bezier_waypoints);
+
+    info = synapse_topic_from_tf(SYNAPSE_BEZIER_TRAJECTORY_TOPIC);
+    zassert_not_null(info);
+    zassert_equal_ptr(info->topic, &topic_bezier_trajectory);
+}
+
+ZTEST(bezier_planner, test_unchanged_curves_kept)
+{
+    for (int i = 0; i < 4; i++) {
+        waypoint(i, (i + 1) * NSEC, i, 1, i * i, 0.5);
+    }
+    zassert_equal(plan(), 3);
+    synapse_msgs_BezierCurve curves[3];
+    memcpy(curves, g_planner.trajectory.curves, sizeof(curves));
+
+    // the first waypoint passed, one appended, only the new curve solved
+    memmove(&g_waypoints.curves[0], &g_waypoints.curves[1], 3 * sizeof(g_waypoints.curves[0]));
+    waypoint(3, 5 * NSEC, 4, 1, 16, 0.5);
+    zassert_equal(plan(), 1);
+    for (int k = 0; k < 2; k++) {
+        const synapse_msgs_BezierCurve* c = &g_planner.trajectory.curves[k];
+        zassert_mem_equal(c->x, curves[k + 1].x, sizeof(c->x));
+        zassert_mem_equal(c->y, curves[k + 1].y, sizeof(c->y));
+    }
+
+    // the last waypoint moved
+    g_waypoints.curves[3].x[0] = 4.5;
+    zassert_equal(plan(), 1);
+
+    // sent again unchanged
+    zassert_equal(plan(), 0);
+
+    // out of order, the previous plan stays
+    g_waypoints.curves[2].time_stop = NSEC;
+    zassert_equal(plan(), -EINVAL);
+    zassert_equal(g_planner.trajectory.curves_count, 3);
+}
+
+ZTEST_SUITE(bezier_planner, NULL, planner_setup, planner_before, NULL, NULL);
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2024 CogniPilot Foundation
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+
+// zephyr
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <cerebri/core/bezier.h>
+
+#include "casadi/gen/b3rb.h"
+
+#define MY_STACK_SIZE 4096
+#define MY_PRIORITY 10
+
+#define BEZIER_STEPS 2000
+
+LOG_MODULE_DECLARE(pubsub);
+
+/********************************************************************
+ * time per reference of the position controllers over a trajectory of
+ * the most curves a message holds, the cached power basis with Horner
+ * of lib/core/bezier against the scan from the first curve and the
+ * generated bezier6_rover it replaced
+ ********************************************************************/
+static synapse_msgs_BezierTrajectory g_msg;
+static struct bezier_cache g_cache;
+
+static void bezier_trajectory(void)
+{
+    static const double x[6] = { 0, 1, 3, 4, 4.5, 7 };
+    static const double y[6] = { 0, -0.5, 0.2, 2, 3.5, 3 };
+
+    g_msg.time_start = 0;
+    g_msg.curves_count = BEZIER_CURVES_MAX;
+    for (int i = 0; i < (int)BEZIER_CURVES_MAX; i++) {
+        g_msg.curves[i].time_stop = (i + 1) * 1000000000ULL;
+        g_msg.curves[i].x_count = 6;
+        g_msg.curves[i].y_count = 6;
+        for (int j = 0; j < 6; j++) {
+            g_msg.curves[i].x[j] = x[j] + i * x[5];
+            g_msg.curves[i].y[j] = y[j] + i * y[5];
+        }
+    }
+}
+
+// the reference as position control computed it before the cache
+static int bezier_scan(uint64_t time_nsec, double out[5])
+{
+    uint64_t time_start = g_msg.time_start;
+    int i = 0;
+    while (time_nsec >= g_msg.curves[i].time_stop) {
+        time_start = g_msg.curves[i].time_stop;
+        if (++i >= g_msg.curves_count) {
+            return -1;
+        }
+    }
+
+    double T = (g_msg.curves[i].time_stop - time_start) * 1e-9;
+    double t = (time_nsec - time_start) * 1e-9;
+    const casadi_real* args[] = { &t, &T, g_msg.curves[i].x, g_msg.curves[i].y };
+    casadi_real* res[] = { &out[0], &out[1], &out[2], &out[3], &out[4] };
+    casadi_real w[bezier6_rover_SZ_W];
+    bezier6_rover(args, res, NULL, w, 0);
+    return 0;
+}
+
+static void bezier_entry_point(void* p0, void* p1, void* p2)
+{
+    bezier_trajectory();
+    uint64_t time_stop = g_msg.curves[g_msg.curves_count - 1].time_stop;
+
+    uint64_t cycles_scan = 0;
+    uint64_t cycles_cache = 0;
+    double err_max = 0;
+    uint32_t start = k_cycle_get_32();
+    bezier_cache_load(&g_cache, &g_msg);
+    uint32_t cycles_load = k_cycle_get_32() - start;
+
+    // sweep the whole trajectory, forward as the controllers do
+    for (int i = 0; i < BEZIER_STEPS; i++) {
+        uint64_t time_nsec = time_stop / BEZIER_STEPS * i;
+        double out[5];
+        struct bezier_ref ref;
+
+        start = k_cycle_get_32();
+        int rc_scan = bezier_scan(time_nsec, out);
+        cycles_scan += k_cycle_get_32() - start;
+
+        start = k_cycle_get_32();
+        int rc_cache = bezier_cache_eval(&g_cache, time_nsec, &ref);
+        cycles_cache += k_cycle_get_32() - start;
+
+        if (rc_scan < 0 || rc_cache < 0) {
+            LOG_ERR("bezier: no reference at step %d", i);
+            return;
+        }
+        err_max = fmax(err_max, fabs(ref.x - out[0]) + fabs(ref.y - out[1]) + fabs(ref.V - out[3]));
+    }
+
+    if (err_max > 1e-9) {
+        LOG_ERR("bezier: cache differs from bezier6_rover by %g", err_max);
+        return;
+    }
+
+    LOG_INF("bezier: %d curves, load %d ns, scan %d ns, cache %d ns",
+        (int)BEZIER_CURVES_MAX, (int)k_cyc_to_ns_ceil64(cycles_load),
+        (int)k_cyc_to_ns_ceil64(cycles_scan / BEZIER_STEPS),
+        (int)k_cyc_to_ns_ceil64(cycles_cache / BEZIER_STEPS));
+}
+
+K_THREAD_DEFINE(bezier_bench, MY_STACK_SIZE, bezier_entry_point,
+    NULL, NULL, NULL, MY_PRIORITY, 0, 0);
+
+// vi: ts=4 sw=4 et
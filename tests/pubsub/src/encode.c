@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2024 CogniPilot Foundation
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+// zephyr
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <pb_encode.h>
+#include <synapse_tinyframe/SynapseTopics.h>
+#include <synapse_tinyframe/TinyFrame.h>
+#include <synapse_tinyframe/utils.h>
+
+#include <cerebri/synapse/tf_pb.h>
+
+#include <synapse_topic_list.h>
+
+#define MY_STACK_SIZE 4096
+#define MY_PRIORITY 10
+
+#define ENCODE_ITERATIONS 1000
+
+LOG_MODULE_DECLARE(pubsub);
+
+/********************************************************************
+ * compares cycles spent sending a message with the stack buffer
+ * publisher against encoding directly into the frame
+ ********************************************************************/
+static TinyFrame g_tf;
+static uint8_t g_sink[1500];
+static size_t g_sink_len;
+static bool g_sink_overflow;
+
+static void sink_write(TinyFrame* tf, const uint8_t* buf, uint32_t len)
+{
+    // stands in for the copy into the network stack, a frame may be
+    // written in several chunks
+    if (len > sizeof(g_sink) - g_sink_len) {
+        g_sink_overflow = true;
+        return;
+    }
+    memcpy(g_sink + g_sink_len, buf, len);
+    g_sink_len += len;
+}
+
+static void sink_reset(void)
+{
+    g_sink_len = 0;
+    g_sink_overflow = false;
+}
+
+static bool send_stack_buffer(TinyFrame* tf, const synapse_msgs_Odometry* odom)
+{
+    TF_Msg msg;
+    TF_ClearMsg(&msg);
+    uint8_t buf[synapse_msgs_Odometry_size];
+    memset(buf, 0, synapse_msgs_Odometry_size);
+    pb_ostream_t stream = pb_ostream_from_buffer((pu8)buf, sizeof(buf));
+    int rc = pb_encode(&stream, synapse_msgs_Odometry_fields, odom);
+    if (rc) {
+        msg.type = SYNAPSE_ODOMETRY_TOPIC;
+        msg.data = buf;
+        msg.len = stream.bytes_written;
+        TF_Send(tf, &msg);
+    }
+    return rc;
+}
+
+static void encode_entry_point(void* p0, void* p1, void* p2)
+{
+    synapse_msgs_Odometry odom = synapse_msgs_Odometry_init_default;
+    odom.has_header = true;
+    strncpy(odom.header.frame_id, "odom", sizeof(odom.header.frame_id) - 1);
+    strncpy(odom.child_frame_id, "base_link", sizeof(odom.child_frame_id) - 1);
+    odom.has_pose = true;
+    odom.pose.has_pose = true;
+    odom.pose.pose.has_position = true;
+    odom.pose.pose.position.x = 1.5;
+    odom.pose.pose.position.y = -2.25;
+    odom.pose.pose.has_orientation = true;
+    odom.pose.pose.orientation.w = 1;
+    odom.has_twist = true;
+    odom.twist.has_twist = true;
+    odom.twist.twist.has_linear = true;
+    odom.twist.twist.linear.x = 0.5;
+
+    TF_InitStatic(&g_tf, TF_MASTER, sink_write);
+
+    // both paths must produce the same frame, fail the test otherwise
+    sink_reset();
+    send_stack_buffer(&g_tf, &odom);
+    uint8_t expected[sizeof(g_sink)];
+    size_t expected_len = g_sink_len;
+    bool expected_overflow = g_sink_overflow;
+    memcpy(expected, g_sink, expected_len);
+    // each send takes the next frame id, restart so both frames get the same id
+    TF_InitStatic(&g_tf, TF_MASTER, sink_write);
+    sink_reset();
+    synapse_tf_send_pb(&g_tf, SYNAPSE_ODOMETRY_TOPIC, synapse_msgs_Odometry_fields, &odom);
+    if (expected_overflow || g_sink_overflow || expected_len == 0
+        || g_sink_len != expected_len || memcmp(expected, g_sink, expected_len) != 0) {
+        LOG_ERR("encode: frame mismatch");
+        k_panic();
+    }
+
+    uint32_t start = k_cycle_get_32();
+    for (int i = 0; i < ENCODE_ITERATIONS; i++) {
+        sink_reset();
+        send_stack_buffer(&g_tf, &odom);
+    }
+    uint32_t cycles_stack = k_cycle_get_32() - start;
+
+    start = k_cycle_get_32();
+    for (int i = 0; i < ENCODE_ITERATIONS; i++) {
+        sink_reset();
+        synapse_tf_send_pb(&g_tf, SYNAPSE_ODOMETRY_TOPIC, synapse_msgs_Odometry_fields, &odom);
+    }
+    uint32_t cycles_direct = k_cycle_get_32() - start;
+
+    LOG_INF("encode: frame %d bytes, stack buffer %d cycles/msg, direct %d cycles/msg",
+        (int)expected_len, cycles_stack / ENCODE_ITERATIONS, cycles_direct / ENCODE_ITERATIONS);
+}
+
+K_THREAD_DEFINE(encode, MY_STACK_SIZE, encode_entry_point,
+    NULL, NULL, NULL, MY_PRIORITY, 0, 0);
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2024 CogniPilot Foundation
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+
+// zephyr
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "mpc.h"
+
+#define MY_STACK_SIZE 8192
+#define MY_PRIORITY 10
+
+#define MPC_STEPS 2000
+#define MPC_RATE_HZ 200
+
+LOG_MODULE_DECLARE(pubsub);
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/********************************************************************
+ * worst case solve time of the b3rb path following mpc, closing the
+ * loop on a unicycle around a 5 m circle at 2 m/s from an offset start,
+ * against the period of a 200 Hz pose
+ ********************************************************************/
+static const struct mpc_params g_params = {
+    .dt = 0.1,
+    .q = { 1, 10, 4 },
+    .r = { 0.1, 0.05 },
+    .max_velocity = 3,
+    .max_turn_angle = 0.4,
+    .wheel_base = 0.226,
+    .iterations = 50,
+};
+
+static struct mpc g_mpc;
+
+static void mpc_entry_point(void* p0, void* p1, void* p2)
+{
+    const double radius = 5;
+    const double speed = 2;
+    const double h = 1.0 / MPC_RATE_HZ;
+
+    double V[MPC_N], omega[MPC_N];
+    for (int k = 0; k < MPC_N; k++) {
+        V[k] = speed;
+        omega[k] = speed / radius;
+    }
+
+    // reference starts at (radius, 0) heading north, the rover off by
+    // 0.5 m and 0.3 rad
+    double x = radius - 0.5, y = 0, theta = M_PI / 2 + 0.3;
+
+    mpc_init(&g_mpc, &g_params);
+    uint32_t cycles_max = 0;
+    uint64_t cycles_sum = 0;
+    double e[3] = {};
+    for (int i = 0; i < MPC_STEPS; i++) {
+        double a = speed / radius * i * h;
+        double dx = radius * cos(a) - x;
+        double dy = radius * sin(a) - y;
+        e[0] = cos(theta) * dx + sin(theta) * dy;
+        e[1] = -sin(theta) * dx + cos(theta) * dy;
+        e[2] = atan2(sin(a + M_PI / 2 - theta), cos(a + M_PI / 2 - theta));
+
+        double v, w;
+        uint32_t start = k_cycle_get_32();
+        int rc = mpc_solve(&g_mpc, e, V, omega, &v, &w);
+        uint32_t cycles = k_cycle_get_32() - start;
+        if (rc < 0) {
+            LOG_ERR("mpc: solution not finite at step %d", i);
+            return;
+        }
+        cycles_max = cycles > cycles_max ? cycles : cycles_max;
+        cycles_sum += cycles;
+
+        x += v * cos(theta) * h;
+        y += v * sin(theta) * h;
+        theta += w * h;
+    }
+
+    if (hypot(e[0], e[1]) > 0.05) {
+        LOG_ERR("mpc: not converged, error %f m", hypot(e[0], e[1]));
+        return;
+    }
+
+    LOG_INF("mpc: horizon %d, %d iterations, mean %d us, worst %d us of %d us",
+        MPC_N, g_params.iterations,
+        (int)k_cyc_to_us_ceil32((uint32_t)(cycles_sum / MPC_STEPS)),
+        (int)k_cyc_to_us_ceil32(cycles_max), 1000000 / MPC_RATE_HZ);
+}
+
+K_THREAD_DEFINE(mpc_bench, MY_STACK_SIZE, mpc_entry_point,
+    NULL, NULL, NULL, MY_PRIORITY, 0, 0);
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2024 CogniPilot Foundation
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+
+// zephyr
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "vote.h"
+
+#define MY_STACK_SIZE 4096
+#define MY_PRIORITY 10
+
+#define SENSE_ITERATIONS 1000
+#define SENSE_IMU_COUNT 3
+
+LOG_MODULE_DECLARE(pubsub);
+
+/********************************************************************
+ * cycles spent per tick by the sensor data path for 3 imus, a mag and
+ * a baro, the conversions and calibration as in lib/sense and the
+ * voting of lib/sense/imu/vote.c
+ ********************************************************************/
+static struct sensor_value g_accel_value[SENSE_IMU_COUNT][3];
+static struct sensor_value g_gyro_value[SENSE_IMU_COUNT][3];
+static struct sensor_value g_mag_value[3];
+static struct sensor_value g_press_value;
+static struct sensor_value g_temp_value;
+
+static float g_accel_bias[SENSE_IMU_COUNT][3];
+static float g_accel_scale[SENSE_IMU_COUNT];
+static float g_gyro_bias[SENSE_IMU_COUNT][3];
+
+static const struct imu_vote_config g_vote_config = {
+    .fusion = IMU_VOTE_FUSION_MEDIAN,
+    .stuck_count = 100,
+    .noise_max = 1.0f,
+    .error_max = 1.0f,
+    .alpha = 0.02f,
+};
+
+static struct imu_vote g_accel_vote;
+static struct imu_vote g_gyro_vote;
+
+// result, kept so the compiler can't drop the work
+static volatile float g_out_f;
+
+// vary the samples so the vote doesn't see stuck sensors
+static void sense_sample(int n)
+{
+    for (int i = 0; i < SENSE_IMU_COUNT; i++) {
+        for (int j = 0; j < 3; j++) {
+            g_accel_value[i][j].val1 = j == 2 ? 9 : 0;
+            g_accel_value[i][j].val2 = 123456 * (i + 1) + j + n % 7;
+            g_gyro_value[i][j].val1 = 0;
+            g_gyro_value[i][j].val2 = 1000 * (i + 1) + j + n % 5;
+        }
+    }
+    for (int j = 0; j < 3; j++) {
+        g_mag_value[j].val1 = 0;
+        g_mag_value[j].val2 = 250000 + j + n % 3;
+    }
+    g_press_value.val1 = 100;
+    g_press_value.val2 = 525000 + n % 11;
+    g_temp_value.val1 = 25;
+    g_temp_value.val2 = 0;
+}
+
+static void sense_tick(void)
+{
+    float accel[SENSE_IMU_COUNT][3];
+    float gyro[SENSE_IMU_COUNT][3];
+    float accel_fused[3];
+    float gyro_fused[3];
+
+    // lib/sense/imu, read and calibrate each sensor, then vote
+    for (int i = 0; i < SENSE_IMU_COUNT; i++) {
+        for (int j = 0; j < 3; j++) {
+            float a = sensor_value_to_float(&g_accel_value[i][j]);
+            accel[i][j] = (a - g_accel_bias[i][j]) / g_accel_scale[i];
+            gyro[i][j] = sensor_value_to_float(&g_gyro_value[i][j]) - g_gyro_bias[i][j];
+        }
+    }
+    imu_vote_update(&g_accel_vote, (const float(*)[3])accel, accel_fused);
+    imu_vote_update(&g_gyro_vote, (const float(*)[3])gyro, gyro_fused);
+
+    // lib/sense/mag and lib/sense/baro
+    float mag[3];
+    for (int j = 0; j < 3; j++) {
+        mag[j] = sensor_value_to_float(&g_mag_value[j]);
+    }
+    float press = sensor_value_to_float(&g_press_value);
+    float temp = sensor_value_to_float(&g_temp_value);
+    float alt = ((powf((101.325f / press), 1 / 5.257f) - 1.0f) * (15.0f + 273.15f)) / 0.0065f;
+
+    g_out_f = accel_fused[2] + gyro_fused[0] + mag[0] + temp + alt;
+}
+
+static void sense_entry_point(void* p0, void* p1, void* p2)
+{
+    for (int i = 0; i < SENSE_IMU_COUNT; i++) {
+        for (int j = 0; j < 3; j++) {
+            g_accel_bias[i][j] = 0.01f * j;
+            g_gyro_bias[i][j] = 0.001f * j;
+        }
+        g_accel_scale[i] = 1.0f + 0.001f * i;
+    }
+    imu_vote_init(&g_accel_vote, SENSE_IMU_COUNT, &g_vote_config);
+    imu_vote_init(&g_gyro_vote, SENSE_IMU_COUNT, &g_vote_config);
+
+    uint32_t cycles_tick = 0;
+    for (int i = 0; i < SENSE_ITERATIONS; i++) {
+        sense_sample(i);
+        uint32_t start = k_cycle_get_32();
+        sense_tick();
+        cycles_tick += k_cycle_get_32() - start;
+    }
+
+    LOG_INF("sense: tick %d cycles", cycles_tick / SENSE_ITERATIONS);
+}
+
+K_THREAD_DEFINE(sense_bench, MY_STACK_SIZE, sense_entry_point,
+    NULL, NULL, NULL, MY_PRIORITY, 0, 0);
+
+// vi: ts=4 sw=4 et
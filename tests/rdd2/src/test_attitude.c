@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2024 CogniPilot Foundation
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <math.h>
+
+#include <zephyr/ztest.h>
+
+#include "attitude.h"
+
+#define GRAVITY 9.80665
+#define RATE_HZ 200
+
+/********************************************************************
+ * the nonlinear complementary filter of app/rdd2/src/attitude.c, as
+ * run by the rdd2 estimate thread on each imu sample
+ ********************************************************************/
+
+// v_body = R^T v_world
+static void to_body(const double q[4], const double v[3], double r[3])
+{
+    const double qc[4] = { q[0], -q[1], -q[2], -q[3] };
+    const double p[4] = { 0, v[0], v[1], v[2] };
+    double t[4];
+    double s[4];
+    quat_mul(qc, p, t);
+    quat_mul(t, q, s);
+    r[0] = s[1];
+    r[1] = s[2];
+    r[2] = s[3];
+}
+
+// angle of the rotation between two attitudes
+static double quat_angle(const double a[4], const double b[4])
+{
+    double d = fabs(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]);
+    return 2 * acos(d > 1 ? 1 : d);
+}
+
+// tilt of the body z axis away from where it should be
+static double tilt_error(const double q[4], const double q_true[4])
+{
+    static const double e3[3] = { 0, 0, 1 };
+    double up[3];
+    double up_true[3];
+    to_body(q, e3, up);
+    to_body(q_true, e3, up_true);
+    double d = up[0] * up_true[0] + up[1] * up_true[1] + up[2] * up_true[2];
+    return acos(d > 1 ? 1 : d);
+}
+
+// hold a stationary vehicle at q_true for sec, with a biased gyro
+static void run_stationary(struct attitude* att, const struct attitude_gains* gains,
+    const double q_true[4], const double bias[3], const double* mag_world, double sec)
+{
+    static const double g_world[3] = { 0, 0, GRAVITY };
+    double accel[3];
+    double mag[3];
+    to_body(q_true, g_world, accel);
+    if (mag_world != NULL) {
+        to_body(q_true, mag_world, mag);
+    }
+    double rate[3];
+    for (int i = 0; i < sec * RATE_HZ; i++) {
+        attitude_update(att, gains, bias, accel, mag_world != NULL ? mag : NULL,
+            1.0 / RATE_HZ, rate);
+    }
+}
+
+ZTEST(rdd2_attitude, test_init_level)
+{
+    struct attitude att;
+    const double accel[3] = { 0, 0, GRAVITY };
+    zassert_equal(attitude_init(&att, accel, NULL, 0), 0);
+
+    // body x east, yaw 0, without a magnetometer
+    const double q_true[4] = { 1, 0, 0, 0 };
+    zassert_within(quat_angle(att.q, q_true), 0, 1e-9);
+    for (int i = 0; i < 3; i++) {
+        zassert_within(att.bias[i], 0, 1e-12);
+    }
+}
+
+ZTEST(rdd2_attitude, test_init_tilted)
+{
+    double q_true[4];
+    quat_from_euler(0.3, -0.2, 0, q_true);
+    static const double g_world[3] = { 0, 0, GRAVITY };
+    double accel[3];
+    to_body(q_true, g_world, accel);
+
+    struct attitude att;
+    zassert_equal(attitude_init(&att, accel, NULL, 0), 0);
+    zassert_within(tilt_error(att.q, q_true), 0, 1e-9);
+}
+
+ZTEST(rdd2_attitude, test_init_free_fall)
+{
+    struct attitude att;
+    const double accel[3] = { 0, 0, 0 };
+    zassert_equal(attitude_init(&att, accel, NULL, 0), -EINVAL);
+}
+
+ZTEST(rdd2_attitude, test_tilt_and_bias_converge)
+{
+    const struct attitude_gains gains = { .accel = 1, .bias = 0.05 };
+    const double accel[3] = { 0, 0, GRAVITY };
+    struct attitude att;
+    zassert_equal(attitude_init(&att, accel, NULL, 0), 0);
+
+    // started level, the vehicle is tilted and the gyro biased
+    double q_true[4];
+    quat_from_euler(0.2, -0.1, 0, q_true);
+    const double bias[3] = { 0.01, -0.02, 0 };
+    run_stationary(&att, &gains, q_true, bias, NULL, 120);
+
+    // the yaw bias is only observable with the magnetometer, see below
+    zassert_within(tilt_error(att.q, q_true), 0, 1e-3);
+    zassert_within(att.bias[0], bias[0], 1e-3);
+    zassert_within(att.bias[1], bias[1], 1e-3);
+}
+
+ZTEST(rdd2_attitude, test_mag_corrects_yaw_only)
+{
+    const struct attitude_gains gains = { .accel = 1, .mag = 0.5, .bias = 0.05 };
+    const double accel[3] = { 0, 0, GRAVITY };
+    struct attitude att;
+    zassert_equal(attitude_init(&att, accel, NULL, 0), 0);
+
+    // level, turned 0.5 rad, the field points north and down
+    double q_true[4];
+    quat_from_euler(0, 0, 0.5, q_true);
+    const double mag_world[3] = { 0, 0.2, -0.4 };
+    const double bias[3] = { 0, 0, 0.01 };
+
+    // the yaw correction must not tilt the estimate on the way
+    for (int i = 0; i < 180; i++) {
+        run_stationary(&att, &gains, q_true, bias, mag_world, 1);
+        zassert_within(tilt_error(att.q, q_true), 0, 1e-3);
+    }
+    zassert_within(quat_yaw(att.q), 0.5, 1e-3);
+    zassert_within(att.bias[2], bias[2], 1e-3);
+}
+
+ZTEST(rdd2_attitude, test_rate_is_bias_corrected)
+{
+    const struct attitude_gains gains = { .accel = 1, .bias = 0.05 };
+    const double accel[3] = { 0, 0, GRAVITY };
+    struct attitude att;
+    zassert_equal(attitude_init(&att, accel, NULL, 0), 0);
+    att.bias[0] = 0.1;
+
+    const double omega[3] = { 0.5, 0, 0 };
+    double rate[3];
+    attitude_update(&att, &gains, omega, accel, NULL, 1.0 / RATE_HZ, rate);
+    zassert_within(rate[0], 0.4, 1e-6);
+}
+
+ZTEST_SUITE(rdd2_attitude, NULL, NULL, NULL, NULL, NULL);
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2024 CogniPilot Foundation
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/ztest.h>
+
+#include "rate_pid.h"
+
+#define DT 0.005
+
+/********************************************************************
+ * the rate pid of app/rdd2/src/rate_pid.c, as run on each axis by the
+ * rdd2 velocity controller
+ ********************************************************************/
+
+ZTEST(rdd2_rate_pid, test_proportional_and_feedforward)
+{
+    struct rate_pid pid = { .kp = 2, .kff = 0.5, .integral_max = 1, .d_cutoff_hz = 30 };
+    rate_pid_reset(&pid, 0.5);
+    zassert_within(rate_pid_update(&pid, 1, 0.5, DT), 0.5 * 1 + 2 * 0.5, 1e-12);
+}
+
+ZTEST(rdd2_rate_pid, test_integral_clamped)
+{
+    struct rate_pid pid = { .ki = 10, .integral_max = 0.3, .d_cutoff_hz = 30 };
+    rate_pid_reset(&pid, 0);
+
+    // 1 rad/s of error integrates at 10/s, up to the clamp
+    double u = rate_pid_update(&pid, 1, 0, DT);
+    zassert_within(u, 10 * DT, 1e-12);
+    for (int i = 0; i < 200; i++) {
+        u = rate_pid_update(&pid, 1, 0, DT);
+    }
+    zassert_within(u, 0.3, 1e-12);
+
+    // and back down to the other side
+    for (int i = 0; i < 200; i++) {
+        u = rate_pid_update(&pid, -1, 0, DT);
+    }
+    zassert_within(u, -0.3, 1e-12);
+
+    rate_pid_reset(&pid, 0);
+    zassert_within(pid.integral, 0, 1e-12);
+}
+
+ZTEST(rdd2_rate_pid, test_no_derivative_kick)
+{
+    struct rate_pid pid = { .kd = 1, .integral_max = 1, .d_cutoff_hz = 30 };
+    rate_pid_reset(&pid, 0.2);
+
+    // a setpoint step with the rate steady leaves the derivative at rest
+    zassert_within(rate_pid_update(&pid, 0, 0.2, DT), 0, 1e-12);
+    zassert_within(rate_pid_update(&pid, 5, 0.2, DT), 0, 1e-12);
+}
+
+ZTEST(rdd2_rate_pid, test_derivative_low_passed)
+{
+    struct rate_pid pid = { .kd = 1, .integral_max = 1, .d_cutoff_hz = 30 };
+    rate_pid_reset(&pid, 0);
+
+    // a rate ramping at 2 rad/s^2 is opposed by -2, reached through the
+    // low pass rather than on the first step
+    double u = rate_pid_update(&pid, 0, 2 * DT, DT);
+    zassert_true(u < 0 && u > -2, "u %f", u);
+    for (int i = 2; i < 200; i++) {
+        u = rate_pid_update(&pid, 0, 2 * DT * i, DT);
+    }
+    zassert_within(u, -2, 1e-6);
+}
+
+ZTEST(rdd2_rate_pid, test_closed_loop_settles)
+{
+    // a rigid body, torque is angular acceleration, tracks a rate step
+    // with no steady state error despite a constant disturbance
+    struct rate_pid pid = {
+        .kp = 0.5, .ki = 2, .kd = 0.001, .integral_max = 1, .d_cutoff_hz = 30
+    };
+    double rate = 0;
+    rate_pid_reset(&pid, rate);
+    for (int i = 0; i < 5 / DT; i++) {
+        double torque = rate_pid_update(&pid, 1, rate, DT);
+        rate += (torque - 0.2) * 20 * DT;
+    }
+    zassert_within(rate, 1, 1e-3);
+    zassert_within(pid.integral, 0.2, 1e-3);
+}
+
+ZTEST_SUITE(rdd2_rate_pid, NULL, NULL, NULL, NULL, NULL);
+
+// vi: ts=4 sw=4 et